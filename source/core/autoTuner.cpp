@@ -0,0 +1,219 @@
+#include "core/autoTuner.h"
+
+#include "core/crfSolver.h"
+#include "core/imageAligner.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/taskScheduler.h"
+#include "core/toneMapper.h"
+#include "core/toneStatistics.h"
+#include "core/tuningProfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace shdr {
+
+namespace {
+
+double elapsedMilliseconds(const std::chrono::steady_clock::time_point& begin,
+                           const std::chrono::steady_clock::time_point& end) {
+
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+} // anonymous namespace
+
+AutoTuner::AutoTuner(const std::string& imageAligner,
+                     const std::string& crfSolver,
+                     const std::string& toneMapper) :
+    _imageAligner(StageFactory::createImageAligner(imageAligner)),
+    _crfSolver(StageFactory::createCrfSolver(crfSolver)),
+    _toneMapper(StageFactory::createToneMapper(toneMapper)),
+    _scratchArena(std::make_shared<ScratchArena>()) {
+
+    _imageAligner->setScratchArena(_scratchArena.get());
+    _crfSolver->setScratchArena(_scratchArena.get());
+    _toneMapper->setScratchArena(_scratchArena.get());
+}
+
+AutoTuner::~AutoTuner() = default;
+
+void AutoTuner::tune(const std::vector<cv::Mat>& images,
+                     const std::vector<float>&   shutterSpeeds,
+                     TuningProfile* const        inout_profile) const {
+
+    if (images.empty() || images.size() != shutterSpeeds.size()) {
+        std::cout << "Auto-tuning needs images with their shutter speeds"
+                  << std::endl;
+
+        return;
+    }
+
+    const int resolutionClass = TaskScheduler::resolutionClass(images[0].cols, images[0].rows);
+
+    std::cout << "# Begin to auto-tune on " << images.size() << " images of "
+              << images[0].cols << "x" << images[0].rows
+              << " (" << TuningProfile::resolutionClassName(resolutionClass) << ")"
+              << std::endl;
+
+    // the response curve is solved once, it is not a timed kernel
+    cv::Mat crf;
+    _crfSolver->solveCrf(images, shutterSpeeds, &crf);
+
+    /*
+        Thread counts from one per core down to one,
+        halving below three quarters of the cores
+    */
+    const int numCpus = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<int> threadCandidates = { numCpus };
+    if (numCpus * 3 / 4 > numCpus / 2) {
+        threadCandidates.push_back(numCpus * 3 / 4);
+    }
+    for (int numThreads = numCpus / 2; numThreads >= 1; numThreads /= 2) {
+        threadCandidates.push_back(numThreads);
+    }
+
+    const std::vector<int> bandCandidates = { 4, 8, 16, 32, 64, 128 };
+
+    std::vector<std::string> report;
+
+    const auto timeSetting = [&](const int numThreads, const int rowBandSize) {
+        StageTimes times;
+        _timeStages(images, shutterSpeeds, crf, &times);
+
+        report.push_back("    threads " + std::to_string(numThreads) +
+                         ", row band " + std::to_string(rowBandSize) +
+                         ": align " + std::to_string(times.alignMs) +
+                         " ms, merge " + std::to_string(times.mergeMs) +
+                         " ms, tone mapping " + std::to_string(times.toneMapMs) +
+                         " ms, total " + std::to_string(times.alignMs + times.mergeMs + times.toneMapMs) + " ms");
+
+        return times;
+    };
+
+    const auto setStageRowBandSizes = [resolutionClass](const int rowBandSize) {
+        TaskScheduler::setStageRowBandSize(StageType::S_ALIGN,    resolutionClass, rowBandSize);
+        TaskScheduler::setStageRowBandSize(StageType::S_MERGE,    resolutionClass, rowBandSize);
+        TaskScheduler::setStageRowBandSize(StageType::S_TONE_MAP, resolutionClass, rowBandSize);
+    };
+
+    /*
+        The number of threads is searched on the total time
+        with the default row band size in every stage
+    */
+    TaskScheduler::setRowBandSize(0);
+    setStageRowBandSizes(0);
+
+    int        bestThreads = numCpus;
+    StageTimes bestTimes   = {};
+    double     bestMs      = std::numeric_limits<double>::max();
+    for (const int numThreads : threadCandidates) {
+        TaskScheduler::setNumThreads(numThreads);
+
+        const StageTimes times   = timeSetting(numThreads, TaskScheduler::instance().rowBandSize());
+        const double     totalMs = times.alignMs + times.mergeMs + times.toneMapMs;
+        if (totalMs < bestMs) {
+            bestMs      = totalMs;
+            bestTimes   = times;
+            bestThreads = numThreads;
+        }
+    }
+
+    TaskScheduler::setNumThreads(bestThreads);
+
+    /*
+        Stages are timed separately, so one sweep over the
+        row band sizes finds the best one of every stage
+    */
+    const int defaultBandSize = TaskScheduler::instance().rowBandSize();
+
+    int bestAlignBandSize   = defaultBandSize;
+    int bestMergeBandSize   = defaultBandSize;
+    int bestToneMapBandSize = defaultBandSize;
+    for (const int rowBandSize : bandCandidates) {
+        if (rowBandSize == defaultBandSize) {
+            continue;
+        }
+
+        setStageRowBandSizes(rowBandSize);
+
+        const StageTimes times = timeSetting(bestThreads, rowBandSize);
+        if (times.alignMs < bestTimes.alignMs) {
+            bestTimes.alignMs = times.alignMs;
+            bestAlignBandSize = rowBandSize;
+        }
+        if (times.mergeMs < bestTimes.mergeMs) {
+            bestTimes.mergeMs = times.mergeMs;
+            bestMergeBandSize = rowBandSize;
+        }
+        if (times.toneMapMs < bestTimes.toneMapMs) {
+            bestTimes.toneMapMs = times.toneMapMs;
+            bestToneMapBandSize = rowBandSize;
+        }
+    }
+
+    // other resolution classes of the profile are kept
+    inout_profile->setNumThreads(bestThreads);
+    inout_profile->setStageRowBandSize(StageType::S_ALIGN,    resolutionClass, bestAlignBandSize);
+    inout_profile->setStageRowBandSize(StageType::S_MERGE,    resolutionClass, bestMergeBandSize);
+    inout_profile->setStageRowBandSize(StageType::S_TONE_MAP, resolutionClass, bestToneMapBandSize);
+    inout_profile->apply();
+
+    std::cout << "# Auto-tuning results"
+              << std::endl;
+    for (const std::string& line : report) {
+        std::cout << line
+                  << std::endl;
+    }
+    std::cout << "# Best: " << bestThreads << " threads, row band size "
+              << bestAlignBandSize << " for alignment, "
+              << bestMergeBandSize << " for merge, "
+              << bestToneMapBandSize << " for tone mapping ("
+              << (bestTimes.alignMs + bestTimes.mergeMs + bestTimes.toneMapMs) << " ms)"
+              << std::endl;
+}
+
+void AutoTuner::_timeStages(const std::vector<cv::Mat>& images,
+                            const std::vector<float>&   shutterSpeeds,
+                            const cv::Mat&              crf,
+                            StageTimes* const           out_times) const {
+
+    out_times->alignMs   = std::numeric_limits<double>::max();
+    out_times->mergeMs   = std::numeric_limits<double>::max();
+    out_times->toneMapMs = std::numeric_limits<double>::max();
+
+    // run 0 warms up the scratch arena and the pool, it is not timed
+    for (int run = 0; run <= NUM_RUNS; ++run) {
+        std::vector<cv::Mat> alignImages;
+        cv::Mat              hdri;
+        ToneStatistics       statistics;
+        cv::Mat              ldri;
+
+        // a real run builds the reference pyramid once, so must every timed run
+        _imageAligner->clearCache();
+
+        const auto alignBegin = std::chrono::steady_clock::now();
+        _imageAligner->align(images, &alignImages);
+
+        const auto mergeBegin = std::chrono::steady_clock::now();
+        _crfSolver->merge(alignImages, shutterSpeeds, crf, &hdri, &statistics);
+
+        const auto toneMapBegin = std::chrono::steady_clock::now();
+        _toneMapper->map(hdri, statistics, &ldri);
+
+        const auto end = std::chrono::steady_clock::now();
+
+        if (run > 0) {
+            out_times->alignMs   = std::min(out_times->alignMs,   elapsedMilliseconds(alignBegin, mergeBegin));
+            out_times->mergeMs   = std::min(out_times->mergeMs,   elapsedMilliseconds(mergeBegin, toneMapBegin));
+            out_times->toneMapMs = std::min(out_times->toneMapMs, elapsedMilliseconds(toneMapBegin, end));
+        }
+    }
+}
+
+} // namespace shdr
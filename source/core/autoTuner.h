@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+class CrfSolver;
+class ImageAligner;
+class ScratchArena;
+class ToneMapper;
+class TuningProfile;
+
+/*
+    AutoTuner finds the task scheduler settings that run
+    the pipeline fastest on the current host.
+
+    The alignment, merge and tone mapping kernels are timed
+    on a bracket of the images the host usually processes,
+    since the best grain depends on the image size as much
+    as on the cores and caches. The number of threads is
+    searched first with the default row band size, then the
+    row band size of each stage with the best number of
+    threads, for the resolution class of the images. Each
+    setting is timed as the fastest of a few runs after a
+    warm-up run, so the scratch arena is already filled.
+*/
+class AutoTuner {
+public:
+    AutoTuner(const std::string& imageAligner = "mtb",
+              const std::string& crfSolver    = "debevec",
+              const std::string& toneMapper   = "bilateral");
+    ~AutoTuner();
+
+    // the scheduler is left with the best settings, the profile
+    // keeps the row band sizes of other resolution classes
+    void tune(const std::vector<cv::Mat>& images,
+              const std::vector<float>&   shutterSpeeds,
+              TuningProfile* const        inout_profile) const;
+
+private:
+    struct StageTimes {
+        double alignMs;
+        double mergeMs;
+        double toneMapMs;
+    };
+
+    // fastest time of each stage with the current scheduler settings
+    void _timeStages(const std::vector<cv::Mat>& images,
+                     const std::vector<float>&   shutterSpeeds,
+                     const cv::Mat&              crf,
+                     StageTimes* const           out_times) const;
+
+    std::shared_ptr<ImageAligner> _imageAligner;
+    std::shared_ptr<CrfSolver>    _crfSolver;
+    std::shared_ptr<ToneMapper>   _toneMapper;
+    std::shared_ptr<ScratchArena> _scratchArena;
+
+    static const int NUM_RUNS = 3;
+};
+
+} // namespace shdr
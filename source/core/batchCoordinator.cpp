@@ -0,0 +1,245 @@
+#include "core/batchCoordinator.h"
+
+#include "core/workerChannel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace shdr {
+
+namespace {
+
+/*
+    Timing report of one worker, as seen by the coordinator 
+    (busy) and as reported by the worker itself (run)
+*/
+struct WorkerReport {
+    int    numJobs     = 0;
+    int    numFailures = 0;
+    int    numCrfHits  = 0;
+    double busyMs      = 0.0;
+    double runMs       = 0.0;
+    bool   isLost      = false;
+};
+
+struct PendingJob {
+    std::size_t index;
+    int         numAttempts;
+};
+
+} // anonymous namespace
+
+BatchCoordinator::BatchCoordinator(const std::string& manifestFilename,
+                                   const int          numRetries,
+                                   const int          jobTimeoutSeconds) :
+    _jobs(),
+    _numRetries(numRetries),
+    _jobTimeoutMs((jobTimeoutSeconds > 0) ? jobTimeoutSeconds * 1000 : -1),
+    _numMalformed(0) {
+
+    std::ifstream manifest(manifestFilename);
+    if (!manifest) {
+        std::cout << "Manifest file can't open !"
+                  << std::endl;
+
+        return;
+    }
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        const std::size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        JsonValue job;
+        if (!JsonValue::parse(line, &job) || job.type() != JsonType::J_OBJECT) {
+            std::cout << "    Malformed manifest line: " << line
+                      << std::endl;
+
+            ++_numMalformed;
+
+            continue;
+        }
+
+        // responses are matched to jobs by id
+        if (!job.has("id")) {
+            job.set("id", std::to_string(_jobs.size() + 1));
+        }
+
+        _jobs.push_back(job);
+    }
+}
+
+std::size_t BatchCoordinator::numJobs() const {
+    return _jobs.size();
+}
+
+int BatchCoordinator::run(const std::vector<WorkerChannel*>& workers) const {
+    using Clock = std::chrono::steady_clock;
+
+    std::cout << "# Begin to run " << _jobs.size() << " jobs on " 
+              << workers.size() << " workers"
+              << std::endl;
+
+    const Clock::time_point startTime = Clock::now();
+
+    std::deque<PendingJob>    queue;
+    int                       numInFlight = 0;
+    int                       numFailed   = 0;
+    int                       numAlive    = static_cast<int>(workers.size());
+    std::mutex                mutex;
+    std::condition_variable   changed;
+    std::vector<WorkerReport> reports(workers.size());
+
+    for (std::size_t i = 0; i < _jobs.size(); ++i) {
+        queue.push_back({ i, 0 });
+    }
+
+    /*
+        Each worker has its own thread which takes the next 
+        job whenever its worker is idle, a job which fails is
+        queued again until it runs out of attempts
+    */
+    std::vector<std::thread> threads;
+    for (std::size_t w = 0; w < workers.size(); ++w) {
+        threads.emplace_back([&, w]() {
+            WorkerChannel* const worker = workers[w];
+            WorkerReport&        report = reports[w];
+
+            while (true) {
+                PendingJob job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() {
+                        return !queue.empty() || numInFlight == 0;
+                    });
+
+                    if (queue.empty()) {
+                        return;
+                    }
+
+                    job = queue.front();
+                    queue.pop_front();
+                    ++numInFlight;
+                }
+
+                const JsonValue&        request  = _jobs[job.index];
+                const std::string       id       = request["id"].asString(request["id"].dump());
+                const Clock::time_point jobStart = Clock::now();
+
+                std::string line;
+                const bool isReached = worker->send(request.dump()) && worker->receive(&line, _jobTimeoutMs);
+
+                JsonValue response;
+                const bool isOk = isReached &&
+                                  JsonValue::parse(line, &response) &&
+                                  response["status"].asString() == "ok";
+
+                const double busyMs = std::chrono::duration<double, std::milli>(Clock::now() - jobStart).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+
+                report.busyMs += busyMs;
+                if (isOk) {
+                    report.numJobs += 1;
+                    report.runMs   += response["runMs"].asNumber();
+                    report.numCrfHits += response["crfCached"].asBool() ? 1 : 0;
+
+                    std::cout << "    Job " << id << ": done by " << worker->name()
+                              << " in " << static_cast<int>(busyMs) << " ms"
+                              << std::endl;
+                }
+                else {
+                    report.numFailures += 1;
+
+                    const std::string reason = isReached ? 
+                        response["error"].asString("malformed response") : "worker lost";
+
+                    ++job.numAttempts;
+                    if (job.numAttempts <= _numRetries) {
+                        queue.push_back(job);
+
+                        std::cout << "    Job " << id << ": failed on " << worker->name()
+                                  << " (" << reason << "), retry " << job.numAttempts
+                                  << std::endl;
+                    }
+                    else {
+                        ++numFailed;
+
+                        std::cout << "    Job " << id << ": failed (" << reason << "), giving up"
+                                  << std::endl;
+                    }
+                }
+
+                --numInFlight;
+
+                // a lost worker leaves its remaining jobs to the others
+                if (!isReached) {
+                    report.isLost = true;
+                    --numAlive;
+
+                    // nobody is left to take the queued jobs
+                    if (numAlive == 0) {
+                        numFailed += static_cast<int>(queue.size());
+                        queue.clear();
+                    }
+                }
+
+                changed.notify_all();
+
+                if (!isReached) {
+                    return;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    const double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+
+    /*
+        Merge per-worker timing reports
+    */
+    WorkerReport total;
+    std::cout << "# Batch report"
+              << std::endl;
+    for (std::size_t w = 0; w < workers.size(); ++w) {
+        const WorkerReport& report = reports[w];
+
+        std::cout << "    Worker " << (w + 1) << " (" << workers[w]->name() << "): "
+                  << report.numJobs << " jobs, "
+                  << report.numFailures << " failures, "
+                  << report.numCrfHits << " cached curves, "
+                  << "run " << static_cast<int>(report.runMs) << " ms, "
+                  << "busy " << static_cast<int>(report.busyMs) << " ms ("
+                  << static_cast<int>(wallMs > 0.0 ? 100.0 * report.busyMs / wallMs : 0.0) << "%)"
+                  << (report.isLost ? ", lost" : "")
+                  << std::endl;
+
+        total.numJobs     += report.numJobs;
+        total.numFailures += report.numFailures;
+        total.numCrfHits  += report.numCrfHits;
+        total.runMs       += report.runMs;
+        total.busyMs      += report.busyMs;
+    }
+
+    std::cout << "    Total: " << total.numJobs << " of " << _jobs.size() << " jobs done, "
+              << numFailed + _numMalformed << " failed, "
+              << total.numFailures << " failed attempts, "
+              << "wall " << static_cast<int>(wallMs) << " ms, "
+              << "throughput " << (wallMs > 0.0 ? 1000.0 * total.numJobs / wallMs : 0.0) << " jobs/s"
+              << std::endl;
+
+    return numFailed + _numMalformed;
+}
+
+} // namespace shdr
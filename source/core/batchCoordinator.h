@@ -0,0 +1,47 @@
+#pragma once
+
+#include "jsonValue.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+class WorkerChannel;
+
+/*
+    BatchCoordinator runs a manifest of bracket sets on several
+    workers. The manifest holds one job server request per line
+    (lines starting with '#' are comments).
+
+    Jobs are handed out one at a time, so a worker gets the 
+    next job as soon as it finishes its current one, failed 
+    jobs are retried (possibly on another worker), and the 
+    timing reports of all workers are merged at the end.
+    A worker that doesn't answer a job within the job timeout
+    is given up like a crashed one, and the job is retried.
+
+    Workers are only reached through WorkerChannel, the 
+    coordinator does not care where they run.
+*/
+class BatchCoordinator {
+public:
+    // jobTimeoutSeconds <= 0 waits for workers forever
+    explicit BatchCoordinator(const std::string& manifestFilename,
+                              const int          numRetries        = 2,
+                              const int          jobTimeoutSeconds = 600);
+
+    // returns the number of jobs that failed on every attempt
+    int run(const std::vector<WorkerChannel*>& workers) const;
+
+    std::size_t numJobs() const;
+
+private:
+    std::vector<JsonValue> _jobs;
+    int                    _numRetries;
+    int                    _jobTimeoutMs;
+    int                    _numMalformed;
+};
+
+} // namespace shdr
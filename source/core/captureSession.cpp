@@ -0,0 +1,241 @@
+#include "core/captureSession.h"
+
+#include "core/crfSolver.h"
+#include "core/imageAligner.h"
+#include "core/radianceAccumulator.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/toneMapper.h"
+#include "imageUtils.h"
+#include "ioUtils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace shdr {
+
+CaptureSession::CaptureSession(const std::string& sessionFilename,
+                               const std::string& imageDirectory,
+                               const std::string& shutterFilename,
+                               const std::string& imageAligner,
+                               const std::string& crfSolver,
+                               const std::string& toneMapper) :
+    _sessionFilename(sessionFilename),
+    _crfSolverMethod(crfSolver),
+    _imageDirectory(imageDirectory),
+    _shutterFilename(shutterFilename),
+    _isHalfPrecision(false),
+    _imageAligner(nullptr),
+    _crfSolver(nullptr),
+    _toneMapper(nullptr),
+    _accumulator(std::make_unique<RadianceAccumulator>()),
+    _scratchArena(std::make_unique<ScratchArena>()) {
+
+    _imageAligner = StageFactory::createImageAligner(imageAligner);
+    _crfSolver    = StageFactory::createCrfSolver(crfSolver);
+    _toneMapper   = StageFactory::createToneMapper(toneMapper);
+
+    _imageAligner->setScratchArena(_scratchArena.get());
+    _crfSolver->setScratchArena(_scratchArena.get());
+    _toneMapper->setScratchArena(_scratchArena.get());
+}
+
+CaptureSession::~CaptureSession() = default;
+
+void CaptureSession::setHalfPrecision(const bool isHalfPrecision) {
+    _isHalfPrecision = isHalfPrecision;
+    _crfSolver->setHalfPrecision(isHalfPrecision);
+}
+
+void CaptureSession::setToneCurveFiles(const std::string& importFilename,
+                                       const std::string& exportFilename) {
+
+    _toneMapper->setToneCurveFiles(importFilename, exportFilename);
+}
+
+void CaptureSession::solve(cv::Mat* const out_ldri) {
+    /*
+        Both lists grow during capture, only exposures
+        that have a shutter speed already are used
+    */
+    std::vector<float> shutterSpeeds;
+    ioUtils::readShutterSpeeds(_shutterFilename, &shutterSpeeds);
+
+    std::vector<std::string> imageFilenames;
+    ioUtils::listFiles(_imageDirectory, &imageFilenames);
+
+    const int numAvailable = static_cast<int>(std::min(imageFilenames.size(), shutterSpeeds.size()));
+    if (numAvailable == 0) {
+        std::cout << "# No exposure available yet"
+                  << std::endl;
+
+        return;
+    }
+
+    const cv::Mat reference = cv::imread(imageFilenames[0]);
+    if (reference.empty()) {
+        std::cout << "First exposure can't be read: " << imageFilenames[0]
+                  << std::endl;
+
+        return;
+    }
+
+    if (!_accumulator->open(_sessionFilename, reference.cols, reference.rows)) {
+        return;
+    }
+
+    /*
+        A resumed session must have been folded from the first 
+        exposures of the directory with the same crf method,
+        otherwise it is started over
+    */
+    const auto exposureKey = [&](const int numExposures) {
+        std::uint64_t key = 0;
+        for (int n = 0; n < numExposures; ++n) {
+            key = _foldExposureKey(key, imageFilenames[n], shutterSpeeds[n]);
+        }
+
+        return key;
+    };
+
+    const int numResumed = _accumulator->numExposures();
+    if (numResumed > 0 || _accumulator->hasCrf()) {
+        if (numResumed > numAvailable ||
+            _accumulator->crfMethod() != _crfSolverMethod ||
+            _accumulator->exposureKey() != exposureKey(numResumed)) {
+
+            std::cout << "# Session file belongs to other exposures or another crf method, start over"
+                      << std::endl;
+
+            _accumulator->clear();
+        }
+    }
+
+    /*
+        Read exposure n aligned to the first exposure,
+        false if it can't be read (e.g. still being written)
+    */
+    const auto readAligned = [&](const int n, cv::Mat* const out_image) {
+        if (n == 0) {
+            *out_image = reference;
+
+            return true;
+        }
+
+        const cv::Mat image = cv::imread(imageFilenames[n]);
+        if (image.empty()) {
+            std::cout << "    Image " << (n + 1) << " can't be read yet: " << imageFilenames[n]
+                      << std::endl;
+
+            return false;
+        }
+
+        cv::Point offset(0, 0);
+        _imageAligner->alignImage(reference, image, false, &offset, out_image);
+
+        std::cout << "    Image " << (n + 1) << ": " << imageFilenames[n]
+                  << ", offset: x = " << offset.x << ", y = " << offset.y
+                  << std::endl;
+
+        return true;
+    };
+
+    /*
+        The response curve needs at least two exposures, it is
+        solved again from the new exposures as long as fewer than 
+        MAX_CRF_EXPOSURES went into it, then the session is folded
+        again with the refined curve
+    */
+    std::vector<cv::Mat> alignImages;
+    const int numCrfExposures = std::min(numAvailable, MAX_CRF_EXPOSURES);
+    if (numCrfExposures >= 2 && _accumulator->numCrfExposures() < numCrfExposures) {
+        for (int n = 0; n < numCrfExposures; ++n) {
+            cv::Mat alignImage;
+            if (!readAligned(n, &alignImage)) {
+                break;
+            }
+            alignImages.push_back(alignImage);
+        }
+
+        const int numRead = static_cast<int>(alignImages.size());
+        if (numRead >= 2 && numRead > _accumulator->numCrfExposures()) {
+            cv::Mat crf;
+            _crfSolver->solveCrf(alignImages, 
+                                 std::vector<float>(shutterSpeeds.begin(), shutterSpeeds.begin() + numRead), 
+                                 &crf);
+
+            if (_accumulator->hasCrf()) {
+                std::cout << "# Refine response curve with " << numRead << " exposures, fold the session again"
+                          << std::endl;
+            }
+
+            _accumulator->clear();
+            _accumulator->setCrf(crf, _crfSolverMethod, numRead);
+        }
+    }
+
+    if (!_accumulator->hasCrf()) {
+        std::cout << "# Response curve needs at least 2 exposures, got " << numAvailable
+                  << std::endl;
+
+        return;
+    }
+
+    /*
+        Fold every exposure that is not in the session yet,
+        an unreadable one is folded by a later call
+    */
+    const cv::Mat crf = _accumulator->crf();
+    for (int n = _accumulator->numExposures(); n < numAvailable; ++n) {
+        cv::Mat alignImage;
+        if (n < static_cast<int>(alignImages.size())) {
+            alignImage = alignImages[n];
+        }
+        else if (!readAligned(n, &alignImage)) {
+            break;
+        }
+
+        _crfSolver->accumulate(alignImage, shutterSpeeds[n], crf, _accumulator.get());
+        _accumulator->setExposureKey(_foldExposureKey(_accumulator->exposureKey(), 
+                                                      imageFilenames[n], 
+                                                      shutterSpeeds[n]));
+
+        std::cout << "    Fold exposure " << (n + 1) << " into session"
+                  << std::endl;
+    }
+    _accumulator->sync();
+
+    std::cout << "# Session has " << _accumulator->numExposures() << " exposures"
+              << std::endl;
+
+    /*
+        Preview of the current state
+    */
+    cv::Mat        hdri;
+    ToneStatistics statistics;
+    _accumulator->radianceMap(imageUtils::radianceType(_isHalfPrecision), &hdri, &statistics);
+    _toneMapper->map(hdri, statistics, out_ldri);
+}
+
+std::uint64_t CaptureSession::_foldExposureKey(const std::uint64_t key,
+                                               const std::string&  filename,
+                                               const float         shutterSpeed) {
+    // FNV-1a over the file name and the shutter speed
+    constexpr std::uint64_t FNV_OFFSET = 14695981039346656037ull;
+    constexpr std::uint64_t FNV_PRIME  = 1099511628211ull;
+
+    std::uint64_t hash = (key == 0) ? FNV_OFFSET : key;
+    for (const char c : filename) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    }
+
+    const unsigned char* speedBytes = reinterpret_cast<const unsigned char*>(&shutterSpeed);
+    for (std::size_t i = 0; i < sizeof(shutterSpeed); ++i) {
+        hash = (hash ^ speedBytes[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+} // namespace shdr
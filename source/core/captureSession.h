@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace shdr {
+
+class CrfSolver;
+class ImageAligner;
+class RadianceAccumulator;
+class ScratchArena;
+class ToneMapper;
+
+/*
+    CaptureSession is used for tethered capture, where the
+    brackets of one scene arrive one at a time.
+
+    Each call folds the exposures that arrived since the last
+    call into a radiance accumulator and produces a tone mapped
+    preview of the current state. The accumulator (and the
+    response curve, solved once two exposures exist) is kept in
+    a memory-mapped session file, so a session can be resumed.
+
+    The curve is refined while the bracket grows up to 
+    MAX_CRF_EXPOSURES exposures, the session is then folded
+    again with it. A session file folded from other exposures
+    or with another crf method is started over.
+
+    New exposures are aligned to the first one of the session.
+*/
+class CaptureSession {
+public:
+    CaptureSession(const std::string& sessionFilename,
+                   const std::string& imageDirectory,
+                   const std::string& shutterFilename,
+                   const std::string& imageAligner = "mtb",
+                   const std::string& crfSolver    = "debevec",
+                   const std::string& toneMapper   = "bilateral");
+    ~CaptureSession();
+
+    // out_ldri is left empty if there is nothing to preview yet
+    void solve(cv::Mat* const out_ldri);
+
+    void setHalfPrecision(const bool isHalfPrecision);
+
+    // tone curve files of global tone mappers, see ToneMapper
+    void setToneCurveFiles(const std::string& importFilename,
+                           const std::string& exportFilename);
+
+private:
+    // key of the exposures folded in so far, with one more exposure
+    static std::uint64_t _foldExposureKey(const std::uint64_t key,
+                                          const std::string&  filename,
+                                          const float         shutterSpeed);
+
+    std::string _sessionFilename;
+    std::string _crfSolverMethod;
+    std::string _imageDirectory;
+    std::string _shutterFilename;
+    bool        _isHalfPrecision;
+
+    std::unique_ptr<ImageAligner>        _imageAligner;
+    std::unique_ptr<CrfSolver>           _crfSolver;
+    std::unique_ptr<ToneMapper>          _toneMapper;
+    std::unique_ptr<RadianceAccumulator> _accumulator;
+    std::unique_ptr<ScratchArena>        _scratchArena;
+
+    static const int MAX_CRF_EXPOSURES = 5;
+};
+
+} // namespace shdr
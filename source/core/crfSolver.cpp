@@ -0,0 +1,136 @@
+#include "core/crfSolver.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace shdr {
+
+void CrfSolver::_mergeWithCurve(const std::vector<cv::Mat>& images,
+                                const std::vector<float>&   shutterSpeeds,
+                                const cv::Mat&              crf,
+                                const float* const          weight,
+                                cv::Mat* const              out_hdri,
+                                ToneStatistics* const       out_statistics) const {
+
+    std::cout << "# Begin to reconstruct radiance map"
+              << std::endl;
+
+    const int width     = images.at(0).cols;
+    const int height    = images.at(0).rows;
+    const int numImages = static_cast<int>(images.size());
+
+    const cv::Mat& g    = crf;
+    cv::Mat        hdri = _scratch(height, width, _radianceType);
+
+    std::vector<float> logShutterSpeeds(numImages);
+    for (int n = 0; n < numImages; ++n) {
+        logShutterSpeeds[n] = std::log(shutterSpeeds[n]);
+    }
+
+    /*
+        Begin to construct HDR radiance map (hdri),
+        for each pixel, each channel,
+        calculate its weighted radiance sum over all images,
+        then gather tone mapping statistics of the final radiance
+        in the same pass, the row is converted to the storage
+        precision of hdri when it is stored
+    */
+    // statistics describe the stored map, so they see its clamping
+    const float maxRadiance = imageUtils::maxRadiance(hdri.type());
+
+    ToneStatistics statistics;
+    std::mutex     statisticsMutex;
+    // row bands are merged in parallel, each with its own statistics
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        ToneStatistics                bandStatistics;
+        std::vector<const cv::Vec3b*> imageRows(numImages);
+        std::vector<cv::Vec3f>        hdriRow(width);
+        // image y
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            for (int n = 0; n < numImages; ++n) {
+                imageRows[n] = images[n].ptr<cv::Vec3b>(iy);
+            }
+
+            // image x
+            for (int ix = 0; ix < width; ++ix) {
+                float lnESum[3]    = { 0.0f, 0.0f, 0.0f };
+                float weightSum[3] = { 0.0f, 0.0f, 0.0f };
+
+                // number of images
+                for (int n = 0; n < numImages; ++n) {
+                    // three color channel
+                    for (int c = 0; c < 3; ++c) {
+                        const int   z   = static_cast<int>(imageRows[n][ix][c]);
+                        const float lnE = g.at<cv::Vec3f>(z, 0)[c] - logShutterSpeeds[n];
+
+                        lnESum[c]    += weight[z] * lnE;
+                        weightSum[c] += weight[z];
+                    }
+                }
+
+                for (int c = 0; c < 3; ++c) {
+                    hdriRow[ix][c] = (weightSum[c] > 0.0f) ? std::exp(lnESum[c] / weightSum[c]) : 1.0f;
+                    hdriRow[ix][c] = std::min(hdriRow[ix][c], maxRadiance);
+                }
+
+                const float lw = ToneStatistics::luminance(hdriRow[ix][0], hdriRow[ix][1], hdriRow[ix][2]);
+                bandStatistics.addLogLuminance(std::log(lw + ToneStatistics::LUMINANCE_DELTA));
+            }
+
+            imageUtils::storeRadianceRow(&hdriRow[0][0], iy, &hdri);
+        }
+
+        std::lock_guard<std::mutex> lock(statisticsMutex);
+        statistics.combine(bandStatistics);
+    });
+
+    *out_hdri       = hdri;
+    *out_statistics = statistics;
+
+    std::cout << "# Finish reconstructing radiance map"
+              << std::endl;
+}
+
+void CrfSolver::_accumulateWithCurve(const cv::Mat&             image,
+                                     const float                shutterSpeed,
+                                     const cv::Mat&             crf,
+                                     const float* const         weight,
+                                     RadianceAccumulator* const inout_accumulator) const {
+
+    const int width  = image.cols;
+    const int height = image.rows;
+
+    const cv::Mat& g               = crf;
+    const float    logShutterSpeed = std::log(shutterSpeed);
+
+    cv::Mat& lnESum    = inout_accumulator->lnESum();
+    cv::Mat& weightSum = inout_accumulator->weightSum();
+
+    /*
+        Fold one exposure into the weighted radiance sum
+        and the weight sum of each pixel and channel
+    */
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const cv::Vec3b* imageRow     = image.ptr<cv::Vec3b>(iy);
+            cv::Vec3f*       lnESumRow    = lnESum.ptr<cv::Vec3f>(iy);
+            cv::Vec3f*       weightSumRow = weightSum.ptr<cv::Vec3f>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                for (int c = 0; c < 3; ++c) {
+                    const int   z   = static_cast<int>(imageRow[ix][c]);
+                    const float lnE = g.at<cv::Vec3f>(z, 0)[c] - logShutterSpeed;
+
+                    lnESumRow[ix][c]    += weight[z] * lnE;
+                    weightSumRow[ix][c] += weight[z];
+                }
+            }
+        }
+    });
+
+    inout_accumulator->addExposure();
+}
+
+} // namespace shdr
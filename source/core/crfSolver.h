@@ -1,7 +1,13 @@
 #pragma once
 
 #include "config.h"
+#include "core/pipelineStage.h"
+#include "core/radianceAccumulator.h"
+#include "core/taskScheduler.h"
+#include "core/toneStatistics.h"
+#include "imageUtils.h"
 
+#include <iostream>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
@@ -17,28 +23,130 @@ namespace shdr {
     CrfSolver's goal is to recover response curve of 
     the camera, and then we can use these information
     to reconstruct the radiance map (hdr image).
+
+    Solving the curve and merging the radiance map are 
+    exposed separately, so that a curve recovered once
+    can be reused for later image sets of the same camera.
+
+    Merging visits every pixel anyway, so it also gathers
+    the tone mapping statistics of the radiance map.
+
+    Exposures can also be folded into a RadianceAccumulator 
+    one at a time, e.g. when they arrive during capture.
+
+    The curve can be solved from unaligned images and their
+    offsets, it is sampled where the aligned images would be,
+    so no aligned copies are needed, e.g. for a region solve.
+
+    The radiance map is stored in single precision by default,
+    half precision halves its footprint for display-referred output.
 */
-class CrfSolver {
+class CrfSolver : public PipelineStage {
 public:
+    CrfSolver();
+
     void solve(const std::vector<cv::Mat>& images, 
                const std::vector<float>&   shutterSpeeds, 
-               cv::Mat* const              out_hdri) const;
+               cv::Mat* const              out_hdri,
+               ToneStatistics* const       out_statistics,
+               cv::Mat* const              out_crf = nullptr) const;
+
+    void solveCrf(const std::vector<cv::Mat>& images,
+                  const std::vector<float>&   shutterSpeeds,
+                  cv::Mat* const              out_crf) const;
+
+    // offsets translate images like ImageAligner::translateRegion
+    void solveCrf(const std::vector<cv::Mat>&   images,
+                  const std::vector<cv::Point>& offsets,
+                  const std::vector<float>&     shutterSpeeds,
+                  cv::Mat* const                out_crf) const;
+
+    void merge(const std::vector<cv::Mat>& images,
+               const std::vector<float>&   shutterSpeeds,
+               const cv::Mat&              crf,
+               cv::Mat* const              out_hdri,
+               ToneStatistics* const       out_statistics) const;
+
+    void accumulate(const cv::Mat&             image,
+                    const float                shutterSpeed,
+                    const cv::Mat&             crf,
+                    RadianceAccumulator* const inout_accumulator) const;
+
+    void setHalfPrecision(const bool isHalfPrecision);
+
+    // type of the merged radiance map (CV_32FC3 or CV_16FC3)
+    int radianceType() const;
+
+protected:
+    // pixel (x, y) of image translated by offset,
+    // black where nothing is translated in
+    static cv::Vec3b _translatedPixel(const cv::Mat&   image,
+                                      const cv::Point& offset,
+                                      const int        x,
+                                      const int        y);
+
+    // weighted average of g(z) - ln(t) over all exposures, where
+    // crf is the log response lookup table g (256x1 CV_32FC3) and
+    // weight the 256 entry weighting function of pixel values
+    void _mergeWithCurve(const std::vector<cv::Mat>& images,
+                         const std::vector<float>&   shutterSpeeds,
+                         const cv::Mat&              crf,
+                         const float* const          weight,
+                         cv::Mat* const              out_hdri,
+                         ToneStatistics* const       out_statistics) const;
+
+    void _accumulateWithCurve(const cv::Mat&             image,
+                              const float                shutterSpeed,
+                              const cv::Mat&             crf,
+                              const float* const         weight,
+                              RadianceAccumulator* const inout_accumulator) const;
+
+    // type of the merged radiance map (CV_32FC3 or CV_16FC3)
+    int _radianceType;
 
 private:
-    virtual void _solveImpl(const std::vector<cv::Mat>& images,
+    virtual void _solveCrfImpl(const std::vector<cv::Mat>&   images,
+                               const std::vector<cv::Point>& offsets,
+                               const std::vector<float>&     shutterSpeeds,
+                               cv::Mat* const                out_crf) const = 0;
+
+    virtual void _mergeImpl(const std::vector<cv::Mat>& images,
                             const std::vector<float>&   shutterSpeeds,
-                            cv::Mat* const              out_hdri) const = 0;
+                            const cv::Mat&              crf,
+                            cv::Mat* const              out_hdri,
+                            ToneStatistics* const       out_statistics) const = 0;
+
+    virtual void _accumulateImpl(const cv::Mat&             image,
+                                 const float                shutterSpeed,
+                                 const cv::Mat&             crf,
+                                 RadianceAccumulator* const inout_accumulator) const = 0;
 
     void _writeHdrImage(const cv::Mat& hdri) const;
 };
 
 // header implementation
 
+inline CrfSolver::CrfSolver() :
+    PipelineStage(),
+    _radianceType(CV_32FC3) {
+}
+
 inline void CrfSolver::solve(const std::vector<cv::Mat>& images,
                              const std::vector<float>&   shutterSpeeds,
-                             cv::Mat* const              out_hdri) const {
+                             cv::Mat* const              out_hdri,
+                             ToneStatistics* const       out_statistics,
+                             cv::Mat* const              out_crf) const {
+
+    const cv::Size size = images.empty() ? cv::Size() : images[0].size();
+    TaskScheduler::StageScope stageScope(StageType::S_MERGE, size.width, size.height);
+
+    cv::Mat crf;
+    _solveCrfImpl(images, std::vector<cv::Point>(images.size()), shutterSpeeds, &crf);
+    _mergeImpl(images, shutterSpeeds, crf, out_hdri, out_statistics);
 
-    _solveImpl(images, shutterSpeeds, out_hdri);
+    if (out_crf) {
+        *out_crf = crf;
+    }
 
 #ifdef DRAW_RADIANCE_MAP
     _writeHdrImage(*out_hdri);
@@ -46,8 +154,87 @@ inline void CrfSolver::solve(const std::vector<cv::Mat>& images,
 #endif
 }
 
+inline void CrfSolver::solveCrf(const std::vector<cv::Mat>& images,
+                                const std::vector<float>&   shutterSpeeds,
+                                cv::Mat* const              out_crf) const {
+
+    const cv::Size size = images.empty() ? cv::Size() : images[0].size();
+    TaskScheduler::StageScope stageScope(StageType::S_MERGE, size.width, size.height);
+
+    _solveCrfImpl(images, std::vector<cv::Point>(images.size()), shutterSpeeds, out_crf);
+}
+
+inline void CrfSolver::solveCrf(const std::vector<cv::Mat>&   images,
+                                const std::vector<cv::Point>& offsets,
+                                const std::vector<float>&     shutterSpeeds,
+                                cv::Mat* const                out_crf) const {
+
+    const cv::Size size = images.empty() ? cv::Size() : images[0].size();
+    TaskScheduler::StageScope stageScope(StageType::S_MERGE, size.width, size.height);
+
+    _solveCrfImpl(images, offsets, shutterSpeeds, out_crf);
+}
+
+inline void CrfSolver::merge(const std::vector<cv::Mat>& images,
+                             const std::vector<float>&   shutterSpeeds,
+                             const cv::Mat&              crf,
+                             cv::Mat* const              out_hdri,
+                             ToneStatistics* const       out_statistics) const {
+
+    const cv::Size size = images.empty() ? cv::Size() : images[0].size();
+    TaskScheduler::StageScope stageScope(StageType::S_MERGE, size.width, size.height);
+
+    _mergeImpl(images, shutterSpeeds, crf, out_hdri, out_statistics);
+}
+
+inline void CrfSolver::accumulate(const cv::Mat&             image,
+                                  const float                shutterSpeed,
+                                  const cv::Mat&             crf,
+                                  RadianceAccumulator* const inout_accumulator) const {
+
+    TaskScheduler::StageScope stageScope(StageType::S_MERGE, image.cols, image.rows);
+
+    _accumulateImpl(image, shutterSpeed, crf, inout_accumulator);
+}
+
+inline void CrfSolver::setHalfPrecision(const bool isHalfPrecision) {
+    _radianceType = imageUtils::radianceType(isHalfPrecision);
+
+    if (isHalfPrecision && _radianceType != CV_16FC3) {
+        std::cout << "Half precision radiance map needs OpenCV 4, use single precision instead"
+                  << std::endl;
+    }
+}
+
+inline int CrfSolver::radianceType() const {
+    return _radianceType;
+}
+
+inline cv::Vec3b CrfSolver::_translatedPixel(const cv::Mat&   image,
+                                             const cv::Point& offset,
+                                             const int        x,
+                                             const int        y) {
+
+    const int sourceX = x - offset.x;
+    const int sourceY = y - offset.y;
+    if (sourceX < 0 || sourceX >= image.cols || sourceY < 0 || sourceY >= image.rows) {
+        return cv::Vec3b(0, 0, 0);
+    }
+
+    return image.at<cv::Vec3b>(sourceY, sourceX);
+}
+
 inline void CrfSolver::_writeHdrImage(const cv::Mat& hdri) const {
+    // .hdr files only take single precision
+    if (imageUtils::isHalfRadiance(hdri)) {
+        cv::Mat hdriFloat;
+        hdri.convertTo(hdriFloat, CV_32FC3);
+        cv::imwrite("./hdr_radiance_map.hdr", hdriFloat);
+
+        return;
+    }
+
     cv::imwrite("./hdr_radiance_map.hdr", hdri);
 }
 
-} // namespace shdr
\ No newline at end of file
+} // namespace shdr
@@ -0,0 +1,170 @@
+#include "core/exposureCuller.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace shdr {
+
+ExposureCuller::ExposureCuller() :
+    ExposureCuller(8, 247, 0.995f) {
+}
+
+ExposureCuller::ExposureCuller(const int   underExposed,
+                               const int   saturated,
+                               const float coverage) :
+    _underExposed(underExposed),
+    _saturated(saturated),
+    _coverage(coverage) {
+}
+
+void ExposureCuller::cull(const std::vector<cv::Mat>& images,
+                          const std::vector<float>&   shutterSpeeds,
+                          std::vector<int>* const     out_keptIndices) const {
+
+    std::cout << "# Begin to cull redundant exposures"
+              << std::endl;
+
+    const int numImages = static_cast<int>(images.size());
+
+    out_keptIndices->clear();
+    if (numImages <= 2) {
+        for (int n = 0; n < numImages; ++n) {
+            out_keptIndices->push_back(n);
+        }
+
+        std::cout << "# Keep all " << numImages << " exposures"
+                  << std::endl;
+
+        return;
+    }
+
+    /*
+        Well exposed masks of the downsampled exposures,
+        plus their under-exposed and saturated fractions
+    */
+    const int width  = images[0].cols;
+    const int height = images[0].rows;
+    const double scale = std::min(1.0, static_cast<double>(SAMPLE_WIDTH) / width);
+    const cv::Size sampleSize(std::max(static_cast<int>(width * scale), 1), 
+                              std::max(static_cast<int>(height * scale), 1));
+    const int numSamples = sampleSize.area();
+
+    std::vector<std::vector<uchar>> wellExposed(numImages, std::vector<uchar>(numSamples));
+    std::vector<int>                numUnder(numImages, 0);
+    std::vector<int>                numSaturated(numImages, 0);
+
+    TaskScheduler::instance().parallelFor(0, numImages, 1, [&](const int begin, const int end) {
+        for (int n = begin; n < end; ++n) {
+            cv::Mat sample;
+            cv::resize(images[n], sample, sampleSize, 0.0, 0.0, cv::INTER_AREA);
+
+            for (int iy = 0; iy < sample.rows; ++iy) {
+                const cv::Vec3b* row = sample.ptr<cv::Vec3b>(iy);
+                for (int ix = 0; ix < sample.cols; ++ix) {
+                    const int maxValue = std::max({ row[ix][0], row[ix][1], row[ix][2] });
+
+                    const bool isUnder     = maxValue <= _underExposed;
+                    const bool isSaturated = maxValue >= _saturated;
+
+                    numUnder[n]     += isUnder ? 1 : 0;
+                    numSaturated[n] += isSaturated ? 1 : 0;
+                    wellExposed[n][iy * sample.cols + ix] = (!isUnder && !isSaturated) ? 1 : 0;
+                }
+            }
+        }
+    });
+
+    /*
+        Only pixels that some exposure covers can be covered
+    */
+    std::vector<uchar> isCovered(numSamples, 0);
+    int numCoverable = 0;
+    for (int i = 0; i < numSamples; ++i) {
+        for (int n = 0; n < numImages; ++n) {
+            if (wellExposed[n][i]) {
+                ++numCoverable;
+                break;
+            }
+        }
+    }
+
+    /*
+        Greedy set cover, each round picks the exposure
+        which covers the most pixels not covered yet
+    */
+    std::vector<int>  gains(numImages, 0);
+    std::vector<bool> isKept(numImages, false);
+    int numCovered = 0;
+    int numKept    = 0;
+    while (numKept < numImages) {
+        const bool isCoverageMet = numCovered >= _coverage * numCoverable;
+        if (isCoverageMet && numKept >= 2) {
+            break;
+        }
+
+        int bestImage = -1;
+        int bestGain  = -1;
+        for (int n = 0; n < numImages; ++n) {
+            if (isKept[n]) {
+                continue;
+            }
+
+            int gain = 0;
+            for (int i = 0; i < numSamples; ++i) {
+                gain += (wellExposed[n][i] && !isCovered[i]) ? 1 : 0;
+            }
+
+            // ties (e.g. a second exposure adding nothing) go to the best exposed one
+            if (gain > bestGain ||
+                (gain == bestGain && numSaturated[n] + numUnder[n] < numSaturated[bestImage] + numUnder[bestImage])) {
+
+                bestImage = n;
+                bestGain  = gain;
+            }
+        }
+
+        isKept[bestImage] = true;
+        gains[bestImage]  = bestGain;
+        ++numKept;
+
+        for (int i = 0; i < numSamples; ++i) {
+            if (wellExposed[bestImage][i] && !isCovered[i]) {
+                isCovered[i] = 1;
+                ++numCovered;
+            }
+        }
+    }
+
+    /*
+        Report the decision of every exposure
+    */
+    const double percent = 100.0 / numSamples;
+    for (int n = 0; n < numImages; ++n) {
+        const int numWellExposed = numSamples - numUnder[n] - numSaturated[n];
+
+        std::cout << "    Image " << (n + 1) << " (shutter " << shutterSpeeds[n] << "): "
+                  << "well exposed " << numWellExposed * percent << "%, "
+                  << "under-exposed " << numUnder[n] * percent << "%, "
+                  << "saturated " << numSaturated[n] * percent << "% -> ";
+        if (isKept[n]) {
+            std::cout << "keep, adds " << gains[n] * percent << "%"
+                      << std::endl;
+        }
+        else {
+            std::cout << "drop"
+                      << std::endl;
+        }
+
+        if (isKept[n]) {
+            out_keptIndices->push_back(n);
+        }
+    }
+
+    std::cout << "# Keep " << numKept << " of " << numImages << " exposures, covering "
+              << (numCoverable > 0 ? 100.0 * numCovered / numCoverable : 100.0) << "% of the scene"
+              << std::endl;
+}
+
+} // namespace shdr
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ExposureCuller drops redundant exposures of a bracket
+    before alignment, response curve and merge, which all
+    scale with the number of images.
+
+    Each exposure is downsampled, and its pixels are marked 
+    well exposed when they are neither under-exposed nor 
+    saturated. Exposures are then picked greedily by how many
+    not yet covered pixels they expose well, until nearly
+    every pixel that any exposure covers is covered (a greedy
+    minimal set cover). At least two exposures are kept, the
+    response curve can't be solved from one.
+
+    The decision for every exposure is reported.
+*/
+class ExposureCuller {
+public:
+    ExposureCuller();
+    ExposureCuller(const int   underExposed,
+                   const int   saturated,
+                   const float coverage);
+
+    // indices (ascending) of the exposures to keep
+    void cull(const std::vector<cv::Mat>& images,
+              const std::vector<float>&   shutterSpeeds,
+              std::vector<int>* const     out_keptIndices) const;
+
+private:
+    // a pixel is well exposed when its brightest channel 
+    // is in (underExposed, saturated)
+    int   _underExposed;
+    int   _saturated;
+    // fraction of coverable pixels that must be covered
+    float _coverage;
+
+    // width of the downsampled exposures
+    static const int SAMPLE_WIDTH = 256;
+};
+
+} // namespace shdr
@@ -1,147 +1,521 @@
 #include "core/hdrSolver.h"
 
-#include "crfSolver/debevecCrfSolver.h"
-#include "imageAligner/mtbImageAligner.h"
-#include "toneMapper/bilateralToneMapper.h"
-#include "toneMapper/photographicGlobalToneMapper.h"
-#include "toneMapper/photographicLocalToneMapper.h"
+#include "core/crfSolver.h"
+#include "core/exposureCuller.h"
+#include "core/imageAligner.h"
+#include "core/imageCache.h"
+#include "core/radianceAccumulator.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/taskScheduler.h"
+#include "core/toneMapper.h"
+#include "ioUtils.h"
+#include "systemUtils.h"
 
 #include <algorithm>
-#include <cstdio>
 #include <iostream>
-
-#if (defined(_MSC_VER) || \
-     (defined(__GNUC__) && (__GNUC_MAJOR__ >= 8))) 
-    #include <filesystem>
-    namespace std_fs = std::filesystem;
-#else
-    #include <experimental/filesystem>
-    namespace std_fs = std::experimental::filesystem;
-#endif
+#include <utility>
 
 namespace shdr {
 
-HdrSolver::HdrSolver(const std::string& imageDirectory, 
-                     const std::string& shutterFilename, 
-                     const std::string& imageAligner,
-                     const std::string& crfSolver, 
-                     const std::string& toneMapper) :
+HdrSolver::HdrSolver(const std::string&                 imageDirectory, 
+                     const std::string&                 shutterFilename, 
+                     const std::string&                 imageAligner,
+                     const std::string&                 crfSolver, 
+                     const std::string&                 toneMapper,
+                     const std::shared_ptr<ImageCache>& imageCache) :
+    _imageCache(imageCache),
+    _imageAlignerMethod(imageAligner),
+    _imageKeys(),
+    _mappedKeys(),
     _images(),
     _shutterSpeeds(),
     _imageAligner(nullptr),
     _crfSolver(nullptr),
-    _toneMapper(nullptr) {
+    _toneMapper(nullptr),
+    _scratchArena(std::make_shared<ScratchArena>()),
+    _isLean(false),
+    _regionOfInterest() {
 
     // decide which imageAligner to use
-    if (imageAligner == "mtb") {
-        _imageAligner = std::make_unique<MtbImageAligner>();
+    _imageAligner = StageFactory::createImageAligner(imageAligner);
+
+    // decide which crfSolver to use
+    _crfSolver = StageFactory::createCrfSolver(crfSolver);
+
+    // decide which toneMapper to use
+    _toneMapper = StageFactory::createToneMapper(toneMapper);
+
+    // all stages share the pipeline's scratch arena
+    _imageAligner->setScratchArena(_scratchArena.get());
+    _crfSolver->setScratchArena(_scratchArena.get());
+    _toneMapper->setScratchArena(_scratchArena.get());
+
+    // read input data (images and shutterspeeds)
+    _readData(imageDirectory, shutterFilename);
+}
+
+HdrSolver::HdrSolver(std::vector<cv::Mat>                 images,
+                     std::vector<float>                   shutterSpeeds,
+                     const std::shared_ptr<ImageAligner>& imageAligner,
+                     const std::shared_ptr<CrfSolver>&    crfSolver,
+                     const std::shared_ptr<ToneMapper>&   toneMapper,
+                     const std::shared_ptr<ScratchArena>& scratchArena) :
+    _imageCache(nullptr),
+    _imageAlignerMethod(),
+    _imageKeys(),
+    _mappedKeys(),
+    _images(std::move(images)),
+    _shutterSpeeds(std::move(shutterSpeeds)),
+    _imageAligner(imageAligner),
+    _crfSolver(crfSolver),
+    _toneMapper(toneMapper),
+    _scratchArena(scratchArena),
+    _isLean(false),
+    _regionOfInterest() {
+}
+
+HdrSolver::~HdrSolver() {
+    if (!_imageCache) {
+        return;
+    }
+
+    // mapped images must be gone before their entries are released
+    _images.clear();
+    for (const std::string& key : _mappedKeys) {
+        _imageCache->release(key);
     }
-    else {
-        std::cout << "Unknown imageAligner type: <"
-                  << imageAligner << ">, use <mtb> instead"
+}
+
+void HdrSolver::setHalfPrecision(const bool isHalfPrecision) {
+    _crfSolver->setHalfPrecision(isHalfPrecision);
+}
+
+void HdrSolver::setToneCurveFiles(const std::string& importFilename,
+                                  const std::string& exportFilename) {
+
+    _toneMapper->setToneCurveFiles(importFilename, exportFilename);
+}
+
+void HdrSolver::cullExposures() {
+    if (_images.size() != _shutterSpeeds.size()) {
+        std::cout << "Number of images and shutter speeds differ, skip exposure culling"
                   << std::endl;
 
-        _imageAligner = std::make_unique<MtbImageAligner>();
+        return;
     }
 
-    // decide which crfSolver to use
-    if (crfSolver == "debevec") {
-        _crfSolver = std::make_unique<DebevecCrfSolver>(DwfType::D_GAUSSIAN, 50, 40.0f);
+    std::vector<int> keptIndices;
+    ExposureCuller().cull(_images, _shutterSpeeds, &keptIndices);
+
+    std::vector<cv::Mat>     keptImages;
+    std::vector<float>       keptShutterSpeeds;
+    std::vector<std::string> keptImageKeys;
+    for (const int n : keptIndices) {
+        keptImages.push_back(_images[n]);
+        keptShutterSpeeds.push_back(_shutterSpeeds[n]);
+        if (!_imageKeys.empty()) {
+            keptImageKeys.push_back(_imageKeys[n]);
+        }
     }
-    else {
-        std::cout << "Unknown crfSolver type: <"
-                  << crfSolver << ">, use <debevec> instead"
+
+    // dropped images are released here, before any heavy stage
+    _images        = std::move(keptImages);
+    _shutterSpeeds = std::move(keptShutterSpeeds);
+    _imageKeys     = std::move(keptImageKeys);
+}
+
+void HdrSolver::setLeanMode(const bool isLean) {
+    _isLean = isLean;
+}
+
+void HdrSolver::setRegionOfInterest(const cv::Rect& regionOfInterest) {
+    _regionOfInterest = regionOfInterest;
+}
+
+void HdrSolver::solve(cv::Mat* const out_hdri) {
+    cv::Mat crf;
+    solve(out_hdri, &crf);
+}
+
+void HdrSolver::solve(cv::Mat* const out_hdri, 
+                      cv::Mat* const inout_crf,
+                      cv::Mat* const out_radiance) {
+    if (_images.empty()) {
+        std::cout << "There are no images to solve (lean mode consumes them)"
                   << std::endl;
-        
-        _crfSolver = std::make_unique<DebevecCrfSolver>(DwfType::D_GAUSSIAN, 50, 40.0f);
+
+        return;
     }
 
-    // decide which toneMapper to use
-    if (toneMapper == "photographic-global") {
-        _toneMapper = std::make_unique<PhotographicGlobalToneMapper>();
+    /*
+        A region of interest is solved on its own unless the tone
+        mapper needs the whole image, then the result is cropped
+    */
+    const cv::Rect regionOfInterest = _regionOfInterest & cv::Rect(0, 0, _images[0].cols, _images[0].rows);
+    if (!_regionOfInterest.empty() && regionOfInterest.empty()) {
+        std::cout << "Region of interest is outside of the images, solve the whole image"
+                  << std::endl;
     }
-    else if (toneMapper == "photographic-local") {
-        _toneMapper = std::make_unique<PhotographicLocalToneMapper>();
+    else if (!regionOfInterest.empty()) {
+        const int haloRadius = _toneMapper->haloRadius();
+        if (haloRadius != ToneMapper::WHOLE_IMAGE_HALO) {
+            _solveRegion(regionOfInterest, haloRadius, out_hdri, inout_crf, out_radiance);
+
+            return;
+        }
+
+        std::cout << "Tone mapper depends on the whole image, solve it and crop the region of interest"
+                  << std::endl;
     }
-    else if (toneMapper == "bilateral") {
-        _toneMapper = std::make_unique<BilateralToneMapper>();
+
+    const int numImages = static_cast<int>(_images.size());
+    const int reference = ImageAligner::referenceIndex(numImages);
+
+    std::vector<cv::Mat>   alignImages(numImages);
+    std::vector<cv::Point> offsets(numImages);
+    cv::Mat                hdri;
+    ToneStatistics         statistics;
+    cv::Mat                hdri_toneMapping;
+
+    /*
+        The pipeline is a task graph: one alignment task per image,
+        the response curve needs samples of every exposure so solving
+        and merging wait for all alignments (merging is split into 
+        row band tasks inside), tone mapping waits for the merge.
+        With a known response curve, each exposure is instead folded
+        into the radiance sums as soon as it is aligned
+    */
+    const bool isCrfKnown = !inout_crf->empty();
+
+    RadianceAccumulator accumulator;
+    TaskGraph           graph;
+
+    std::cout << "# Begin to align images"
+              << std::endl;
+
+    /*
+        Aligned images depend on the aligner, 
+        the reference and the image itself
+    */
+    const bool isAlignedCaching = _imageCache && 
+                                  _imageCache->isAlignedCaching() && 
+                                  static_cast<int>(_imageKeys.size()) == numImages;
+
+    std::vector<std::string> mappedAlignedKeys(numImages);
+
+    std::vector<int> alignTasks;
+    for (int n = 0; n < numImages; ++n) {
+        alignTasks.push_back(graph.addTask([&, n]() {
+            if (n == reference) {
+                alignImages[n] = _images[n];
+
+                return;
+            }
+
+            const std::string alignedKey = isAlignedCaching ? 
+                "aligned|" + _imageAlignerMethod + "|" + _imageKeys[reference] + "|" + _imageKeys[n] : "";
+
+            if (isAlignedCaching && _imageCache->load(alignedKey, &alignImages[n])) {
+                mappedAlignedKeys[n] = alignedKey;
+
+                std::cout << "    Image " << (n + 1) << " aligned (cached)"
+                          << std::endl;
+
+                return;
+            }
+
+            _imageAligner->alignImage(_images[reference], _images[n], false, 
+                                      &offsets[n], &alignImages[n]);
+
+            std::cout << "    Image " << (n + 1)
+                      << " max offset: x = " << offsets[n].x << ", y = " << offsets[n].y
+                      << std::endl;
+
+            if (isAlignedCaching) {
+                _imageCache->store(alignedKey, alignImages[n]);
+            }
+
+            // the reference is still needed by other alignments
+            if (_isLean) {
+                _images[n].release();
+            }
+        }));
     }
-    else {
-        std::cout << "Unknown toneMapper type: <"
-                  << toneMapper << ">, use <bilateral> instead"
-                  << std::endl;
 
-        _toneMapper = std::make_unique<BilateralToneMapper>();
+    /*
+        Exposures are accumulated in image order, so the sums 
+        don't depend on which alignment finishes first
+    */
+    std::vector<int> mergeDependencies = alignTasks;
+    if (isCrfKnown) {
+        accumulator.reset(_images[reference].cols, _images[reference].rows);
+
+        int accumulateTask = -1;
+        for (int n = 0; n < numImages; ++n) {
+            std::vector<int> dependencies = { alignTasks[n] };
+            if (accumulateTask >= 0) {
+                dependencies.push_back(accumulateTask);
+            }
+
+            accumulateTask = graph.addTask([&, n]() {
+                _crfSolver->accumulate(alignImages[n], _shutterSpeeds[n], *inout_crf, &accumulator);
+
+                if (_isLean) {
+                    alignImages[n].release();
+                }
+            }, dependencies);
+        }
+
+        mergeDependencies = { accumulateTask };
     }
 
-    // read input data (images and shutterspeeds)
-    _readData(imageDirectory, shutterFilename);
-}
+    const int mergeTask = graph.addTask([&]() {
+        // the aligner holds on to the reference it cached
+        if (_isLean) {
+            _images.clear();
+            _imageAligner->clearCache();
+            _scratchArena->trim();
+        }
+        _reportMemory("alignment");
+
+        if (isCrfKnown) {
+            accumulator.radianceMap(_crfSolver->radianceType(), &hdri, &statistics);
+        }
+        else {
+            _crfSolver->solve(alignImages, _shutterSpeeds, &hdri, &statistics, inout_crf);
+        }
 
-HdrSolver::~HdrSolver() = default;
+        if (_isLean) {
+            alignImages.clear();
+            _scratchArena->trim();
+        }
+        _reportMemory("merge");
+    }, mergeDependencies);
 
-void HdrSolver::solve(cv::Mat* const out_hdri) const {
-    std::vector<cv::Mat> alignImages;
-    _imageAligner->align(_images, &alignImages);
+    graph.addTask([&]() {
+        _toneMapper->map(hdri, statistics, &hdri_toneMapping);
 
-    cv::Mat hdri;
-    _crfSolver->solve(alignImages, _shutterSpeeds, &hdri);
-    
-    cv::Mat hdri_toneMapping;
-    _toneMapper->map(hdri, &hdri_toneMapping);
+        if (out_radiance) {
+            *out_radiance = hdri;
+        }
+
+        if (_isLean) {
+            hdri.release();
+            _scratchArena->trim();
+        }
+        _reportMemory("tone mapping");
+    }, { mergeTask });
+
+    graph.run();
+
+    // the radiance map doesn't share memory with the aligned images
+    alignImages.clear();
+    for (const std::string& key : mappedAlignedKeys) {
+        if (!key.empty()) {
+            _imageCache->release(key);
+        }
+    }
+
+    if (!regionOfInterest.empty()) {
+        hdri_toneMapping = hdri_toneMapping(regionOfInterest).clone();
+        if (out_radiance) {
+            *out_radiance = (*out_radiance)(regionOfInterest).clone();
+        }
+    }
 
     *out_hdri = hdri_toneMapping;
+
+    std::cout << "# Scratch arena high-water usage: "
+              << (_scratchArena->highWaterBytes() >> 20) << " MB"
+              << std::endl;
 }
 
-void HdrSolver::_readData(const std::string& imageDirectory, const std::string& shutterFilename) {
+void HdrSolver::_solveRegion(const cv::Rect& regionOfInterest,
+                             const int       haloRadius,
+                             cv::Mat* const  out_hdri, 
+                             cv::Mat* const  inout_crf,
+                             cv::Mat* const  out_radiance) {
+
+    const int numImages = static_cast<int>(_images.size());
+    const int reference = ImageAligner::referenceIndex(numImages);
+    const int width     = _images[0].cols;
+    const int height    = _images[0].rows;
+
     /*
-        First, we read shutter times from a file,
-        and calculate its size
+        Local operators see the region plus their halo, 
+        clamped to the image like the full solve would be
     */
-    FILE *f = fopen(shutterFilename.c_str(), "r");
-    if (!f) {
-        std::cout << "Shutter times file can't open !"
-                  << std::endl;
+    const cv::Rect haloRegion = cv::Rect(regionOfInterest.x - haloRadius,
+                                         regionOfInterest.y - haloRadius,
+                                         regionOfInterest.width  + 2 * haloRadius,
+                                         regionOfInterest.height + 2 * haloRadius) &
+                                cv::Rect(0, 0, width, height);
+
+    // the overview is at most OVERVIEW_SIZE pixels on its longer side
+    const int overviewStride = std::max(std::max(width, height) / OVERVIEW_SIZE, 1);
+
+    std::cout << "# Begin to solve region x = " << regionOfInterest.x << ", y = " << regionOfInterest.y
+              << ", " << regionOfInterest.width << "x" << regionOfInterest.height
+              << " (halo " << haloRadius << ", overview stride " << overviewStride << ")"
+              << std::endl;
+
+    /*
+        The response curve is sampled from the original images
+        at the pixels the aligned ones would have, so it is the
+        curve of a full render without any full resolution copy
+    */
+    const bool isCrfSolved = inout_crf->empty();
+
+    std::vector<cv::Mat>   regionImages(numImages);
+    std::vector<cv::Mat>   overviewImages(numImages);
+    std::vector<cv::Point> offsets(numImages);
+    cv::Mat                hdri;
+    ToneStatistics       statistics;
+    cv::Mat              hdri_toneMapping;
+
+    /*
+        Same graph as the full solve, but alignment only finds 
+        the global offsets, the aligned images are computed for 
+        the halo region and for the overview only
+    */
+    TaskGraph graph;
+
+    std::vector<int> alignTasks;
+    for (int n = 0; n < numImages; ++n) {
+        alignTasks.push_back(graph.addTask([&, n]() {
+            if (n != reference) {
+                _imageAligner->findOffset(_images[reference], _images[n], false, &offsets[n]);
+
+                std::cout << "    Image " << (n + 1)
+                          << " max offset: x = " << offsets[n].x << ", y = " << offsets[n].y
+                          << std::endl;
+            }
 
-        exit(0);
+            ImageAligner::translateRegion(_images[n], offsets[n], haloRegion, 1, &regionImages[n]);
+            ImageAligner::translateRegion(_images[n], offsets[n], cv::Rect(0, 0, width, height), 
+                                          overviewStride, &overviewImages[n]);
+
+            // the curve still needs the originals
+            if (_isLean && n != reference && !isCrfSolved) {
+                _images[n].release();
+            }
+        }));
     }
 
-    char line[1024];
-    while (fgets(line, 1024, f)) {
-        if (line[strlen(line)] == '\n') {
-            line[strlen(line) - 1] = '\0';
+    const int mergeTask = graph.addTask([&]() {
+        if (isCrfSolved) {
+            _crfSolver->solveCrf(_images, offsets, _shutterSpeeds, inout_crf);
+        }
+
+        // the aligner holds on to the reference it cached
+        if (_isLean) {
+            _images.clear();
+            _imageAligner->clearCache();
+            _scratchArena->trim();
+        }
+        _reportMemory("alignment");
+
+        /*
+            The global statistics come from the overview,
+            the region is merged with the same curve
+        */
+        cv::Mat overviewHdri;
+        _crfSolver->merge(overviewImages, _shutterSpeeds, *inout_crf, &overviewHdri, &statistics);
+        overviewImages.clear();
+
+        ToneStatistics regionStatistics;
+        _crfSolver->merge(regionImages, _shutterSpeeds, *inout_crf, &hdri, &regionStatistics);
+        regionImages.clear();
+
+        _reportMemory("merge");
+    }, alignTasks);
+
+    graph.addTask([&]() {
+        _toneMapper->map(hdri, statistics, &hdri_toneMapping);
+
+        const cv::Rect window = regionOfInterest - haloRegion.tl();
+        hdri_toneMapping = hdri_toneMapping(window).clone();
+        if (out_radiance) {
+            *out_radiance = hdri(window).clone();
         }
 
-        const float time = static_cast<float>(std::stold(line));
-        _shutterSpeeds.push_back(time);
+        if (_isLean) {
+            hdri.release();
+            _scratchArena->trim();
+        }
+        _reportMemory("tone mapping");
+    }, { mergeTask });
+
+    graph.run();
+
+    *out_hdri = hdri_toneMapping;
+
+    std::cout << "# Scratch arena high-water usage: "
+              << (_scratchArena->highWaterBytes() >> 20) << " MB"
+              << std::endl;
+}
+
+void HdrSolver::_reportMemory(const char* const stage) {
+    const std::size_t peakBytes = systemUtils::peakResidentBytes();
+    if (peakBytes == 0) {
+        return;
     }
 
+    std::cout << "# Memory after " << stage << ": peak "
+              << (peakBytes >> 20) << " MB, resident "
+              << (systemUtils::residentBytes() >> 20) << " MB"
+              << std::endl;
+}
+
+void HdrSolver::_readData(const std::string& imageDirectory, const std::string& shutterFilename) {
     /*
-        Second, we read image data from files
+        First, we read shutter times from a file,
+        and calculate its size
     */
+    ioUtils::readShutterSpeeds(shutterFilename, &_shutterSpeeds);
+
+    /*
+        Second, we read image data from files,
+        or map them from the cache if it has them
+    */
+    _images.reserve(_shutterSpeeds.size());
+    if (!_imageCache) {
+        ioUtils::readImages(imageDirectory, &_images);
+
+        return;
+    }
+
     std::cout << "# Begin to read images"
               << std::endl;
 
     std::vector<std::string> imageFilenames;
-    imageFilenames.reserve(_shutterSpeeds.size());
-    for (const auto& entry : std_fs::directory_iterator(imageDirectory)) {
-        imageFilenames.push_back(entry.path().string());
-    }
-
-    // Because filename loading order may be different from standard order,
-    // we need to sort it first to make sure its order fits shutterspeed's order.
-    std::sort(imageFilenames.begin(), imageFilenames.end());
+    ioUtils::listFiles(imageDirectory, &imageFilenames);
 
     for (std::size_t i = 0; i < imageFilenames.size(); ++i) {
-        std::cout << "    Image " << (i + 1) << ": " << imageFilenames[i]
-                  << std::endl;
+        const std::string key = ImageCache::fileKey(imageFilenames[i]);
+
+        cv::Mat img;
+        if (_imageCache->load(key, &img)) {
+            _mappedKeys.push_back(key);
+
+            std::cout << "    Image " << (i + 1) << ": " << imageFilenames[i] << " (cached)"
+                      << std::endl;
+        }
+        else {
+            std::cout << "    Image " << (i + 1) << ": " << imageFilenames[i]
+                      << std::endl;
+
+            img = cv::imread(imageFilenames[i]);
+            _imageCache->store(key, img);
+        }
 
-        const cv::Mat img = cv::imread(imageFilenames[i]);
         _images.push_back(img);
+        _imageKeys.push_back(key);
     }
 
     std::cout << "# Total read " << _images.size() << " images"
               << std::endl;
 }
 
-} // namespace shdr
\ No newline at end of file
+} // namespace shdr
@@ -9,28 +9,109 @@ namespace shdr {
 
 class CrfSolver;
 class ImageAligner;
+class ImageCache;
+class ScratchArena;
 class ToneMapper;
 
 class HdrSolver {
 public:
-    HdrSolver(const std::string& imageDirectory, 
-              const std::string& shutterFilename,
-              const std::string& imageAligner = "mtb",
-              const std::string& crfSolver    = "debevec", 
-              const std::string& toneMapper   = "bilateral");
+    // decoded (and aligned) images go through imageCache if given
+    HdrSolver(const std::string&                 imageDirectory, 
+              const std::string&                 shutterFilename,
+              const std::string&                 imageAligner = "mtb",
+              const std::string&                 crfSolver    = "debevec", 
+              const std::string&                 toneMapper   = "bilateral",
+              const std::shared_ptr<ImageCache>& imageCache   = nullptr);
+
+    /*
+        Images already in memory, processed by stages owned
+        elsewhere (e.g. kept warm by the job server), the stages
+        are expected to use the given scratch arena already
+    */
+    HdrSolver(std::vector<cv::Mat>                 images,
+              std::vector<float>                   shutterSpeeds,
+              const std::shared_ptr<ImageAligner>& imageAligner,
+              const std::shared_ptr<CrfSolver>&    crfSolver,
+              const std::shared_ptr<ToneMapper>&   toneMapper,
+              const std::shared_ptr<ScratchArena>& scratchArena);
     ~HdrSolver();
 
-    void solve(cv::Mat* const out_hdri) const;
+    void solve(cv::Mat* const out_hdri);
+
+    /*
+        If inout_crf is not empty it is reused instead of being 
+        solved again, otherwise the solved curve is returned in it,
+        out_radiance receives the radiance map before tone mapping
+    */
+    void solve(cv::Mat* const out_hdri, 
+               cv::Mat* const inout_crf,
+               cv::Mat* const out_radiance = nullptr);
+
+    // store the radiance map in half precision
+    void setHalfPrecision(const bool isHalfPrecision);
+
+    // tone curve files of global tone mappers, see ToneMapper
+    void setToneCurveFiles(const std::string& importFilename,
+                           const std::string& exportFilename);
+
+    // drop exposures that add no well exposed pixels
+    void cullExposures();
+
+    /*
+        In lean mode every buffer is freed as soon as the next
+        stage has consumed it: originals after alignment, 
+        aligned images after the merge, the radiance map after
+        tone mapping, so solve can only run once
+    */
+    void setLeanMode(const bool isLean);
+
+    /*
+        Only the region of interest is merged and tone mapped, 
+        with the halo local tone mappers need around it, global 
+        statistics come from a subsampled overview of the whole
+        image, an empty rectangle solves the whole image. The
+        response curve is sampled from the original images at
+        their aligned positions, pass the one of a full render
+        to skip that
+    */
+    void setRegionOfInterest(const cv::Rect& regionOfInterest);
 
 private:
+    // solve of the region of interest, haloRadius from the tone mapper
+    void _solveRegion(const cv::Rect& regionOfInterest,
+                      const int       haloRadius,
+                      cv::Mat* const  out_hdri, 
+                      cv::Mat* const  inout_crf,
+                      cv::Mat* const  out_radiance);
+
     void _readData(const std::string& imageDirectory, const std::string& shutterFilename);
 
+    // print peak and current resident memory after a stage
+    static void _reportMemory(const char* const stage);
+
+    // images may be mapped from the cache, so it is released after them
+    std::shared_ptr<ImageCache> _imageCache;
+    std::string                 _imageAlignerMethod;
+    std::vector<std::string>    _imageKeys;
+
+    // keys of the images mapped from the cache, released with them
+    std::vector<std::string>    _mappedKeys;
+
     std::vector<cv::Mat> _images;
     std::vector<float>   _shutterSpeeds;
 
-    std::unique_ptr<ImageAligner> _imageAligner;
-    std::unique_ptr<CrfSolver>    _crfSolver;
-    std::unique_ptr<ToneMapper>   _toneMapper;
+    std::shared_ptr<ImageAligner> _imageAligner;
+    std::shared_ptr<CrfSolver>    _crfSolver;
+    std::shared_ptr<ToneMapper>   _toneMapper;
+
+    // temporaries of all stages are recycled between runs
+    std::shared_ptr<ScratchArena> _scratchArena;
+
+    bool     _isLean;
+    cv::Rect _regionOfInterest;
+
+    // longer side of the overview a region gets its statistics from
+    static constexpr int OVERVIEW_SIZE = 1024;
 };
 
-} // namespace shdr
\ No newline at end of file
+} // namespace shdr
@@ -0,0 +1,94 @@
+#include "core/imageAligner.h"
+
+#include "core/taskScheduler.h"
+
+#include <iostream>
+
+namespace shdr {
+
+void ImageAligner::align(const std::vector<cv::Mat>&   images,
+                         std::vector<cv::Mat>* const   out_alignImages,
+                         std::vector<cv::Point>* const inout_offsets) const {
+
+    std::cout << "# Begin to align images"
+              << std::endl;
+
+    const int numImages = static_cast<int>(images.size());
+    const int middle    = referenceIndex(numImages);
+
+    std::cout << "    Using image " << (middle + 1) << " as center image"
+              << std::endl;
+
+    /*
+        If previous offsets are given (one per image), 
+        they are used as a warm start
+    */
+    const bool isWarmStart = (inout_offsets->size() == images.size());
+    if (isWarmStart) {
+        std::cout << "    Warm start from previous offsets"
+                  << std::endl;
+    }
+    else {
+        inout_offsets->assign(images.size(), cv::Point(0, 0));
+    }
+
+    /*
+        only align non-center images, one task per image
+    */
+    out_alignImages->resize(images.size());
+    TaskScheduler::instance().parallelFor(0, numImages, 1, [&](const int begin, const int end) {
+        for (int n = begin; n < end; ++n) {
+            if (n == middle) {
+                (*out_alignImages)[n] = images[n];
+                (*inout_offsets)[n]   = cv::Point(0, 0);
+            }
+            else {
+                alignImage(images[middle], images[n], isWarmStart, 
+                           &(*inout_offsets)[n], &(*out_alignImages)[n]);
+            }
+        }
+    });
+
+    for (int n = 0; n < numImages; ++n) {
+        if (n != middle) {
+            std::cout << "    Image " << (n + 1)
+                      << " max offset: x = " << (*inout_offsets)[n].x 
+                      << ", y = " << (*inout_offsets)[n].y
+                      << std::endl;
+        }
+    }
+
+    std::cout << "# Finish aligning images"
+              << std::endl;
+}
+
+void ImageAligner::translateRegion(const cv::Mat&   image,
+                                   const cv::Point& offset,
+                                   const cv::Rect&  region,
+                                   const int        stride,
+                                   cv::Mat* const   out_region) {
+
+    TaskScheduler::StageScope stageScope(StageType::S_ALIGN, image.cols, image.rows);
+
+    const int width  = (region.width  + stride - 1) / stride;
+    const int height = (region.height + stride - 1) / stride;
+
+    /*
+        The inverse map takes a pixel of the region to the pixel
+        of image it comes from, pixels translated in from outside
+        are black like the ones of a warped image
+    */
+    cv::Mat inverseMap = cv::Mat::zeros(cv::Size(3, 2), CV_32FC1);
+    inverseMap.at<float>(0, 0) = static_cast<float>(stride);
+    inverseMap.at<float>(0, 2) = static_cast<float>(region.x - offset.x);
+    inverseMap.at<float>(1, 1) = static_cast<float>(stride);
+    inverseMap.at<float>(1, 2) = static_cast<float>(region.y - offset.y);
+
+    cv::Mat translated;
+    cv::warpAffine(image, translated, inverseMap, cv::Size(width, height), 
+                   cv::INTER_NEAREST | cv::WARP_INVERSE_MAP);
+
+    *out_region = translated;
+}
+
+} // namespace shdr
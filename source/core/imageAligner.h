@@ -1,5 +1,8 @@
 #pragma once
 
+#include "core/pipelineStage.h"
+#include "core/taskScheduler.h"
+
 #include <opencv2/opencv.hpp>
 #include <vector>
 
@@ -10,11 +13,113 @@ namespace shdr {
 
     It is suggested to run image alignment before
     radiance map reconstruction.
+
+    The offsets overload reports the translation found
+    for each image. When it is given one offset per image
+    on input, those offsets are used as a warm start, e.g.
+    the offsets of the previous frame of a time-lapse.
+
+    Each image is aligned to the reference (center) image
+    on its own, so pipelines can schedule one task per image.
+
+    Offsets can also be found without warping the image, 
+    translateRegion then computes only a region of the
+    aligned image (e.g. a crop, or a subsampled overview).
 */
-class ImageAligner {
+class ImageAligner : public PipelineStage {
 public:
-    virtual void align(const std::vector<cv::Mat>& images,
-                       std::vector<cv::Mat>* const out_alignImages) const = 0;
+    void align(const std::vector<cv::Mat>& images,
+               std::vector<cv::Mat>* const out_alignImages) const;
+
+    void align(const std::vector<cv::Mat>&   images,
+               std::vector<cv::Mat>* const   out_alignImages,
+               std::vector<cv::Point>* const inout_offsets) const;
+
+    // align image to reference, inout_offset is used as warm start if isWarmStart
+    void alignImage(const cv::Mat&    reference,
+                    const cv::Mat&    image,
+                    const bool        isWarmStart,
+                    cv::Point* const  inout_offset,
+                    cv::Mat* const    out_alignImage) const;
+
+    // offset of image to reference only, used as warm start if isWarmStart
+    void findOffset(const cv::Mat&   reference,
+                    const cv::Mat&   image,
+                    const bool       isWarmStart,
+                    cv::Point* const inout_offset) const;
+
+    // drop cached reference data, e.g. so that timed runs build it again,
+    // or after writing new pixels into a reference in place
+    void clearCache() const;
+
+    static int referenceIndex(const int numImages);
+
+    /*
+        out_region(u, v) = aligned(region.x + u * stride, region.y + v * stride),
+        where aligned is image translated by offset like alignImage does,
+        only the pixels of the region are computed
+    */
+    static void translateRegion(const cv::Mat&   image,
+                                const cv::Point& offset,
+                                const cv::Rect&  region,
+                                const int        stride,
+                                cv::Mat* const   out_region);
+
+private:
+    virtual void _alignImageImpl(const cv::Mat&   reference,
+                                 const cv::Mat&   image,
+                                 const bool       isWarmStart,
+                                 cv::Point* const inout_offset,
+                                 cv::Mat* const   out_alignImage) const = 0;
+
+    virtual void _findOffsetImpl(const cv::Mat&   reference,
+                                 const cv::Mat&   image,
+                                 const bool       isWarmStart,
+                                 cv::Point* const inout_offset) const = 0;
+
+    // aligners without a cache have nothing to drop
+    virtual void _clearCacheImpl() const;
 };
 
-} // namespace shdr
\ No newline at end of file
+// header implementation
+
+inline void ImageAligner::align(const std::vector<cv::Mat>& images,
+                                std::vector<cv::Mat>* const out_alignImages) const {
+
+    std::vector<cv::Point> offsets;
+    align(images, out_alignImages, &offsets);
+}
+
+inline void ImageAligner::alignImage(const cv::Mat&   reference,
+                                     const cv::Mat&   image,
+                                     const bool       isWarmStart,
+                                     cv::Point* const inout_offset,
+                                     cv::Mat* const   out_alignImage) const {
+
+    TaskScheduler::StageScope stageScope(StageType::S_ALIGN, image.cols, image.rows);
+
+    _alignImageImpl(reference, image, isWarmStart, inout_offset, out_alignImage);
+}
+
+inline void ImageAligner::findOffset(const cv::Mat&   reference,
+                                     const cv::Mat&   image,
+                                     const bool       isWarmStart,
+                                     cv::Point* const inout_offset) const {
+
+    TaskScheduler::StageScope stageScope(StageType::S_ALIGN, image.cols, image.rows);
+
+    _findOffsetImpl(reference, image, isWarmStart, inout_offset);
+}
+
+inline void ImageAligner::clearCache() const {
+    _clearCacheImpl();
+}
+
+inline void ImageAligner::_clearCacheImpl() const {
+}
+
+inline int ImageAligner::referenceIndex(const int numImages) {
+    return numImages / 2;
+}
+
+} // namespace shdr
@@ -0,0 +1,299 @@
+#include "core/imageCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#if (defined(_MSC_VER) || \
+     (defined(__GNUC__) && (__GNUC_MAJOR__ >= 8))) 
+    #include <filesystem>
+    namespace std_fs = std::filesystem;
+#else
+    #include <experimental/filesystem>
+    namespace std_fs = std::experimental::filesystem;
+#endif
+
+namespace shdr {
+
+const char ImageCache::MAGIC[8] = { 'S', 'H', 'D', 'R', 'I', 'M', 'G', '1' };
+
+ImageCache::ImageCache(const std::string& directory, const std::size_t maxBytes) :
+    _directory(directory),
+    _maxBytes(maxBytes),
+    _isAlignedCaching(false),
+    _index(),
+    _totalBytes(0),
+    _useClock(0),
+    _mappings(),
+    _mutex() {
+
+    std::error_code error;
+    std_fs::create_directories(_directory, error);
+
+    _scan();
+}
+
+std::string ImageCache::fileKey(const std::string& filename) {
+    std::error_code error;
+    if (!std_fs::exists(filename, error)) {
+        return "";
+    }
+
+    const std_fs::path path     = std_fs::absolute(filename);
+    const auto         size     = std_fs::file_size(path, error);
+    const auto         modified = std_fs::last_write_time(path, error);
+    if (error) {
+        return "";
+    }
+
+    return path.string() + "|" + 
+           std::to_string(modified.time_since_epoch().count()) + "|" + 
+           std::to_string(size);
+}
+
+bool ImageCache::load(const std::string& key, cv::Mat* const out_image) {
+    if (key.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const std::uint64_t keyHash  = _hash(key);
+    const std::string   filename = _entryFilename(keyHash);
+
+    /*
+        A pinned entry is already mapped and checked
+    */
+    auto mapped = _mappings.find(keyHash);
+    if (mapped == _mappings.end()) {
+        auto mapping = std::make_unique<MappedFile>();
+        {
+            // a missing entry is a normal miss, no need to try mapping it
+            std::error_code error;
+            if (!std_fs::exists(filename, error) || !mapping->openReadOnly(filename)) {
+                return false;
+            }
+        }
+
+        /*
+            Check the entry really belongs to key and is complete
+        */
+        if (mapping->size() < sizeof(Header)) {
+            return false;
+        }
+
+        const Header* header = static_cast<const Header*>(mapping->data());
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->keyHash != keyHash ||
+            std::strncmp(header->key, key.c_str(), sizeof(header->key) - 1) != 0) {
+
+            return false;
+        }
+
+        const cv::Mat image(header->rows, header->cols, header->type,
+                            const_cast<unsigned char*>(static_cast<const unsigned char*>(mapping->data())) + sizeof(Header));
+        if (mapping->size() < sizeof(Header) + image.total() * image.elemSize()) {
+            return false;
+        }
+
+        Mapping entry;
+        entry.file     = std::move(mapping);
+        entry.numUsers = 0;
+        mapped = _mappings.emplace(keyHash, std::move(entry)).first;
+    }
+
+    MappedFile&   file   = *mapped->second.file;
+    const Header* header = static_cast<const Header*>(file.data());
+
+    ++mapped->second.numUsers;
+    *out_image = cv::Mat(header->rows, header->cols, header->type,
+                         const_cast<unsigned char*>(static_cast<const unsigned char*>(file.data())) + sizeof(Header));
+
+    // a hit makes the entry the most recently used one, in this run and the next
+    _touch(keyHash, file.size());
+
+    std::error_code error;
+    std_fs::last_write_time(filename, std_fs::file_time_type::clock::now(), error);
+
+    return true;
+}
+
+void ImageCache::release(const std::string& key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto mapped = _mappings.find(_hash(key));
+    if (mapped != _mappings.end() && --mapped->second.numUsers <= 0) {
+        _mappings.erase(mapped);
+    }
+}
+
+void ImageCache::store(const std::string& key, const cv::Mat& image) {
+    if (key.empty() || image.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const std::uint64_t keyHash  = _hash(key);
+    const std::string   filename = _entryFilename(keyHash);
+    const std::size_t   rowBytes = image.cols * image.elemSize();
+    const std::size_t   numBytes = sizeof(Header) + rowBytes * image.rows;
+
+    /*
+        Written to a temporary name first, so that a reader 
+        never maps a half written entry
+    */
+    const std::string temporaryFilename = filename + ".tmp";
+    {
+        MappedFile file;
+        if (!file.open(temporaryFilename, numBytes)) {
+            std::cout << "Image cache entry <" << temporaryFilename << "> can't be written"
+                      << std::endl;
+
+            return;
+        }
+
+        Header* header = static_cast<Header*>(file.data());
+        std::memset(header, 0, sizeof(Header));
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->rows    = image.rows;
+        header->cols    = image.cols;
+        header->type    = image.type();
+        header->keyHash = keyHash;
+        std::strncpy(header->key, key.c_str(), sizeof(header->key) - 1);
+
+        unsigned char* pixels = static_cast<unsigned char*>(file.data()) + sizeof(Header);
+        for (int iy = 0; iy < image.rows; ++iy) {
+            std::memcpy(pixels + iy * rowBytes, image.ptr(iy), rowBytes);
+        }
+
+        file.sync();
+    }
+
+    std::error_code error;
+    std_fs::rename(temporaryFilename, filename, error);
+    if (error) {
+        std_fs::remove(temporaryFilename, error);
+
+        return;
+    }
+
+    _touch(keyHash, numBytes);
+    _evict();
+}
+
+void ImageCache::setAlignedCaching(const bool isAlignedCaching) {
+    _isAlignedCaching = isAlignedCaching;
+}
+
+bool ImageCache::isAlignedCaching() const {
+    return _isAlignedCaching;
+}
+
+std::string ImageCache::_entryFilename(const std::uint64_t keyHash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.raw", static_cast<unsigned long long>(keyHash));
+
+    return (std_fs::path(_directory) / name).string();
+}
+
+void ImageCache::_scan() {
+    struct Entry {
+        std::uint64_t          keyHash;
+        std::uintmax_t         size;
+        std_fs::file_time_type lastUsed;
+    };
+
+    std::error_code    error;
+    std::vector<Entry> entries;
+    for (const auto& file : std_fs::directory_iterator(_directory, error)) {
+        if (file.path().extension() != ".raw") {
+            continue;
+        }
+
+        // entry files are named by their key hash
+        const std::string stem = file.path().stem().string();
+        char*             end  = nullptr;
+
+        Entry entry;
+        entry.keyHash  = std::strtoull(stem.c_str(), &end, 16);
+        entry.size     = std_fs::file_size(file.path(), error);
+        entry.lastUsed = std_fs::last_write_time(file.path(), error);
+        if (error || stem.empty() || *end != '\0') {
+            error.clear();
+
+            continue;
+        }
+
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+
+    for (const Entry& entry : entries) {
+        _touch(entry.keyHash, entry.size);
+    }
+}
+
+void ImageCache::_touch(const std::uint64_t keyHash, const std::uintmax_t size) {
+    IndexEntry& entry = _index[keyHash];
+
+    _totalBytes    = _totalBytes - entry.size + size;
+    entry.size     = size;
+    entry.lastUsed = ++_useClock;
+}
+
+void ImageCache::_evict() {
+    if (_totalBytes <= _maxBytes) {
+        return;
+    }
+
+    /*
+        Least recently used entries go first. Pinned entries 
+        stay readable on POSIX, elsewhere removing them fails
+        and they are tried again next time
+    */
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> entries;
+    entries.reserve(_index.size());
+    for (const auto& entry : _index) {
+        entries.emplace_back(entry.second.lastUsed, entry.first);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    for (const auto& entry : entries) {
+        if (_totalBytes <= _maxBytes) {
+            break;
+        }
+
+        const std::uint64_t keyHash  = entry.second;
+        const std_fs::path  filename = _entryFilename(keyHash);
+
+        // an entry another process already removed only leaves the index
+        std::error_code error;
+        if (std_fs::remove(filename, error) || !std_fs::exists(filename, error)) {
+            _totalBytes -= _index[keyHash].size;
+            _index.erase(keyHash);
+
+            std::cout << "    Evict cached image " << filename.filename().string()
+                      << std::endl;
+        }
+    }
+}
+
+std::uint64_t ImageCache::_hash(const std::string& key) {
+    // FNV-1a
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+} // namespace shdr
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "core/mappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ImageCache keeps decoded (and optionally aligned) images
+    on disk in a raw layout, so repeated runs on the same 
+    bracket map the pixels instead of decoding them again.
+
+    Entries are keyed by source file path, modification time
+    and size (see fileKey). A loaded entry is memory-mapped
+    read-only and pinned, the image stays valid until the
+    key is released (or the cache is destroyed), loading a
+    pinned key again shares its mapping.
+
+    The cache directory is capped in size, the least recently
+    used entries are evicted first. Sizes and use order are
+    kept in memory, the directory is only listed when the
+    cache is created (hits refresh an entry's file time, so
+    the order carries over to the next run).
+*/
+class ImageCache {
+public:
+    ImageCache(const std::string& directory, const std::size_t maxBytes);
+
+    // key of an image file, empty if the file can't be found
+    static std::string fileKey(const std::string& filename);
+
+    // returns false if there is no entry for key,
+    // otherwise the entry stays mapped until release(key)
+    bool load(const std::string& key, cv::Mat* const out_image);
+
+    // unpin an entry loaded before, its mapping is closed once
+    // every load of it is released
+    void release(const std::string& key);
+
+    void store(const std::string& key, const cv::Mat& image);
+
+    // whether aligned images are cached as well
+    void setAlignedCaching(const bool isAlignedCaching);
+    bool isAlignedCaching() const;
+
+private:
+    /*
+        Raw entry layout: header, then continuous pixel rows
+    */
+    struct Header {
+        char          magic[8];
+        std::int32_t  rows;
+        std::int32_t  cols;
+        std::int32_t  type;
+        std::int32_t  reserved;
+        std::uint64_t keyHash;
+        char          key[480];
+    };
+
+    struct IndexEntry {
+        std::uintmax_t size;
+        std::uint64_t  lastUsed;
+    };
+
+    struct Mapping {
+        std::unique_ptr<MappedFile> file;
+        int                         numUsers;
+    };
+
+    std::string _entryFilename(const std::uint64_t keyHash) const;
+
+    // list the entries already in the directory, oldest first
+    void _scan();
+
+    // mark an entry as the most recently used one
+    void _touch(const std::uint64_t keyHash, const std::uintmax_t size);
+
+    void _evict();
+
+    static std::uint64_t _hash(const std::string& key);
+
+    std::string _directory;
+    std::size_t _maxBytes;
+    bool        _isAlignedCaching;
+
+    std::map<std::uint64_t, IndexEntry> _index;
+    std::uintmax_t                      _totalBytes;
+    std::uint64_t                       _useClock;
+
+    std::map<std::uint64_t, Mapping> _mappings;
+    std::mutex                       _mutex;
+
+    static const char MAGIC[8];
+};
+
+} // namespace shdr
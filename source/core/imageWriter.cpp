@@ -0,0 +1,205 @@
+#include "core/imageWriter.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+namespace shdr {
+
+ImageWriter::ImageWriter(const std::string& path) :
+    _path(path),
+    _format(),
+    _quality(95),
+    _compression(1) {
+}
+
+void ImageWriter::setPath(const std::string& path) {
+    _path = path;
+}
+
+void ImageWriter::setFormat(const std::string& format) {
+    _format = format;
+}
+
+void ImageWriter::setQuality(const int quality) {
+    _quality = quality;
+}
+
+void ImageWriter::setCompression(const int compression) {
+    _compression = compression;
+}
+
+bool ImageWriter::isStdout() const {
+    return _path == "-";
+}
+
+std::string ImageWriter::format() const {
+    std::string format = _format;
+    if (format.empty()) {
+        const std::size_t dot = _path.find_last_of('.');
+        format = (isStdout() || dot == std::string::npos) ? "png" : _path.substr(dot + 1);
+    }
+
+    std::transform(format.begin(), format.end(), format.begin(), [](const unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return (format == "jpeg") ? "jpg" : format;
+}
+
+bool ImageWriter::write(const cv::Mat& ldri) const {
+    const std::string format = this->format();
+    const bool        isPnm  = (format == "ppm" || format == "pnm" || format == "pgm");
+
+    bool isWritten = false;
+    if (isPnm) {
+        FILE* const file = _open();
+        if (file) {
+            isWritten = _writePnm(ldri, file);
+            isWritten = _close(file) && isWritten;
+        }
+    }
+    else {
+        isWritten = _writeEncoded(ldri, format);
+    }
+
+    if (!isWritten) {
+        std::cout << "Output can't be written: " << _path
+                  << std::endl;
+    }
+
+    return isWritten;
+}
+
+FILE* ImageWriter::_open() const {
+    FILE* file = nullptr;
+    if (isStdout()) {
+        file = stdout;
+
+#ifdef _WIN32
+        // no newline translation of the encoded bytes
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    else {
+        file = fopen(_path.c_str(), "wb");
+    }
+
+    if (!file) {
+        std::cout << "Output file can't open: " << _path
+                  << std::endl;
+    }
+
+    return file;
+}
+
+bool ImageWriter::_close(FILE* const file) const {
+    return isStdout() ? (fflush(file) == 0) : (fclose(file) == 0);
+}
+
+bool ImageWriter::_writePnm(const cv::Mat& ldri, FILE* const file) const {
+    const int width       = ldri.cols;
+    const int height      = ldri.rows;
+    const int numChannels = ldri.channels();
+    const int rowBytes    = width * numChannels;
+
+    /*
+        Binary pnm is a short header followed by raw rows,
+        color rows are stored as RGB
+    */
+    char header[64];
+    const int headerSize = snprintf(header, sizeof(header), "%s\n%d %d\n255\n", 
+                                    (numChannels == 1) ? "P5" : "P6", width, height);
+    if (fwrite(header, 1, static_cast<std::size_t>(headerSize), file) != static_cast<std::size_t>(headerSize)) {
+        return false;
+    }
+
+    /*
+        Rows are converted in parallel chunks, one window of
+        chunks at a time, so that the first bytes are written
+        while the rest of the image is still being converted
+    */
+    TaskScheduler& scheduler = TaskScheduler::instance();
+
+    const int chunkRows      = scheduler.rowBandSize();
+    const int chunksInWindow = scheduler.numThreads() * CHUNKS_PER_THREAD;
+    const int numChunks      = (height + chunkRows - 1) / chunkRows;
+
+    std::vector<std::vector<uchar>> chunks(chunksInWindow);
+    for (int windowBegin = 0; windowBegin < numChunks; windowBegin += chunksInWindow) {
+        const int windowEnd = std::min(windowBegin + chunksInWindow, numChunks);
+
+        scheduler.parallelFor(windowBegin, windowEnd, 1, [&](const int chunkBegin, const int chunkEnd) {
+            for (int chunk = chunkBegin; chunk < chunkEnd; ++chunk) {
+                const int rowBegin = chunk * chunkRows;
+                const int rowEnd   = std::min(rowBegin + chunkRows, height);
+
+                std::vector<uchar>& bytes = chunks[chunk - windowBegin];
+                bytes.resize(static_cast<std::size_t>(rowEnd - rowBegin) * rowBytes);
+
+                uchar* out = bytes.data();
+                for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                    const uchar* row = ldri.ptr<uchar>(iy);
+                    if (numChannels == 1) {
+                        std::copy(row, row + rowBytes, out);
+                    }
+                    else {
+                        for (int ix = 0; ix < width; ++ix) {
+                            out[3 * ix]     = row[3 * ix + 2];
+                            out[3 * ix + 1] = row[3 * ix + 1];
+                            out[3 * ix + 2] = row[3 * ix];
+                        }
+                    }
+                    out += rowBytes;
+                }
+            }
+        });
+
+        for (int chunk = windowBegin; chunk < windowEnd; ++chunk) {
+            const std::vector<uchar>& bytes = chunks[chunk - windowBegin];
+            if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+                return false;
+            }
+        }
+        fflush(file);
+    }
+
+    return true;
+}
+
+bool ImageWriter::_writeEncoded(const cv::Mat& ldri, const std::string& format) const {
+    std::vector<int> params;
+    if (format == "jpg") {
+        params = { cv::IMWRITE_JPEG_QUALITY, _quality };
+    }
+    else if (format == "webp") {
+        params = { cv::IMWRITE_WEBP_QUALITY, _quality };
+    }
+    else if (format == "png") {
+        params = { cv::IMWRITE_PNG_COMPRESSION, _compression };
+    }
+
+    // encode first, the file is only created once there is something to write
+    std::vector<uchar> bytes;
+    if (!cv::imencode("." + format, ldri, bytes, params)) {
+        return false;
+    }
+
+    FILE* const file = _open();
+    if (!file) {
+        return false;
+    }
+
+    const bool isWritten = (fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size());
+
+    return _close(file) && isWritten;
+}
+
+} // namespace shdr
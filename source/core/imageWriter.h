@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ImageWriter is the output stage for tone mapped images.
+
+    The format follows the file extension unless it is set
+    explicitly, the path "-" streams the image to stdout
+    (png unless another format is set), so a pipe can consume
+    it without a temporary file.
+
+    Only the uncompressed formats (ppm / pgm) are streamed:
+    they are converted in parallel row chunks and written out
+    window by window as they are ready. Other formats are
+    encoded by OpenCV into memory with the given quality
+    (jpg, webp) or compression level (png) before the file
+    is opened, so a failed encoding leaves no partial file.
+*/
+class ImageWriter {
+public:
+    explicit ImageWriter(const std::string& path = "./hdr_tone_mapping.png");
+
+    // keeps the format settings, e.g. to write frames of a sequence
+    void setPath(const std::string& path);
+
+    // format name without dot, e.g. "png", "jpg" or "ppm"
+    void setFormat(const std::string& format);
+
+    // quality of lossy formats, 0-100
+    void setQuality(const int quality);
+
+    // compression level of png, 0-9
+    void setCompression(const int compression);
+
+    bool write(const cv::Mat& ldri) const;
+
+    // true if the image goes to stdout
+    bool isStdout() const;
+
+    // format actually written, set explicitly or taken from the path
+    std::string format() const;
+
+private:
+    // opens the path, or returns stdout
+    FILE* _open() const;
+
+    // flushes stdout or closes the file, false on a write error
+    bool _close(FILE* const file) const;
+
+    bool _writePnm(const cv::Mat& ldri, FILE* const file) const;
+    bool _writeEncoded(const cv::Mat& ldri, const std::string& format) const;
+
+    std::string _path;
+    std::string _format;
+    int         _quality;
+    int         _compression;
+
+    // chunks encoded in parallel per written window, per thread
+    static const int CHUNKS_PER_THREAD = 2;
+};
+
+} // namespace shdr
@@ -0,0 +1,573 @@
+#include "core/jobServer.h"
+
+#include "core/crfSolver.h"
+#include "core/hdrSolver.h"
+#include "core/imageAligner.h"
+#include "core/imageWriter.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/toneMapper.h"
+#include "ioUtils.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define SHDR_HAS_UNIX_SOCKET
+#endif
+
+namespace shdr {
+
+namespace {
+
+double elapsedMilliseconds(const std::chrono::steady_clock::time_point& begin,
+                           const std::chrono::steady_clock::time_point& end) {
+
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// free scratch buffers kept warm for the next job
+constexpr std::size_t SCRATCH_BUDGET_BYTES = std::size_t(512) << 20;
+
+/*
+    Client values are only cast once they are finite
+    integers in [0, INT_MAX], the corners included
+*/
+bool readRegionOfInterest(const JsonValue& value, cv::Rect* const out_roi) {
+    const std::vector<JsonValue>& roi = value.asArray();
+    if (roi.size() != 4) {
+        return false;
+    }
+
+    for (const JsonValue& coordinate : roi) {
+        // non-numbers give -1
+        const double number = coordinate.asNumber(-1.0);
+        if (!std::isfinite(number)       ||
+            number != std::floor(number) ||
+            number < 0.0 || number > INT_MAX) {
+
+            return false;
+        }
+    }
+
+    if (roi[0].asNumber() + roi[2].asNumber() > INT_MAX ||
+        roi[1].asNumber() + roi[3].asNumber() > INT_MAX) {
+        return false;
+    }
+
+    *out_roi = cv::Rect(static_cast<int>(roi[0].asNumber()),
+                        static_cast<int>(roi[1].asNumber()),
+                        static_cast<int>(roi[2].asNumber()),
+                        static_cast<int>(roi[3].asNumber()));
+
+    return true;
+}
+
+#ifdef SHDR_HAS_UNIX_SOCKET
+
+/*
+    One client of the socket, it is closed once the
+    reader and all of its pending jobs are done with it
+*/
+class SocketConnection {
+public:
+    explicit SocketConnection(const int fd) :
+        _fd(fd),
+        _writeMutex() {
+    }
+
+    ~SocketConnection() {
+        ::close(_fd);
+    }
+
+    void writeLine(const std::string& line) {
+        std::lock_guard<std::mutex> lock(_writeMutex);
+
+        const std::string text = line + "\n";
+
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+
+        std::size_t numWritten = 0;
+        while (numWritten < text.size()) {
+            const ssize_t n = ::send(_fd, text.data() + numWritten, text.size() - numWritten, flags);
+            if (n <= 0) {
+                // the client has gone away
+                return;
+            }
+
+            numWritten += static_cast<std::size_t>(n);
+        }
+    }
+
+    // returns false at the end of the stream
+    bool readLine(std::string* const out_line) {
+        while (true) {
+            const std::size_t newline = _pending.find('\n');
+            if (newline != std::string::npos) {
+                *out_line = _pending.substr(0, newline);
+                _pending.erase(0, newline + 1);
+
+                return true;
+            }
+
+            char buffer[4096];
+            const ssize_t n = ::recv(_fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                // last request may not end with a newline
+                if (!_pending.empty()) {
+                    *out_line = _pending;
+                    _pending.clear();
+
+                    return true;
+                }
+
+                return false;
+            }
+
+            _pending.append(buffer, static_cast<std::size_t>(n));
+        }
+    }
+
+private:
+    int         _fd;
+    std::mutex  _writeMutex;
+    std::string _pending;
+};
+
+#endif
+
+} // anonymous namespace
+
+JobServer::JobServer(const std::string& imageAligner,
+                     const std::string& crfSolver,
+                     const std::string& toneMapper,
+                     const int          numWorkers,
+                     const int          queueCapacity) :
+    _defaultImageAligner(imageAligner),
+    _defaultCrfSolver(crfSolver),
+    _defaultToneMapper(toneMapper),
+    _isHalfPrecision(false),
+    _scratchArena(std::make_shared<ScratchArena>()),
+    _imageAligners(),
+    _crfSolvers(),
+    _toneMappers(),
+    _crfCache(),
+    _cacheMutex(),
+    _jobs(),
+    _queueCapacity(static_cast<std::size_t>(std::max(queueCapacity, 1))),
+    _isFinished(false),
+    _queueMutex(),
+    _notEmpty(),
+    _notFull(),
+    _workers() {
+
+    // jobs run side by side, each job is parallel inside as well
+    for (int i = 0; i < std::max(numWorkers, 1); ++i) {
+        _workers.emplace_back(&JobServer::_workerLoop, this);
+    }
+}
+
+JobServer::~JobServer() {
+    _finish();
+}
+
+void JobServer::setHalfPrecision(const bool isHalfPrecision) {
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    _isHalfPrecision = isHalfPrecision;
+    for (auto& crfSolver : _crfSolvers) {
+        crfSolver.second->setHalfPrecision(isHalfPrecision);
+    }
+}
+
+void JobServer::serve(std::istream& in, std::ostream& out) {
+    std::cout << "# Job server reading requests from stdin"
+              << std::endl;
+
+    std::mutex outMutex;
+    const Respond respond = [&out, &outMutex](const std::string& line) {
+        std::lock_guard<std::mutex> lock(outMutex);
+        out << line << std::endl;
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+        _handleLine(line, respond);
+    }
+
+    // responses of queued jobs still go to out
+    _finish();
+}
+
+void JobServer::serveSocket(const std::string& socketPath) {
+#ifdef SHDR_HAS_UNIX_SOCKET
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path is too long: " << socketPath
+                  << std::endl;
+
+        return;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    const int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cout << "Socket can't be created !"
+                  << std::endl;
+
+        return;
+    }
+
+    // a stale socket of a previous server would make bind fail
+    ::unlink(socketPath.c_str());
+    if (::bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+
+        std::cout << "Socket can't listen on " << socketPath << " !"
+                  << std::endl;
+
+        ::close(listenFd);
+
+        return;
+    }
+
+    std::cout << "# Job server listening on " << socketPath
+              << std::endl;
+
+    while (true) {
+        const int clientFd = ::accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            continue;
+        }
+
+        const auto connection = std::make_shared<SocketConnection>(clientFd);
+        std::thread([this, connection]() {
+            const Respond respond = [connection](const std::string& line) {
+                connection->writeLine(line);
+            };
+
+            std::string line;
+            while (connection->readLine(&line)) {
+                _handleLine(line, respond);
+            }
+        }).detach();
+    }
+
+#else
+    std::cout << "Socket mode needs a POSIX system, use stdin instead"
+              << std::endl;
+
+    serve(std::cin, std::cout);
+
+#endif
+}
+
+void JobServer::_handleLine(const std::string& line, const Respond& respond) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        return;
+    }
+
+    Job job;
+    if (!JsonValue::parse(line, &job.request) || 
+        job.request.type() != JsonType::J_OBJECT) {
+
+        JsonValue response = JsonValue::object();
+        response.set("status", "error");
+        response.set("error", "malformed request");
+        respond(response.dump());
+
+        return;
+    }
+
+    job.respond     = respond;
+    job.enqueueTime = Clock::now();
+
+    _push(std::move(job));
+}
+
+void JobServer::_push(Job job) {
+    std::unique_lock<std::mutex> lock(_queueMutex);
+
+    // wait here (and stop reading requests) while the queue is full
+    _notFull.wait(lock, [this]() {
+        return _jobs.size() < _queueCapacity;
+    });
+
+    _jobs.push_back(std::move(job));
+    _notEmpty.notify_one();
+}
+
+void JobServer::_finish() {
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _isFinished = true;
+    }
+    _notEmpty.notify_all();
+
+    for (auto& worker : _workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void JobServer::_workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _notEmpty.wait(lock, [this]() {
+                return !_jobs.empty() || _isFinished;
+            });
+
+            // remaining jobs are drained before workers leave
+            if (_jobs.empty()) {
+                return;
+            }
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        _notFull.notify_one();
+
+        _runJob(job);
+    }
+}
+
+void JobServer::_runJob(const Job& job) {
+    const JsonValue&        request   = job.request;
+    const Clock::time_point startTime = Clock::now();
+
+    JsonValue response = JsonValue::object();
+    response.set("id", request["id"]);
+
+    std::string error;
+    try {
+        std::vector<cv::Mat> images;
+        std::vector<float>   shutterSpeeds;
+        cv::Rect             roi;
+        if (request.has("roi") && !readRegionOfInterest(request["roi"], &roi)) {
+            error = "roi must be four integers in [0, " + std::to_string(INT_MAX) + "]";
+        }
+        else if (_readInputs(request, &images, &shutterSpeeds, &error)) {
+            const std::string crfMethod = request["crf"].asString(_defaultCrfSolver);
+
+            /*
+                Response curves are only reused for the same method
+                and camera, the exposure set doesn't identify a camera,
+                so jobs without a camera name solve their own curve
+            */
+            const bool        isCrfCaching = request.has("camera");
+            const std::string crfKey       = crfMethod + "|camera:" + request["camera"].asString();
+
+            cv::Mat crf;
+            if (isCrfCaching) {
+                std::lock_guard<std::mutex> lock(_cacheMutex);
+                const auto cached = _crfCache.find(crfKey);
+                if (cached != _crfCache.end()) {
+                    crf = cached->second;
+                }
+            }
+            const bool isCrfCached = !crf.empty();
+
+            HdrSolver hdrSolver(std::move(images),
+                                std::move(shutterSpeeds),
+                                _getImageAligner(request["aligner"].asString(_defaultImageAligner)),
+                                _getCrfSolver(crfMethod),
+                                _getToneMapper(request["toneMapper"].asString(_defaultToneMapper)),
+                                _scratchArena);
+
+            if (request.has("roi")) {
+                hdrSolver.setRegionOfInterest(roi);
+            }
+
+            cv::Mat ldri;
+            hdrSolver.solve(&ldri, &crf);
+
+            if (isCrfCaching && !isCrfCached) {
+                std::lock_guard<std::mutex> lock(_cacheMutex);
+                _crfCache[crfKey] = crf;
+            }
+
+            if (request.has("output")) {
+                const std::string output = request["output"].asString();
+                if (ImageWriter(output).write(ldri)) {
+                    response.set("output", output);
+                }
+                else {
+                    error = "output can't be written: " + output;
+                }
+            }
+            else {
+                std::vector<uchar> buffer;
+                cv::imencode(".png", ldri, buffer);
+                response.set("image", ioUtils::encodeBase64(buffer));
+            }
+
+            response.set("crfCached", isCrfCached);
+        }
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    /*
+        The arena is shared by all jobs, buffers of
+        other image sizes are released beyond the budget
+    */
+    _scratchArena->trim(SCRATCH_BUDGET_BYTES);
+
+    const Clock::time_point endTime = Clock::now();
+
+    response.set("status", error.empty() ? "ok" : "error");
+    if (!error.empty()) {
+        response.set("error", error);
+    }
+    response.set("queueMs", elapsedMilliseconds(job.enqueueTime, startTime));
+    response.set("runMs",   elapsedMilliseconds(startTime, endTime));
+    response.set("totalMs", elapsedMilliseconds(job.enqueueTime, endTime));
+    response.set("scratchBytes", static_cast<double>(_scratchArena->reservedBytes()));
+
+    job.respond(response.dump());
+}
+
+std::shared_ptr<ImageAligner> JobServer::_getImageAligner(const std::string& method) {
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    std::shared_ptr<ImageAligner>& imageAligner = _imageAligners[method];
+    if (!imageAligner) {
+        imageAligner = StageFactory::createImageAligner(method);
+        imageAligner->setScratchArena(_scratchArena.get());
+    }
+
+    return imageAligner;
+}
+
+std::shared_ptr<CrfSolver> JobServer::_getCrfSolver(const std::string& method) {
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    std::shared_ptr<CrfSolver>& crfSolver = _crfSolvers[method];
+    if (!crfSolver) {
+        crfSolver = StageFactory::createCrfSolver(method);
+        crfSolver->setScratchArena(_scratchArena.get());
+        crfSolver->setHalfPrecision(_isHalfPrecision);
+    }
+
+    return crfSolver;
+}
+
+std::shared_ptr<ToneMapper> JobServer::_getToneMapper(const std::string& method) {
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    std::shared_ptr<ToneMapper>& toneMapper = _toneMappers[method];
+    if (!toneMapper) {
+        toneMapper = StageFactory::createToneMapper(method);
+        toneMapper->setScratchArena(_scratchArena.get());
+    }
+
+    return toneMapper;
+}
+
+bool JobServer::_readInputs(const JsonValue&            request,
+                            std::vector<cv::Mat>* const out_images,
+                            std::vector<float>* const   out_shutterSpeeds,
+                            std::string* const          out_error) {
+
+    /*
+        Images come from file paths, a directory 
+        or base64 encoded image files
+    */
+    if (request.has("images")) {
+        for (const JsonValue& filename : request["images"].asArray()) {
+            out_images->push_back(cv::imread(filename.asString()));
+        }
+    }
+    else if (request.has("imageDirectory")) {
+        ioUtils::readImages(request["imageDirectory"].asString(), out_images);
+    }
+    else if (request.has("buffers")) {
+        for (const JsonValue& text : request["buffers"].asArray()) {
+            std::vector<uchar> buffer;
+            if (!ioUtils::decodeBase64(text.asString(), &buffer) || buffer.empty()) {
+                out_images->push_back(cv::Mat());
+
+                continue;
+            }
+
+            out_images->push_back(cv::imdecode(buffer, cv::IMREAD_COLOR));
+        }
+    }
+
+    /*
+        Shutter speeds come from the request 
+        or from a shutter speed file
+    */
+    if (request.has("exposures")) {
+        for (const JsonValue& exposure : request["exposures"].asArray()) {
+            out_shutterSpeeds->push_back(static_cast<float>(exposure.asNumber()));
+        }
+    }
+    else if (request.has("shutterFile")) {
+        const std::string shutterFilename = request["shutterFile"].asString();
+
+        // reading a missing file would end the whole server
+        FILE* f = fopen(shutterFilename.c_str(), "r");
+        if (!f) {
+            *out_error = "shutter times file can't open: " + shutterFilename;
+
+            return false;
+        }
+        fclose(f);
+
+        ioUtils::readShutterSpeeds(shutterFilename, out_shutterSpeeds);
+    }
+
+    if (out_images->size() < 2) {
+        *out_error = "at least two images are needed";
+
+        return false;
+    }
+    if (out_images->size() != out_shutterSpeeds->size()) {
+        *out_error = "number of images and exposures differ";
+
+        return false;
+    }
+
+    for (std::size_t i = 0; i < out_images->size(); ++i) {
+        const cv::Mat& image = (*out_images)[i];
+        if (image.empty() || image.type() != CV_8UC3) {
+            *out_error = "image " + std::to_string(i + 1) + " can't be read";
+
+            return false;
+        }
+        if (image.size() != out_images->front().size()) {
+            *out_error = "image " + std::to_string(i + 1) + " differs in size";
+
+            return false;
+        }
+        if (!((*out_shutterSpeeds)[i] > 0.0f)) {
+            *out_error = "exposure " + std::to_string(i + 1) + " is not positive";
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace shdr
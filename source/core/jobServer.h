@@ -0,0 +1,117 @@
+#pragma once
+
+#include "jsonValue.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace shdr {
+
+class CrfSolver;
+class ImageAligner;
+class ScratchArena;
+class ToneMapper;
+
+/*
+    JobServer keeps the pipeline warm between requests, so that
+    small jobs do not pay for process start, stage construction
+    and a cold scratch arena every time.
+
+    Requests and responses are line-delimited JSON, read from
+    stdin (responses on stdout) or from a local Unix socket.
+    A request looks like
+
+        {"id": "1", "images": ["a.jpg", "b.jpg"], "exposures": [0.5, 0.125],
+         "aligner": "mtb", "crf": "debevec", "toneMapper": "bilateral",
+         "camera": "my-camera", "output": "out.png", "roi": [0, 0, 256, 256]}
+
+    where "images" can be replaced by "imageDirectory" (read like
+    the command line) or "buffers" (base64 encoded image files), 
+    "exposures" by "shutterFile", and a missing "output" returns 
+    the tone mapped image as a base64 png in the response. An
+    optional "roi" [x, y, width, height] of non-negative integers
+    only solves that region. Responses report the bytes the shared
+    scratch arena keeps after the job in "scratchBytes".
+
+    Stages are created once per method and shared by all jobs,
+    response curves are cached per crf method and camera, jobs
+    without a camera name always solve it. Jobs wait in a bounded 
+    queue, a full queue stops reading requests (backpressure).
+*/
+class JobServer {
+public:
+    JobServer(const std::string& imageAligner   = "mtb",
+              const std::string& crfSolver      = "debevec",
+              const std::string& toneMapper     = "bilateral",
+              const int          numWorkers     = 2,
+              const int          queueCapacity  = 8);
+    ~JobServer();
+
+    // serve requests until the input ends
+    void serve(std::istream& in, std::ostream& out);
+
+    // serve requests of every client connecting to the socket
+    void serveSocket(const std::string& socketPath);
+
+    // store radiance maps of all jobs in half precision
+    void setHalfPrecision(const bool isHalfPrecision);
+
+private:
+    using Clock   = std::chrono::steady_clock;
+    using Respond = std::function<void(const std::string&)>;
+
+    struct Job {
+        JsonValue         request;
+        Respond           respond;
+        Clock::time_point enqueueTime;
+    };
+
+    void _handleLine(const std::string& line, const Respond& respond);
+    void _push(Job job);
+    void _finish();
+    void _workerLoop();
+    void _runJob(const Job& job);
+
+    std::shared_ptr<ImageAligner> _getImageAligner(const std::string& method);
+    std::shared_ptr<CrfSolver>    _getCrfSolver(const std::string& method);
+    std::shared_ptr<ToneMapper>   _getToneMapper(const std::string& method);
+
+    static bool _readInputs(const JsonValue&            request,
+                            std::vector<cv::Mat>* const out_images,
+                            std::vector<float>* const   out_shutterSpeeds,
+                            std::string* const          out_error);
+
+    std::string _defaultImageAligner;
+    std::string _defaultCrfSolver;
+    std::string _defaultToneMapper;
+    bool        _isHalfPrecision;
+
+    // warm state shared by all jobs
+    std::shared_ptr<ScratchArena>                        _scratchArena;
+    std::map<std::string, std::shared_ptr<ImageAligner>> _imageAligners;
+    std::map<std::string, std::shared_ptr<CrfSolver>>    _crfSolvers;
+    std::map<std::string, std::shared_ptr<ToneMapper>>   _toneMappers;
+    std::map<std::string, cv::Mat>                       _crfCache;
+    std::mutex                                           _cacheMutex;
+
+    // bounded job queue
+    std::deque<Job>          _jobs;
+    std::size_t              _queueCapacity;
+    bool                     _isFinished;
+    std::mutex               _queueMutex;
+    std::condition_variable  _notEmpty;
+    std::condition_variable  _notFull;
+    std::vector<std::thread> _workers;
+};
+
+} // namespace shdr
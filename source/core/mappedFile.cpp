@@ -0,0 +1,222 @@
+#include "core/mappedFile.h"
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+#endif
+
+namespace shdr {
+
+MappedFile::MappedFile() :
+    _data(nullptr),
+    _size(0),
+#ifdef _WIN32
+    _fileHandle(INVALID_HANDLE_VALUE),
+    _mappingHandle(nullptr) {
+
+#else
+    _fileDescriptor(-1) {
+
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& filename, const std::size_t numBytes) {
+    close();
+
+    _fileHandle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                              nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    const DWORD sizeHigh = static_cast<DWORD>(static_cast<unsigned long long>(numBytes) >> 32);
+    const DWORD sizeLow  = static_cast<DWORD>(numBytes & 0xFFFFFFFFull);
+
+    _mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READWRITE, sizeHigh, sizeLow, nullptr);
+    if (!_mappingHandle) {
+        close();
+
+        return false;
+    }
+
+    _data = MapViewOfFile(_mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, numBytes);
+    _size = numBytes;
+    if (!_data) {
+        close();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFile::openReadOnly(const std::string& filename) {
+    close();
+
+    _fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(_fileHandle, &fileSize);
+
+    _mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!_mappingHandle) {
+        close();
+
+        return false;
+    }
+
+    _data = MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    _size = static_cast<std::size_t>(fileSize.QuadPart);
+    if (!_data) {
+        close();
+
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::sync() {
+    if (_data) {
+        FlushViewOfFile(_data, _size);
+    }
+}
+
+void MappedFile::close() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mappingHandle) {
+        CloseHandle(_mappingHandle);
+    }
+    if (_fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(_fileHandle);
+    }
+
+    _data          = nullptr;
+    _size          = 0;
+    _mappingHandle = nullptr;
+    _fileHandle    = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const std::string& filename, const std::size_t numBytes) {
+    close();
+
+    _fileDescriptor = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fileDescriptor < 0) {
+        return false;
+    }
+
+    /*
+        Grow (zero filled) or shrink the file to the mapped size
+    */
+    struct stat fileStatus;
+    if (fstat(_fileDescriptor, &fileStatus) != 0 ||
+        (static_cast<std::size_t>(fileStatus.st_size) != numBytes &&
+         ftruncate(_fileDescriptor, static_cast<off_t>(numBytes)) != 0)) {
+
+        close();
+
+        return false;
+    }
+
+    void* data = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fileDescriptor, 0);
+    if (data == MAP_FAILED) {
+        close();
+
+        return false;
+    }
+
+    _data = data;
+    _size = numBytes;
+
+    return true;
+}
+
+bool MappedFile::openReadOnly(const std::string& filename) {
+    close();
+
+    _fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+    if (_fileDescriptor < 0) {
+        return false;
+    }
+
+    struct stat fileStatus;
+    if (fstat(_fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+        close();
+
+        return false;
+    }
+
+    const std::size_t numBytes = static_cast<std::size_t>(fileStatus.st_size);
+
+    void* data = mmap(nullptr, numBytes, PROT_READ, MAP_SHARED, _fileDescriptor, 0);
+    if (data == MAP_FAILED) {
+        close();
+
+        return false;
+    }
+
+    _data = data;
+    _size = numBytes;
+
+    return true;
+}
+
+void MappedFile::sync() {
+    if (_data) {
+        msync(_data, _size, MS_SYNC);
+    }
+}
+
+void MappedFile::close() {
+    if (_data) {
+        munmap(_data, _size);
+    }
+    if (_fileDescriptor >= 0) {
+        ::close(_fileDescriptor);
+    }
+
+    _data           = nullptr;
+    _size           = 0;
+    _fileDescriptor = -1;
+}
+
+#endif
+
+void* MappedFile::data() {
+    return _data;
+}
+
+const void* MappedFile::data() const {
+    return _data;
+}
+
+std::size_t MappedFile::size() const {
+    return _size;
+}
+
+bool MappedFile::isOpen() const {
+    return _data != nullptr;
+}
+
+} // namespace shdr
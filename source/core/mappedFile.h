@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace shdr {
+
+/*
+    MappedFile maps a file into memory, so that its content
+    can be read and written like a buffer and is persisted
+    by the operating system.
+*/
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator = (const MappedFile& other) = delete;
+
+    // Map numBytes of filename for reading and writing, the file is 
+    // created (zero filled) or resized when needed.
+    bool open(const std::string& filename, const std::size_t numBytes);
+
+    // Map the whole file read-only.
+    bool openReadOnly(const std::string& filename);
+
+    void sync();
+    void close();
+
+    void*       data();
+    const void* data() const;
+    std::size_t size() const;
+    bool        isOpen() const;
+
+private:
+    void*       _data;
+    std::size_t _size;
+
+#ifdef _WIN32
+    void* _fileHandle;
+    void* _mappingHandle;
+
+#else
+    int _fileDescriptor;
+
+#endif
+};
+
+} // namespace shdr
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "core/scratchArena.h"
+
+#include <opencv2/opencv.hpp>
+
+namespace shdr {
+
+/*
+    PipelineStage is the common base of all pipeline stages
+    (image aligner, crf solver and tone mapper).
+
+    It gives stages access to the scratch arena owned by 
+    the pipeline, temporaries fall back to plain allocations
+    when no arena is set.
+*/
+class PipelineStage {
+public:
+    PipelineStage();
+
+    void setScratchArena(ScratchArena* const scratchArena);
+
+protected:
+    cv::Mat _scratch(const int rows, const int cols, const int type) const;
+
+private:
+    ScratchArena* _scratchArena;
+};
+
+// header implementation
+
+inline PipelineStage::PipelineStage() :
+    _scratchArena(nullptr) {
+}
+
+inline void PipelineStage::setScratchArena(ScratchArena* const scratchArena) {
+    _scratchArena = scratchArena;
+}
+
+inline cv::Mat PipelineStage::_scratch(const int rows, const int cols, const int type) const {
+    if (!_scratchArena) {
+        return cv::Mat(rows, cols, type);
+    }
+
+    return _scratchArena->acquire(rows, cols, type);
+}
+
+} // namespace shdr
@@ -0,0 +1,200 @@
+#include "core/radianceAccumulator.h"
+
+#include "core/taskScheduler.h"
+#include "imageUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace shdr {
+
+const char RadianceAccumulator::MAGIC[8] = { 'S', 'H', 'D', 'R', 'A', 'C', 'C', '2' };
+
+RadianceAccumulator::RadianceAccumulator() :
+    _file(),
+    _memory(),
+    _header(nullptr),
+    _lnESum(),
+    _weightSum() {
+}
+
+void RadianceAccumulator::reset(const int width, const int height) {
+    _file.close();
+
+    const std::size_t numBytes = sizeof(Header) + 2 * sizeof(float) * 3 * width * height;
+
+    _memory = cv::Mat::zeros(1, static_cast<int>(numBytes), CV_8UC1);
+    _bindBuffers(_memory.data, width, height);
+
+    std::memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+    _header->width  = width;
+    _header->height = height;
+}
+
+bool RadianceAccumulator::open(const std::string& filename, const int width, const int height) {
+    _memory.release();
+
+    const std::size_t numBytes = sizeof(Header) + 2 * sizeof(float) * 3 * width * height;
+    if (!_file.open(filename, numBytes)) {
+        std::cout << "Accumulator file <" << filename << "> can't open !"
+                  << std::endl;
+
+        return false;
+    }
+
+    _bindBuffers(static_cast<unsigned char*>(_file.data()), width, height);
+
+    /*
+        Start from scratch if the file is new 
+        or belongs to another image size
+    */
+    if (std::memcmp(_header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        _header->width  != width ||
+        _header->height != height) {
+
+        std::memset(_file.data(), 0, numBytes);
+        std::memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+        _header->width  = width;
+        _header->height = height;
+    }
+    else {
+        std::cout << "    Resume accumulator with " << _header->numExposures << " exposures"
+                  << std::endl;
+    }
+
+    return true;
+}
+
+void RadianceAccumulator::sync() {
+    if (_file.isOpen()) {
+        _file.sync();
+    }
+}
+
+void RadianceAccumulator::radianceMap(const int             radianceType,
+                                      cv::Mat* const        out_hdri,
+                                      ToneStatistics* const out_statistics) const {
+
+    const int width  = _header->width;
+    const int height = _header->height;
+
+    cv::Mat hdri(height, width, radianceType);
+
+    // statistics describe the stored map, so they see its clamping
+    const float maxRadiance = imageUtils::maxRadiance(hdri.type());
+
+    ToneStatistics statistics;
+    std::mutex     statisticsMutex;
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        ToneStatistics         bandStatistics;
+        std::vector<cv::Vec3f> hdriRow(width);
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const cv::Vec3f* lnESumRow    = _lnESum.ptr<cv::Vec3f>(iy);
+            const cv::Vec3f* weightSumRow = _weightSum.ptr<cv::Vec3f>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                for (int c = 0; c < 3; ++c) {
+                    hdriRow[ix][c] = (weightSumRow[ix][c] > 0.0f) ? 
+                        std::exp(lnESumRow[ix][c] / weightSumRow[ix][c]) : 1.0f;
+                    hdriRow[ix][c] = std::min(hdriRow[ix][c], maxRadiance);
+                }
+
+                const float lw = ToneStatistics::luminance(hdriRow[ix][0], hdriRow[ix][1], hdriRow[ix][2]);
+                bandStatistics.addLogLuminance(std::log(lw + ToneStatistics::LUMINANCE_DELTA));
+            }
+
+            imageUtils::storeRadianceRow(&hdriRow[0][0], iy, &hdri);
+        }
+
+        std::lock_guard<std::mutex> lock(statisticsMutex);
+        statistics.combine(bandStatistics);
+    });
+
+    *out_hdri       = hdri;
+    *out_statistics = statistics;
+}
+
+int RadianceAccumulator::width() const {
+    return _header->width;
+}
+
+int RadianceAccumulator::height() const {
+    return _header->height;
+}
+
+int RadianceAccumulator::numExposures() const {
+    return _header->numExposures;
+}
+
+bool RadianceAccumulator::hasCrf() const {
+    return _header->hasCrf != 0;
+}
+
+cv::Mat RadianceAccumulator::crf() const {
+    return cv::Mat(256, 1, CV_32FC3, _header->crf).clone();
+}
+
+void RadianceAccumulator::setCrf(const cv::Mat&     crf,
+                                 const std::string& method,
+                                 const int          numCrfExposures) {
+
+    crf.copyTo(cv::Mat(256, 1, CV_32FC3, _header->crf));
+    _header->hasCrf          = 1;
+    _header->numCrfExposures = numCrfExposures;
+
+    std::memset(_header->crfMethod, 0, sizeof(_header->crfMethod));
+    std::strncpy(_header->crfMethod, method.c_str(), sizeof(_header->crfMethod) - 1);
+}
+
+std::string RadianceAccumulator::crfMethod() const {
+    return std::string(_header->crfMethod, strnlen(_header->crfMethod, sizeof(_header->crfMethod)));
+}
+
+int RadianceAccumulator::numCrfExposures() const {
+    return _header->numCrfExposures;
+}
+
+std::uint64_t RadianceAccumulator::exposureKey() const {
+    return _header->exposureKey;
+}
+
+void RadianceAccumulator::setExposureKey(const std::uint64_t key) {
+    _header->exposureKey = key;
+}
+
+void RadianceAccumulator::clear() {
+    const int width  = _header->width;
+    const int height = _header->height;
+
+    _lnESum.setTo(cv::Scalar::all(0.0));
+    _weightSum.setTo(cv::Scalar::all(0.0));
+
+    std::memset(_header, 0, sizeof(Header));
+    std::memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+    _header->width  = width;
+    _header->height = height;
+}
+
+cv::Mat& RadianceAccumulator::lnESum() {
+    return _lnESum;
+}
+
+cv::Mat& RadianceAccumulator::weightSum() {
+    return _weightSum;
+}
+
+void RadianceAccumulator::addExposure() {
+    _header->numExposures += 1;
+}
+
+void RadianceAccumulator::_bindBuffers(unsigned char* const data, const int width, const int height) {
+    const std::size_t planeBytes = sizeof(float) * 3 * width * height;
+
+    _header    = reinterpret_cast<Header*>(data);
+    _lnESum    = cv::Mat(height, width, CV_32FC3, data + sizeof(Header));
+    _weightSum = cv::Mat(height, width, CV_32FC3, data + sizeof(Header) + planeBytes);
+}
+
+} // namespace shdr
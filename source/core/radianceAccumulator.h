@@ -0,0 +1,93 @@
+#pragma once
+
+#include "core/mappedFile.h"
+#include "core/toneStatistics.h"
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace shdr {
+
+/*
+    RadianceAccumulator is the merge state of a radiance map,
+    i.e. the weighted log radiance sum and the weight sum of
+    each pixel and channel.
+
+    Exposures can be folded in one at a time as they arrive
+    (see CrfSolver::accumulate), and the current radiance map
+    can be produced at any time. The state, together with the
+    response curve it was accumulated with, can live in a
+    memory-mapped file so that a capture session can resume.
+    The file also records which method solved the curve and a
+    key of the exposures folded in, so that a resumed state can
+    be checked against the exposures it is resumed with.
+*/
+class RadianceAccumulator {
+public:
+    RadianceAccumulator();
+
+    // keep the state in memory
+    void reset(const int width, const int height);
+
+    // keep the state in a mapped file, an existing compatible state is resumed
+    bool open(const std::string& filename, const int width, const int height);
+
+    void sync();
+
+    void radianceMap(const int             radianceType,
+                     cv::Mat* const        out_hdri,
+                     ToneStatistics* const out_statistics) const;
+
+    int  width() const;
+    int  height() const;
+    int  numExposures() const;
+    bool hasCrf() const;
+
+    // log response curve (256x1 CV_32FC3) the state is accumulated with
+    cv::Mat crf() const;
+    void    setCrf(const cv::Mat&     crf, 
+                   const std::string& method, 
+                   const int          numCrfExposures);
+
+    // method that solved the curve and how many exposures it was solved from
+    std::string crfMethod() const;
+    int         numCrfExposures() const;
+
+    // key of the exposures folded in, maintained by the caller
+    std::uint64_t exposureKey() const;
+    void          setExposureKey(const std::uint64_t key);
+
+    // drop the curve and every folded exposure, keeping the size
+    void clear();
+
+    // per pixel state (CV_32FC3), used by the crf solver to fold an exposure in
+    cv::Mat& lnESum();
+    cv::Mat& weightSum();
+    void     addExposure();
+
+private:
+    struct Header {
+        char          magic[8];
+        int           width;
+        int           height;
+        int           numExposures;
+        int           hasCrf;
+        int           numCrfExposures;
+        char          crfMethod[32];
+        std::uint64_t exposureKey;
+        float         crf[256 * 3];
+    };
+
+    void _bindBuffers(unsigned char* const data, const int width, const int height);
+
+    static const char MAGIC[8];
+
+    MappedFile _file;
+    cv::Mat    _memory;
+    Header*    _header;
+    cv::Mat    _lnESum;
+    cv::Mat    _weightSum;
+};
+
+} // namespace shdr
@@ -0,0 +1,472 @@
+#include "core/regressionSuite.h"
+
+#include "core/crfSolver.h"
+#include "core/hdrSolver.h"
+#include "core/imageAligner.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/toneMapper.h"
+#include "core/toneStatistics.h"
+#include "imageUtils.h"
+#include "ioUtils.h"
+#include "mathUtils.h"
+#include "systemUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+#if (defined(_MSC_VER) || \
+     (defined(__GNUC__) && (__GNUC_MAJOR__ >= 8)))
+    #include <filesystem>
+    namespace std_fs = std::filesystem;
+#else
+    #include <experimental/filesystem>
+    namespace std_fs = std::experimental::filesystem;
+#endif
+
+namespace shdr {
+
+namespace {
+
+// quality gates
+constexpr double MIN_PSNR               = 35.0;
+constexpr double MIN_SSIM               = 0.97;
+constexpr double MAX_LOG_RADIANCE_ERROR = 0.05;
+
+// performance gates, budget * tolerance + slack
+constexpr double TIME_TOLERANCE   = 1.25;
+constexpr double TIME_SLACK_MS    = 20.0;
+constexpr double MEMORY_TOLERANCE = 1.15;
+constexpr double MEMORY_SLACK_MB  = 8.0;
+
+constexpr unsigned int RANDOM_SEED = 5489u;
+
+/*
+    Mean SSIM of the luminance of two 8-bit images,
+    with the usual 11x11 gaussian window (sigma 1.5)
+*/
+double structuralSimilarity(const cv::Mat& imageA, const cv::Mat& imageB) {
+    constexpr double C1 = (0.01 * 255.0) * (0.01 * 255.0);
+    constexpr double C2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+    cv::Mat grayA;
+    cv::Mat grayB;
+    cv::cvtColor(imageA, grayA, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(imageB, grayB, cv::COLOR_BGR2GRAY);
+
+    cv::Mat a;
+    cv::Mat b;
+    grayA.convertTo(a, CV_32FC1);
+    grayB.convertTo(b, CV_32FC1);
+
+    cv::Mat aa;
+    cv::Mat bb;
+    cv::Mat ab;
+    cv::multiply(a, a, aa);
+    cv::multiply(b, b, bb);
+    cv::multiply(a, b, ab);
+
+    const cv::Size window(11, 11);
+    cv::Mat muA;
+    cv::Mat muB;
+    cv::Mat muAA;
+    cv::Mat muBB;
+    cv::Mat muAB;
+    cv::GaussianBlur(a,  muA,  window, 1.5);
+    cv::GaussianBlur(b,  muB,  window, 1.5);
+    cv::GaussianBlur(aa, muAA, window, 1.5);
+    cv::GaussianBlur(bb, muBB, window, 1.5);
+    cv::GaussianBlur(ab, muAB, window, 1.5);
+
+    double ssimSum = 0.0;
+    for (int iy = 0; iy < a.rows; ++iy) {
+        const float* muARow  = muA.ptr<float>(iy);
+        const float* muBRow  = muB.ptr<float>(iy);
+        const float* muAARow = muAA.ptr<float>(iy);
+        const float* muBBRow = muBB.ptr<float>(iy);
+        const float* muABRow = muAB.ptr<float>(iy);
+        for (int ix = 0; ix < a.cols; ++ix) {
+            const double ma    = muARow[ix];
+            const double mb    = muBRow[ix];
+            const double varA  = muAARow[ix] - ma * ma;
+            const double varB  = muBBRow[ix] - mb * mb;
+            const double covAB = muABRow[ix] - ma * mb;
+
+            ssimSum += ((2.0 * ma * mb + C1) * (2.0 * covAB + C2)) /
+                       ((ma * ma + mb * mb + C1) * (varA + varB + C2));
+        }
+    }
+
+    return ssimSum / (static_cast<double>(a.rows) * a.cols);
+}
+
+/*
+    RMS difference of the log luminance of two radiance maps
+    after removing the mean difference, i.e. the error up to
+    the global scale a response curve is only known for
+*/
+double logRadianceError(const cv::Mat& hdriA, const cv::Mat& hdriB) {
+    const int width = hdriA.cols;
+
+    std::vector<cv::Vec3f> rowA(width);
+    std::vector<cv::Vec3f> rowB(width);
+
+    double sum       = 0.0;
+    double squareSum = 0.0;
+    for (int iy = 0; iy < hdriA.rows; ++iy) {
+        imageUtils::loadRadianceRow(hdriA, iy, &rowA[0][0]);
+        imageUtils::loadRadianceRow(hdriB, iy, &rowB[0][0]);
+
+        for (int ix = 0; ix < width; ++ix) {
+            const float lwA = ToneStatistics::luminance(rowA[ix][0], rowA[ix][1], rowA[ix][2]);
+            const float lwB = ToneStatistics::luminance(rowB[ix][0], rowB[ix][1], rowB[ix][2]);
+
+            const double difference = std::log(lwA + ToneStatistics::LUMINANCE_DELTA) -
+                                      std::log(lwB + ToneStatistics::LUMINANCE_DELTA);
+
+            sum       += difference;
+            squareSum += difference * difference;
+        }
+    }
+
+    const double numPixels = static_cast<double>(hdriA.rows) * width;
+    const double mean      = sum / numPixels;
+
+    return std::sqrt(std::max(squareSum / numPixels - mean * mean, 0.0));
+}
+
+double elapsedMilliseconds(const std::chrono::steady_clock::time_point& begin,
+                           const std::chrono::steady_clock::time_point& end) {
+
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+} // anonymous namespace
+
+RegressionSuite::RegressionSuite(const std::string& goldenDirectory) :
+    _goldenDirectory(goldenDirectory),
+    _scenes() {
+}
+
+bool RegressionSuite::addScene(const std::string& name,
+                               const std::string& imageDirectory,
+                               const std::string& shutterFilename) {
+
+    // readShutterSpeeds exits on a missing file, a missing scene is only skipped
+    FILE* f = fopen(shutterFilename.c_str(), "r");
+    if (!f) {
+        std::cout << "Regression scene <" << name << "> can't be read, skip it"
+                  << std::endl;
+
+        return false;
+    }
+    fclose(f);
+
+    Scene scene;
+    scene.name = name;
+    ioUtils::readShutterSpeeds(shutterFilename, &scene.shutterSpeeds);
+    ioUtils::readImages(imageDirectory, &scene.images);
+
+    if (scene.images.empty() || scene.images.size() != scene.shutterSpeeds.size()) {
+        std::cout << "Regression scene <" << name << "> has mismatched images, skip it"
+                  << std::endl;
+
+        return false;
+    }
+
+    _scenes.push_back(std::move(scene));
+
+    return true;
+}
+
+void RegressionSuite::addSyntheticScene(const std::string& name,
+                                        const int          width,
+                                        const int          height,
+                                        const int          numExposures) {
+
+    /*
+        Radiance spans four decades from left to right, modulated
+        by horizontal stripes for texture and a few bright discs,
+        each channel is tinted differently
+    */
+    cv::Mat radiance(height, width, CV_32FC3);
+    for (int iy = 0; iy < height; ++iy) {
+        cv::Vec3f* radianceRow = radiance.ptr<cv::Vec3f>(iy);
+        for (int ix = 0; ix < width; ++ix) {
+            const float ramp   = std::pow(10.0f, 4.0f * ix / width - 2.0f);
+            const float stripe = 0.6f + 0.4f * std::sin(mathUtils::TWO_PI * iy / 40.0f);
+
+            float value = ramp * stripe;
+            for (int disc = 0; disc < 3; ++disc) {
+                const float cx = width  * (0.25f + 0.25f * disc);
+                const float cy = height * 0.5f;
+                const float dx = ix - cx;
+                const float dy = iy - cy;
+                if (dx * dx + dy * dy < (height * 0.08f) * (height * 0.08f)) {
+                    value = 50.0f * (disc + 1);
+                }
+            }
+
+            radianceRow[ix] = cv::Vec3f(value * 0.6f, value * 0.8f, value);
+        }
+    }
+
+    /*
+        Exposures two stops apart through a gamma 2.2 response
+        with noise, shifted by a few pixels against each other
+    */
+    std::mt19937                          generator(RANDOM_SEED);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+    Scene scene;
+    scene.name = name;
+    for (int n = 0; n < numExposures; ++n) {
+        const float shutterSpeed = std::pow(4.0f, static_cast<float>(n - numExposures + 1));
+
+        cv::Mat image(height, width, CV_8UC3);
+        for (int iy = 0; iy < height; ++iy) {
+            const cv::Vec3f* radianceRow = radiance.ptr<cv::Vec3f>(iy);
+            cv::Vec3b*       imageRow    = image.ptr<cv::Vec3b>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                for (int c = 0; c < 3; ++c) {
+                    const float exposure = std::min(radianceRow[ix][c] * shutterSpeed, 1.0f);
+                    const float z        = 255.0f * std::pow(exposure, 1.0f / 2.2f) + noise(generator);
+
+                    imageRow[ix][c] = cv::saturate_cast<uchar>(z);
+                }
+            }
+        }
+
+        cv::Mat translation;
+        mathUtils::getTranslationMatrix(2 * n - numExposures, n - numExposures / 2, &translation);
+        cv::warpAffine(image, image, translation, image.size(), cv::INTER_NEAREST, cv::BORDER_REPLICATE);
+
+        scene.images.push_back(image);
+        scene.shutterSpeeds.push_back(shutterSpeed);
+    }
+
+    _scenes.push_back(std::move(scene));
+}
+
+int RegressionSuite::run(const bool isRecording) const {
+    std::cout << "# Begin to " << (isRecording ? "record" : "run") << " regression cases"
+              << std::endl;
+
+    std::error_code error;
+    std_fs::create_directories(_goldenDirectory, error);
+
+    const std::string budgetFilename = _goldenDirectory + "/budgets.json";
+    const std::string host           = systemUtils::hostName();
+
+    /*
+        Budgets are kept per host, since timings only compare
+        on the same machine. Recording replaces the section of
+        this host and keeps the others
+    */
+    JsonValue budgets = JsonValue::object();
+    {
+        std::ifstream     file(budgetFilename);
+        std::stringstream text;
+        text << file.rdbuf();
+
+        if (file && !JsonValue::parse(text.str(), &budgets)) {
+            std::cout << "Regression budgets can't be parsed: " << budgetFilename
+                      << std::endl;
+
+            budgets = JsonValue::object();
+        }
+    }
+
+    // null when nothing was recorded on this host
+    JsonValue hostBudgets = isRecording ? JsonValue::object() : JsonValue();
+    if (budgets.has(host)) {
+        hostBudgets = budgets[host];
+    }
+    else if (!isRecording) {
+        std::cout << "No regression budgets for host <" << host << ">, "
+                  << "time and memory are not checked, record them first"
+                  << std::endl;
+    }
+
+    int numCases    = 0;
+    int numFailures = 0;
+    for (const Scene& scene : _scenes) {
+        for (const std::string& imageAligner : StageFactory::imageAlignerMethods()) {
+            for (const std::string& crfSolver : StageFactory::crfSolverMethods()) {
+                for (const std::string& toneMapper : StageFactory::toneMapperMethods()) {
+                    if (!_runCase(scene, imageAligner, crfSolver, toneMapper, isRecording, &hostBudgets)) {
+                        ++numFailures;
+                    }
+                    ++numCases;
+                }
+            }
+        }
+    }
+
+    if (isRecording) {
+        budgets.set(host, hostBudgets);
+
+        std::ofstream file(budgetFilename);
+        file << budgets.dump() << std::endl;
+
+        if (!file) {
+            std::cout << "Regression budgets can't be written: " << budgetFilename
+                      << std::endl;
+
+            ++numFailures;
+        }
+    }
+
+    std::cout << "# Finish regression: " << numCases << " cases, "
+              << numFailures << " failed"
+              << std::endl;
+
+    return numFailures;
+}
+
+bool RegressionSuite::_runCase(const Scene&       scene,
+                               const std::string& imageAligner,
+                               const std::string& crfSolver,
+                               const std::string& toneMapper,
+                               const bool         isRecording,
+                               JsonValue* const   inout_budgets) const {
+
+    const std::string caseName         = scene.name + "_" + imageAligner + "_" + crfSolver + "_" + toneMapper;
+    const std::string ldriFilename     = _goldenDirectory + "/" + caseName + ".png";
+    const std::string radianceFilename = _goldenDirectory + "/" +
+                                         scene.name + "_" + imageAligner + "_" + crfSolver + ".hdr";
+
+    /*
+        Every case starts from the same random state and its own
+        scratch arena, the peak memory is measured from the
+        resident size at the start of the case
+    */
+    mathUtils::setSeed(RANDOM_SEED);
+
+    const bool        isPeakMeasured = systemUtils::resetPeakResidentBytes();
+    const std::size_t baselineBytes  = systemUtils::residentBytes();
+
+    const auto begin = std::chrono::steady_clock::now();
+
+    cv::Mat ldri;
+    cv::Mat crf;
+    cv::Mat radiance;
+    {
+        HdrSolver hdrSolver(scene.images,
+                            scene.shutterSpeeds,
+                            StageFactory::createImageAligner(imageAligner),
+                            StageFactory::createCrfSolver(crfSolver),
+                            StageFactory::createToneMapper(toneMapper),
+                            std::make_shared<ScratchArena>());
+
+        hdrSolver.solve(&ldri, &crf, &radiance);
+    }
+
+    const double milliseconds = elapsedMilliseconds(begin, std::chrono::steady_clock::now());
+    const std::size_t peakBytes = std::max(systemUtils::peakResidentBytes(), baselineBytes);
+    const double      peakMB    = isPeakMeasured ?
+        static_cast<double>(peakBytes - baselineBytes) / (1 << 20) : 0.0;
+
+    if (isRecording) {
+        cv::Mat radianceFloat;
+        radiance.convertTo(radianceFloat, CV_32FC3);
+
+        const bool isWritten = cv::imwrite(ldriFilename, ldri) &&
+                               cv::imwrite(radianceFilename, radianceFloat);
+
+        JsonValue budget = JsonValue::object();
+        budget.set("ms",     milliseconds);
+        budget.set("peakMB", peakMB);
+        inout_budgets->set(caseName, budget);
+
+        std::cout << "    " << caseName << ": " << milliseconds << " ms, "
+                  << peakMB << " MB" << (isWritten ? "" : ", golden can't be written")
+                  << std::endl;
+
+        return isWritten;
+    }
+
+    /*
+        Quality against the goldens
+    */
+    std::vector<std::string> failures;
+
+    const cv::Mat goldenLdri     = cv::imread(ldriFilename);
+    const cv::Mat goldenRadiance = cv::imread(radianceFilename, cv::IMREAD_UNCHANGED);
+
+    double psnr          = 0.0;
+    double ssim          = 0.0;
+    double radianceError = 0.0;
+    if (goldenLdri.empty() || goldenRadiance.empty() ||
+        goldenLdri.size() != ldri.size() || goldenRadiance.size() != radiance.size()) {
+
+        failures.push_back("no matching golden");
+    }
+    else {
+        psnr          = cv::PSNR(ldri, goldenLdri);
+        ssim          = structuralSimilarity(ldri, goldenLdri);
+        radianceError = logRadianceError(radiance, goldenRadiance);
+
+        if (psnr < MIN_PSNR) {
+            failures.push_back("PSNR");
+        }
+        if (ssim < MIN_SSIM) {
+            failures.push_back("SSIM");
+        }
+        if (radianceError > MAX_LOG_RADIANCE_ERROR) {
+            failures.push_back("radiance");
+        }
+    }
+
+    /*
+        Performance against the budgets
+    */
+    const JsonValue& budget       = (*inout_budgets)[caseName];
+    const double     budgetMs     = budget["ms"].asNumber(-1.0);
+    const double     budgetPeakMB = budget["peakMB"].asNumber(-1.0);
+    if (inout_budgets->isNull()) {
+        // nothing recorded on this host, run() already said so
+    }
+    else if (budgetMs < 0.0) {
+        failures.push_back("no budget");
+    }
+    else {
+        if (milliseconds > budgetMs * TIME_TOLERANCE + TIME_SLACK_MS) {
+            failures.push_back("time");
+        }
+        if (isPeakMeasured && budgetPeakMB >= 0.0 &&
+            peakMB > budgetPeakMB * MEMORY_TOLERANCE + MEMORY_SLACK_MB) {
+
+            failures.push_back("memory");
+        }
+    }
+
+    std::cout << "    " << caseName << ": "
+              << "PSNR " << psnr << " dB, SSIM " << ssim
+              << ", radiance " << radianceError << ", "
+              << milliseconds << " ms (budget " << budgetMs << "), "
+              << peakMB << " MB (budget " << budgetPeakMB << ")";
+
+    if (failures.empty()) {
+        std::cout << " ok" << std::endl;
+
+        return true;
+    }
+
+    std::cout << " FAILED:";
+    for (const std::string& failure : failures) {
+        std::cout << " " << failure;
+    }
+    std::cout << std::endl;
+
+    return false;
+}
+
+} // namespace shdr
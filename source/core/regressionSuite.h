@@ -0,0 +1,65 @@
+#pragma once
+
+#include "jsonValue.h"
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    RegressionSuite runs the whole HdrSolver pipeline for every
+    combination of image aligner, crf solver and tone mapper on
+    captured scenes and on synthetic brackets, and checks each
+    run against what was recorded in the golden directory:
+
+        quality:     PSNR and SSIM of the tone mapped image,
+                     log radiance error of the radiance map
+        performance: wall time and peak resident memory
+
+    Recording writes the golden images and the budgets
+    (budgets.json) instead. Budgets are kept per host name,
+    a host without any is only checked for quality. Runs use
+    a fixed random seed, so sampling based stages are
+    reproducible.
+*/
+class RegressionSuite {
+public:
+    explicit RegressionSuite(const std::string& goldenDirectory);
+
+    // returns false if the scene can't be read
+    bool addScene(const std::string& name,
+                  const std::string& imageDirectory,
+                  const std::string& shutterFilename);
+
+    // bracket of a known radiance map with a gamma response,
+    // noise and small shifts between exposures
+    void addSyntheticScene(const std::string& name,
+                           const int          width,
+                           const int          height,
+                           const int          numExposures);
+
+    // returns the number of failed cases
+    int run(const bool isRecording) const;
+
+private:
+    struct Scene {
+        std::string          name;
+        std::vector<cv::Mat> images;
+        std::vector<float>   shutterSpeeds;
+    };
+
+    // returns false if the case failed
+    bool _runCase(const Scene&       scene,
+                  const std::string& imageAligner,
+                  const std::string& crfSolver,
+                  const std::string& toneMapper,
+                  const bool         isRecording,
+                  JsonValue* const   inout_budgets) const;
+
+    std::string        _goldenDirectory;
+    std::vector<Scene> _scenes;
+};
+
+} // namespace shdr
@@ -0,0 +1,134 @@
+#include "core/scratchArena.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+
+namespace shdr {
+
+ScratchArena::ScratchArena(const std::size_t capacityBytes) :
+    _mutex(),
+    _buffers(),
+    _capacityBytes(capacityBytes),
+    _highWaterBytes(0),
+    _useClock(0) {
+}
+
+cv::Mat ScratchArena::acquire(const int rows, const int cols, const int type) {
+    cv::Mat result;
+    bool    isAllocated = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        /*
+            Reuse a free buffer of the same shape if there is one,
+            otherwise allocate a new one and keep it in the arena,
+            free buffers beyond the capacity are released then
+        */
+        std::size_t inUseBytes = 0;
+        for (Buffer& buffer : _buffers) {
+            if (_isInUse(buffer.mat)) {
+                inUseBytes += _numBytes(buffer.mat);
+            }
+            else if (result.empty()         &&
+                     buffer.mat.rows == rows &&
+                     buffer.mat.cols == cols &&
+                     buffer.mat.type() == type) {
+
+                result          = buffer.mat;
+                buffer.lastUsed = ++_useClock;
+            }
+        }
+
+        if (result.empty()) {
+            result      = cv::Mat(rows, cols, type);
+            isAllocated = true;
+            _buffers.push_back({ result, ++_useClock });
+
+            _evict(_capacityBytes);
+        }
+
+        inUseBytes     += _numBytes(result);
+        _highWaterBytes = std::max(_highWaterBytes, inUseBytes);
+    }
+
+    /*
+        On NUMA hosts a new buffer is first touched in the row
+        bands of parallelRows, so each band's pages land on the
+        node that processes the band (outside the lock, helping
+        threads may acquire buffers themselves)
+    */
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    if (isAllocated && scheduler.numNodes() > 1) {
+        scheduler.parallelRows(rows, [&result](const int rowBegin, const int rowEnd) {
+            result.rowRange(rowBegin, rowEnd).setTo(cv::Scalar::all(0));
+        });
+    }
+
+    return result;
+}
+
+void ScratchArena::trim(const std::size_t maxReservedBytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _evict(maxReservedBytes);
+}
+
+std::size_t ScratchArena::highWaterBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _highWaterBytes;
+}
+
+std::size_t ScratchArena::reservedBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::size_t numBytes = 0;
+    for (const Buffer& buffer : _buffers) {
+        numBytes += _numBytes(buffer.mat);
+    }
+
+    return numBytes;
+}
+
+void ScratchArena::_evict(const std::size_t maxReservedBytes) {
+    std::size_t numBytes = 0;
+    for (const Buffer& buffer : _buffers) {
+        numBytes += _numBytes(buffer.mat);
+    }
+
+    if (numBytes <= maxReservedBytes) {
+        return;
+    }
+
+    // oldest first, buffers in use are skipped
+    std::sort(_buffers.begin(), _buffers.end(), [](const Buffer& a, const Buffer& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+
+    for (Buffer& buffer : _buffers) {
+        if (numBytes <= maxReservedBytes) {
+            break;
+        }
+
+        if (!_isInUse(buffer.mat)) {
+            numBytes -= _numBytes(buffer.mat);
+            buffer.mat.release();
+        }
+    }
+
+    _buffers.erase(std::remove_if(_buffers.begin(), _buffers.end(),
+                                  [](const Buffer& buffer) { return buffer.mat.empty(); }),
+                   _buffers.end());
+}
+
+bool ScratchArena::_isInUse(const cv::Mat& buffer) {
+    // the arena itself holds one reference
+    return buffer.u->refcount > 1;
+}
+
+std::size_t ScratchArena::_numBytes(const cv::Mat& buffer) {
+    return buffer.total() * buffer.elemSize();
+}
+
+} // namespace shdr
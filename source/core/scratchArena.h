@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ScratchArena hands out reusable image buffers by size
+    and type, so that full size temporaries are recycled 
+    between pipeline stages and between jobs instead of
+    being allocated (and page-faulted) again every time.
+
+    A buffer is in use as long as any cv::Mat handed out 
+    still references it, dropping the last reference returns
+    it to the arena. Buffers come from OpenCV's allocator, 
+    so their data is aligned to CV_MALLOC_ALIGN bytes.
+
+    The bytes the arena owns are capped: when a new buffer
+    takes it over the capacity, the least recently used free
+    buffers are released, buffers in use are never released.
+    So a long running process seeing many image sizes stays
+    bounded, e.g. the job server.
+
+    New buffers are first touched in row bands on NUMA hosts,
+    see TaskScheduler. Content of an acquired buffer is undefined.
+*/
+class ScratchArena {
+public:
+    explicit ScratchArena(const std::size_t capacityBytes = DEFAULT_CAPACITY_BYTES);
+
+    cv::Mat acquire(const int rows, const int cols, const int type);
+
+    // release the least recently used free buffers
+    // until the arena owns at most maxReservedBytes
+    void trim(const std::size_t maxReservedBytes = 0);
+
+    // largest number of bytes in use at the same time
+    std::size_t highWaterBytes() const;
+
+    // number of bytes owned by the arena
+    std::size_t reservedBytes() const;
+
+    static constexpr std::size_t DEFAULT_CAPACITY_BYTES = std::size_t(2) << 30;
+
+private:
+    struct Buffer {
+        cv::Mat       mat;
+        std::uint64_t lastUsed;
+    };
+
+    // expects the lock to be held
+    void _evict(const std::size_t maxReservedBytes);
+
+    static bool _isInUse(const cv::Mat& buffer);
+    static std::size_t _numBytes(const cv::Mat& buffer);
+
+    mutable std::mutex  _mutex;
+    std::vector<Buffer> _buffers;
+    std::size_t         _capacityBytes;
+    std::size_t         _highWaterBytes;
+    std::uint64_t       _useClock;
+};
+
+} // namespace shdr
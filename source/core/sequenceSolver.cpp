@@ -0,0 +1,138 @@
+#include "core/sequenceSolver.h"
+
+#include "core/crfSolver.h"
+#include "core/imageAligner.h"
+#include "core/imageWriter.h"
+#include "core/scratchArena.h"
+#include "core/stageFactory.h"
+#include "core/toneMapper.h"
+#include "core/toneStatistics.h"
+#include "ioUtils.h"
+
+#include <cstdio>
+#include <iostream>
+
+namespace shdr {
+
+SequenceSolver::SequenceSolver(const std::string& sequenceDirectory,
+                               const std::string& shutterFilename,
+                               const std::string& imageAligner,
+                               const std::string& crfSolver,
+                               const std::string& toneMapper,
+                               const float        adaptationRate) :
+    _frameDirectories(),
+    _shutterSpeeds(),
+    _adaptationRate(adaptationRate),
+    _imageAligner(nullptr),
+    _crfSolver(nullptr),
+    _toneMapper(nullptr),
+    _imageWriter(std::make_unique<ImageWriter>()),
+    _scratchArena(std::make_unique<ScratchArena>()) {
+
+    _imageAligner = StageFactory::createImageAligner(imageAligner);
+    _crfSolver    = StageFactory::createCrfSolver(crfSolver);
+    _toneMapper   = StageFactory::createToneMapper(toneMapper);
+
+    // all stages share the scratch arena, so buffers are recycled between frames
+    _imageAligner->setScratchArena(_scratchArena.get());
+    _crfSolver->setScratchArena(_scratchArena.get());
+    _toneMapper->setScratchArena(_scratchArena.get());
+
+    // all frames share the same bracket
+    ioUtils::readShutterSpeeds(shutterFilename, &_shutterSpeeds);
+    ioUtils::listSubdirectories(sequenceDirectory, &_frameDirectories);
+
+    std::cout << "# Found " << _frameDirectories.size() << " frames"
+              << std::endl;
+}
+
+SequenceSolver::~SequenceSolver() = default;
+
+void SequenceSolver::setHalfPrecision(const bool isHalfPrecision) {
+    _crfSolver->setHalfPrecision(isHalfPrecision);
+}
+
+void SequenceSolver::setToneCurveFiles(const std::string& importFilename,
+                                       const std::string& exportFilename) {
+
+    _toneMapper->setToneCurveFiles(importFilename, exportFilename);
+}
+
+void SequenceSolver::setImageWriter(const ImageWriter& imageWriter) {
+    *_imageWriter = imageWriter;
+}
+
+void SequenceSolver::solve(const std::string& outputDirectory) const {
+    ImageWriter frameWriter(*_imageWriter);
+    const std::string format = frameWriter.format();
+
+    cv::Mat                crf;
+    std::vector<cv::Point> offsets;
+    ToneStatistics         smoothedStatistics;
+    bool                   hasStatistics = false;
+
+    const int numFrames = static_cast<int>(_frameDirectories.size());
+    for (int frame = 0; frame < numFrames; ++frame) {
+        std::cout << "# Begin to process frame " << (frame + 1) << " / " << numFrames
+                  << std::endl;
+
+        /*
+            Only the current bracket set is kept in memory,
+            each buffer is dropped as soon as it is consumed
+        */
+        std::vector<cv::Mat> images;
+        ioUtils::readImages(_frameDirectories[frame], &images);
+        if (images.size() != _shutterSpeeds.size()) {
+            std::cout << "    Frame " << (frame + 1) << " has " << images.size()
+                      << " images but " << _shutterSpeeds.size() << " shutter speeds, skip it"
+                      << std::endl;
+
+            continue;
+        }
+
+        std::vector<cv::Mat> alignImages;
+        _imageAligner->align(images, &alignImages, &offsets);
+        images.clear();
+
+        /*
+            Response curve is a property of the camera,
+            solve it on the first frame only
+        */
+        if (crf.empty()) {
+            _crfSolver->solveCrf(alignImages, _shutterSpeeds, &crf);
+        }
+
+        cv::Mat        hdri;
+        ToneStatistics statistics;
+        _crfSolver->merge(alignImages, _shutterSpeeds, crf, &hdri, &statistics);
+        alignImages.clear();
+
+        if (!hasStatistics) {
+            smoothedStatistics = statistics;
+            hasStatistics      = true;
+        }
+        else {
+            smoothedStatistics.blend(statistics, _adaptationRate);
+        }
+        // every frame, the first one included, uses the smoothed range
+        smoothedStatistics.setSmoothed(true);
+
+        cv::Mat ldri;
+        _toneMapper->map(hdri, smoothedStatistics, &ldri);
+        hdri.release();
+
+        char filename[64];
+        snprintf(filename, sizeof(filename), "frame_%05d.%s", frame, format.c_str());
+        frameWriter.setPath(outputDirectory + "/" + filename);
+        frameWriter.write(ldri);
+
+        std::cout << "# Finish frame " << (frame + 1) << ": " << filename
+                  << std::endl;
+    }
+
+    std::cout << "# Scratch arena high-water usage: "
+              << (_scratchArena->highWaterBytes() >> 20) << " MB"
+              << std::endl;
+}
+
+} // namespace shdr
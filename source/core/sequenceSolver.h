@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+class CrfSolver;
+class ImageAligner;
+class ImageWriter;
+class ScratchArena;
+class ToneMapper;
+
+/*
+    SequenceSolver is used for video / time-lapse HDR,
+    where each frame is one bracket set stored in its own
+    subdirectory and all frames share the same shutter speeds.
+
+    Frames are streamed one at a time, so only one bracket
+    set is resident in memory. The camera response function
+    is solved once and reused for the whole sequence, alignment
+    is warm-started from the previous frame's offsets, and
+    global tone mapping statistics are taken from the merge
+    and smoothed over time to avoid flickering.
+*/
+class SequenceSolver {
+public:
+    SequenceSolver(const std::string& sequenceDirectory,
+                   const std::string& shutterFilename,
+                   const std::string& imageAligner   = "mtb",
+                   const std::string& crfSolver      = "debevec",
+                   const std::string& toneMapper     = "bilateral",
+                   const float        adaptationRate = 0.2f);
+    ~SequenceSolver();
+
+    void solve(const std::string& outputDirectory) const;
+
+    // store the radiance map in half precision
+    void setHalfPrecision(const bool isHalfPrecision);
+
+    // tone curve files of global tone mappers, see ToneMapper
+    void setToneCurveFiles(const std::string& importFilename,
+                           const std::string& exportFilename);
+
+    // format settings of the frames, the path is replaced by
+    // frame_<number>.<format> in the output directory
+    void setImageWriter(const ImageWriter& imageWriter);
+
+private:
+    std::vector<std::string> _frameDirectories;
+    std::vector<float>       _shutterSpeeds;
+    float                    _adaptationRate;
+
+    std::unique_ptr<ImageAligner> _imageAligner;
+    std::unique_ptr<CrfSolver>    _crfSolver;
+    std::unique_ptr<ToneMapper>   _toneMapper;
+    std::unique_ptr<ImageWriter>  _imageWriter;
+
+    // temporaries of all stages are recycled between runs
+    std::unique_ptr<ScratchArena> _scratchArena;
+};
+
+} // namespace shdr
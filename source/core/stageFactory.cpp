@@ -0,0 +1,86 @@
+#include "core/stageFactory.h"
+
+#include "crfSolver/debevecCrfSolver.h"
+#include "crfSolver/mitsunagaNayarCrfSolver.h"
+#include "imageAligner/mtbImageAligner.h"
+#include "toneMapper/bilateralToneMapper.h"
+#include "toneMapper/gradientDomainToneMapper.h"
+#include "toneMapper/localLaplacianToneMapper.h"
+#include "toneMapper/photographicGlobalToneMapper.h"
+#include "toneMapper/photographicLocalToneMapper.h"
+
+#include <iostream>
+
+namespace shdr {
+
+std::unique_ptr<ImageAligner> StageFactory::createImageAligner(const std::string& method) {
+    if (method == "mtb") {
+        return std::make_unique<MtbImageAligner>();
+    }
+    else {
+        std::cout << "Unknown imageAligner type: <"
+                  << method << ">, use <mtb> instead"
+                  << std::endl;
+
+        return std::make_unique<MtbImageAligner>();
+    }
+}
+
+std::unique_ptr<CrfSolver> StageFactory::createCrfSolver(const std::string& method) {
+    if (method == "debevec") {
+        return std::make_unique<DebevecCrfSolver>(DwfType::D_GAUSSIAN, 50, 40.0f);
+    }
+    else if (method == "mitsunaga-nayar") {
+        return std::make_unique<MitsunagaNayarCrfSolver>();
+    }
+    else {
+        std::cout << "Unknown crfSolver type: <"
+                  << method << ">, use <debevec> instead"
+                  << std::endl;
+
+        return std::make_unique<DebevecCrfSolver>(DwfType::D_GAUSSIAN, 50, 40.0f);
+    }
+}
+
+std::unique_ptr<ToneMapper> StageFactory::createToneMapper(const std::string& method) {
+    if (method == "photographic-global") {
+        return std::make_unique<PhotographicGlobalToneMapper>();
+    }
+    else if (method == "photographic-local") {
+        return std::make_unique<PhotographicLocalToneMapper>();
+    }
+    else if (method == "bilateral") {
+        return std::make_unique<BilateralToneMapper>();
+    }
+    else if (method == "local-laplacian") {
+        return std::make_unique<LocalLaplacianToneMapper>();
+    }
+    else if (method == "gradient-domain") {
+        return std::make_unique<GradientDomainToneMapper>();
+    }
+    else {
+        std::cout << "Unknown toneMapper type: <"
+                  << method << ">, use <bilateral> instead"
+                  << std::endl;
+
+        return std::make_unique<BilateralToneMapper>();
+    }
+}
+
+std::vector<std::string> StageFactory::imageAlignerMethods() {
+    return { "mtb" };
+}
+
+std::vector<std::string> StageFactory::crfSolverMethods() {
+    return { "debevec", "mitsunaga-nayar" };
+}
+
+std::vector<std::string> StageFactory::toneMapperMethods() {
+    return { "photographic-global", 
+             "photographic-local", 
+             "bilateral", 
+             "local-laplacian", 
+             "gradient-domain" };
+}
+
+} // namespace shdr
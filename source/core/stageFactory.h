@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+class CrfSolver;
+class ImageAligner;
+class ToneMapper;
+
+/*
+    StageFactory creates pipeline stages from the method
+    names used on the command line, so that every solver
+    (single image set, sequence, ...) selects them the same way.
+*/
+class StageFactory {
+public:
+    static std::unique_ptr<ImageAligner> createImageAligner(const std::string& method);
+    static std::unique_ptr<CrfSolver>    createCrfSolver(const std::string& method);
+    static std::unique_ptr<ToneMapper>   createToneMapper(const std::string& method);
+
+    // every method name the factories know
+    static std::vector<std::string> imageAlignerMethods();
+    static std::vector<std::string> crfSolverMethods();
+    static std::vector<std::string> toneMapperMethods();
+};
+
+} // namespace shdr
@@ -0,0 +1,559 @@
+#include "core/taskScheduler.h"
+
+#include "systemUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <opencv2/opencv.hpp>
+
+namespace shdr {
+
+namespace {
+
+// queue index of the current thread, -1 for threads outside the pool
+thread_local int t_queueIndex = -1;
+
+std::mutex                     s_instanceMutex;
+std::unique_ptr<TaskScheduler> s_instance;
+int                            s_numThreads  = 0;
+int                            s_rowBandSize = 0;
+
+// 0 where a stage isn't tuned for a resolution class
+std::atomic<int> s_stageRowBandSizes[TaskScheduler::NUM_STAGE_TYPES][TaskScheduler::NUM_RESOLUTION_CLASSES];
+
+} // anonymous namespace
+
+thread_local const TaskScheduler::TaskGroup* TaskScheduler::_currentGroup     = nullptr;
+thread_local int                             TaskScheduler::_stageRowBandSize = 0;
+
+TaskScheduler::TaskScheduler(const int numThreads) :
+    _numThreads(numThreads),
+    _rowBandSize((s_rowBandSize > 0) ? s_rowBandSize : DEFAULT_ROW_BAND_SIZE),
+    _queues(),
+    _workers(),
+    _nodeCpus(),
+    _nodeQueues(),
+    _stealOrders(),
+    _sleepMutex(),
+    _sleepCondition(),
+    _numPending(0),
+    _isStopping(false) {
+
+    // the calling thread also runs tasks while it waits
+    const int numWorkers = numThreads - 1;
+    const int numQueues  = numWorkers + 1;
+    for (int i = 0; i < numQueues; ++i) {
+        _queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    /*
+        Workers are split into contiguous groups, one per node,
+        a node without a worker is not used
+    */
+    systemUtils::numaNodes(&_nodeCpus);
+    const int numNodes = std::max(1, std::min(static_cast<int>(_nodeCpus.size()), numWorkers));
+    _nodeCpus.resize(numNodes);
+    _nodeQueues.resize(numNodes);
+    for (int i = 0; i < numWorkers; ++i) {
+        _nodeQueues[i * numNodes / numWorkers].push_back(i);
+    }
+
+    // own queue, then the own node's queues, then every other queue
+    _stealOrders.resize(numQueues);
+    for (int node = 0; node < numNodes; ++node) {
+        const std::vector<int>& nodeQueues = _nodeQueues[node];
+        for (std::size_t i = 0; i < nodeQueues.size(); ++i) {
+            std::vector<int>& order = _stealOrders[nodeQueues[i]];
+            for (std::size_t j = 0; j < nodeQueues.size(); ++j) {
+                order.push_back(nodeQueues[(i + j) % nodeQueues.size()]);
+            }
+            for (int k = 1; k < numQueues; ++k) {
+                const int queueIndex = (nodeQueues[i] + k) % numQueues;
+                if (std::find(order.begin(), order.end(), queueIndex) == order.end()) {
+                    order.push_back(queueIndex);
+                }
+            }
+        }
+    }
+    for (int k = 0; k < numQueues; ++k) {
+        _stealOrders[numQueues - 1].push_back((numQueues - 1 + k) % numQueues);
+    }
+
+    for (int i = 0; i < numWorkers; ++i) {
+        _workers.emplace_back(&TaskScheduler::_workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _isStopping = true;
+    }
+    _sleepCondition.notify_all();
+
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    std::lock_guard<std::mutex> lock(s_instanceMutex);
+
+    if (!s_instance) {
+        const int numThreads = (s_numThreads > 0) ? 
+            s_numThreads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        // all parallelism goes through the pool
+        cv::setNumThreads(0);
+
+        s_instance.reset(new TaskScheduler(numThreads));
+    }
+
+    return *s_instance;
+}
+
+void TaskScheduler::setNumThreads(const int numThreads) {
+    std::lock_guard<std::mutex> lock(s_instanceMutex);
+
+    s_numThreads = numThreads;
+    s_instance.reset();
+}
+
+void TaskScheduler::setRowBandSize(const int rowBandSize) {
+    std::lock_guard<std::mutex> lock(s_instanceMutex);
+
+    s_rowBandSize = rowBandSize;
+    if (s_instance) {
+        s_instance->_rowBandSize.store((rowBandSize > 0) ? rowBandSize : DEFAULT_ROW_BAND_SIZE);
+    }
+}
+
+void TaskScheduler::setStageRowBandSize(const StageType stage,
+                                        const int       resolutionClass,
+                                        const int       rowBandSize) {
+
+    s_stageRowBandSizes[static_cast<int>(stage)][resolutionClass].store(std::max(rowBandSize, 0));
+}
+
+int TaskScheduler::stageRowBandSize(const StageType stage, const int resolutionClass) {
+    return s_stageRowBandSizes[static_cast<int>(stage)][resolutionClass].load();
+}
+
+int TaskScheduler::resolutionClass(const int width, const int height) {
+    const double megapixels = static_cast<double>(width) * height / 1e6;
+
+    int resolutionClass = 0;
+    for (double limit = 1.0; megapixels > limit && resolutionClass < NUM_RESOLUTION_CLASSES - 1; limit *= 4.0) {
+        ++resolutionClass;
+    }
+
+    return resolutionClass;
+}
+
+int TaskScheduler::numThreads() const {
+    return _numThreads;
+}
+
+int TaskScheduler::rowBandSize() const {
+    return (_stageRowBandSize > 0) ? _stageRowBandSize : _rowBandSize.load();
+}
+
+int TaskScheduler::numNodes() const {
+    return static_cast<int>(_nodeQueues.size());
+}
+
+void TaskScheduler::parallelFor(const int                            begin,
+                                const int                            end,
+                                const int                            grain,
+                                const std::function<void(int, int)>& body) {
+
+    if (end - begin <= grain || _numThreads == 1) {
+        body(begin, end);
+
+        return;
+    }
+
+    const int numChunks = (end - begin + grain - 1) / grain;
+    TaskGroup group(numChunks);
+    for (int chunk = 0; chunk < numChunks; ++chunk) {
+        const int chunkBegin = begin + chunk * grain;
+        const int chunkEnd   = std::min(chunkBegin + grain, end);
+
+        _submit([&body, &group, chunkBegin, chunkEnd]() {
+            TaskFinisher finisher(group);
+            _runTask(group, [&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); });
+        }, &group);
+    }
+
+    _waitUntilDone(group);
+}
+
+void TaskScheduler::parallelRows(const int                            numRows,
+                                 const std::function<void(int, int)>& body) {
+
+    // read once, the band size may be changed by another thread meanwhile
+    const int rowBandSize = this->rowBandSize();
+
+    const int numNodes = this->numNodes();
+    if (numNodes == 1 || numRows <= rowBandSize) {
+        parallelFor(0, numRows, rowBandSize, body);
+
+        return;
+    }
+
+    /*
+        Band b of an image always goes to node b * numNodes / numBands,
+        and to the workers of that node in turn
+    */
+    const int numBands = (numRows + rowBandSize - 1) / rowBandSize;
+    TaskGroup group(numBands);
+    for (int band = 0; band < numBands; ++band) {
+        const int bandBegin = band * rowBandSize;
+        const int bandEnd   = std::min(bandBegin + rowBandSize, numRows);
+
+        const std::vector<int>& nodeQueues = _nodeQueues[band * numNodes / numBands];
+        const int               queueIndex = nodeQueues[band % nodeQueues.size()];
+
+        _submitTo(queueIndex, [&body, &group, bandBegin, bandEnd]() {
+            TaskFinisher finisher(group);
+            _runTask(group, [&body, bandBegin, bandEnd]() { body(bandBegin, bandEnd); });
+        }, &group);
+    }
+
+    _waitUntilDone(group);
+}
+
+void TaskScheduler::reportNodeBandwidth() const {
+    constexpr std::size_t NUM_WORDS = (std::size_t(128) << 20) / sizeof(std::uint64_t);
+
+    const int numNodes = this->numNodes();
+
+    std::cout << "# NUMA read bandwidth in GB/s over " << numNodes << " node(s), "
+              << "rows: cpus of node, columns: memory of node"
+              << std::endl;
+
+    std::atomic<std::uint64_t> sink(0);
+    for (int cpuNode = 0; cpuNode < numNodes; ++cpuNode) {
+        std::cout << "    node " << cpuNode << ":";
+
+        for (int memoryNode = 0; memoryNode < numNodes; ++memoryNode) {
+            // left uninitialized so that the pages are first touched on memoryNode
+            std::unique_ptr<std::uint64_t[]> words(new std::uint64_t[NUM_WORDS]);
+            std::thread toucher([&]() {
+                systemUtils::pinCurrentThread(_nodeCpus[memoryNode]);
+                std::fill(words.get(), words.get() + NUM_WORDS, std::uint64_t(1));
+            });
+            toucher.join();
+
+            const int numReaders = std::max(1, static_cast<int>(_nodeQueues[cpuNode].size()));
+
+            const auto begin = std::chrono::steady_clock::now();
+
+            std::vector<std::thread> readers;
+            for (int r = 0; r < numReaders; ++r) {
+                readers.emplace_back([&, r]() {
+                    systemUtils::pinCurrentThread(_nodeCpus[cpuNode]);
+
+                    const std::size_t wordBegin = NUM_WORDS * r / numReaders;
+                    const std::size_t wordEnd   = NUM_WORDS * (r + 1) / numReaders;
+
+                    std::uint64_t sum = 0;
+                    for (std::size_t i = wordBegin; i < wordEnd; ++i) {
+                        sum += words[i];
+                    }
+                    sink.fetch_add(sum);
+                });
+            }
+            for (std::thread& reader : readers) {
+                reader.join();
+            }
+
+            const double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+
+            std::cout << " " << std::fixed << std::setprecision(1)
+                      << (NUM_WORDS * sizeof(std::uint64_t)) / seconds / 1e9;
+        }
+
+        std::cout << std::defaultfloat << std::endl;
+    }
+}
+
+TaskScheduler::TaskGroup::TaskGroup(const int numTasks) :
+    parent(_currentGroup),
+    stageRowBandSize(_stageRowBandSize),
+    isFailed(false),
+    mutex(),
+    condition(),
+    numRemaining(numTasks),
+    numWakeups(0),
+    exception() {
+}
+
+void TaskScheduler::TaskGroup::finishTask() {
+    // notified under the lock, the waiter may destroy the group once it has it
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--numRemaining == 0) {
+        ++numWakeups;
+        condition.notify_all();
+    }
+}
+
+void TaskScheduler::TaskGroup::fail(std::exception_ptr exception) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!this->exception) {
+        this->exception = std::move(exception);
+    }
+    isFailed.store(true);
+}
+
+void TaskScheduler::TaskGroup::notify() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++numWakeups;
+    condition.notify_all();
+}
+
+TaskScheduler::StageScope::StageScope(const StageType stage, const int width, const int height) :
+    _outerRowBandSize(_stageRowBandSize) {
+
+    const int rowBandSize = stageRowBandSize(stage, resolutionClass(width, height));
+    if (rowBandSize > 0) {
+        _stageRowBandSize = rowBandSize;
+    }
+}
+
+TaskScheduler::StageScope::~StageScope() {
+    _stageRowBandSize = _outerRowBandSize;
+}
+
+void TaskScheduler::_submit(std::function<void()> work, TaskGroup* const group) {
+    const int queueIndex = (t_queueIndex >= 0) ? 
+        t_queueIndex : static_cast<int>(_queues.size()) - 1;
+
+    _submitTo(queueIndex, std::move(work), group);
+}
+
+void TaskScheduler::_submitTo(const int             queueIndex, 
+                              std::function<void()> work, 
+                              TaskGroup* const      group) {
+    {
+        std::lock_guard<std::mutex> lock(_queues[queueIndex]->mutex);
+        _queues[queueIndex]->tasks.push_back({ std::move(work), group });
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        ++_numPending;
+    }
+    _sleepCondition.notify_one();
+
+    // the waiter of the group may be the only thread to run it
+    group->notify();
+}
+
+TaskScheduler::TaskFinisher::TaskFinisher(TaskGroup& group) :
+    group(group) {
+}
+
+TaskScheduler::TaskFinisher::~TaskFinisher() {
+    group.finishTask();
+}
+
+void TaskScheduler::_runTask(TaskGroup& group, const std::function<void()>& work) {
+    if (group.isFailed.load()) {
+        return;
+    }
+
+    try {
+        work();
+    }
+    catch (...) {
+        group.fail(std::current_exception());
+    }
+}
+
+bool TaskScheduler::_tryRunOne(const TaskGroup* const group) {
+    const int numQueues  = static_cast<int>(_queues.size());
+    const int queueIndex = (t_queueIndex >= 0) ? t_queueIndex : numQueues - 1;
+
+    // a task may run if it belongs to group or to a group nested in it
+    const auto isHelpable = [group](const Task& task) {
+        for (const TaskGroup* ancestor = task.group; ancestor; ancestor = ancestor->parent) {
+            if (ancestor == group) {
+                return true;
+            }
+        }
+
+        return group == nullptr;
+    };
+
+    /*
+        Take the newest task of our own queue first,
+        otherwise steal the oldest task of another queue,
+        queues of the own node first
+    */
+    const std::vector<int>& stealOrder = _stealOrders[queueIndex];
+
+    Task task = { nullptr, nullptr };
+    for (int i = 0; i < numQueues && !task.work; ++i) {
+        WorkQueue& queue = *_queues[stealOrder[i]];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        std::deque<Task>& tasks = queue.tasks;
+
+        if (i == 0) {
+            const auto found = std::find_if(tasks.rbegin(), tasks.rend(), isHelpable);
+            if (found != tasks.rend()) {
+                task = std::move(*found);
+                tasks.erase(std::next(found).base());
+            }
+        }
+        else {
+            const auto found = std::find_if(tasks.begin(), tasks.end(), isHelpable);
+            if (found != tasks.end()) {
+                task = std::move(*found);
+                tasks.erase(found);
+            }
+        }
+    }
+
+    if (!task.work) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        --_numPending;
+    }
+
+    // groups started by the task are nested in its group, and run in its stage
+    const TaskGroup* const outerGroup            = _currentGroup;
+    const int              outerStageRowBandSize = _stageRowBandSize;
+    _currentGroup     = task.group;
+    _stageRowBandSize = task.group ? task.group->stageRowBandSize : 0;
+    task.work();
+    _currentGroup     = outerGroup;
+    _stageRowBandSize = outerStageRowBandSize;
+
+    return true;
+}
+
+void TaskScheduler::_waitUntilDone(TaskGroup& group) {
+    /*
+        The group can always be finished by its waiter alone: 
+        its queued tasks only wait for groups nested in them,
+        its running tasks are finished by their own threads.
+        With nothing to help with, the waiter sleeps until a
+        task is added to the group or the group is done
+    */
+    std::unique_lock<std::mutex> lock(group.mutex);
+    while (group.numRemaining > 0) {
+        const int numWakeups = group.numWakeups;
+
+        lock.unlock();
+        const bool isRun = _tryRunOne(&group);
+        lock.lock();
+
+        if (!isRun) {
+            group.condition.wait(lock, [&group, numWakeups]() {
+                return group.numRemaining == 0 || group.numWakeups != numWakeups;
+            });
+        }
+    }
+    lock.unlock();
+
+    if (group.exception) {
+        std::rethrow_exception(group.exception);
+    }
+}
+
+void TaskScheduler::_workerLoop(const int queueIndex) {
+    t_queueIndex = queueIndex;
+
+    // pinning only matters when there is more than one node
+    if (numNodes() > 1) {
+        for (int node = 0; node < numNodes(); ++node) {
+            const std::vector<int>& nodeQueues = _nodeQueues[node];
+            if (std::find(nodeQueues.begin(), nodeQueues.end(), queueIndex) != nodeQueues.end()) {
+                systemUtils::pinCurrentThread(_nodeCpus[node]);
+            }
+        }
+    }
+
+    while (true) {
+        if (_tryRunOne(nullptr)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepCondition.wait(lock, [this]() { return _isStopping || _numPending > 0; });
+        if (_isStopping && _numPending == 0) {
+            return;
+        }
+    }
+}
+
+TaskGraph::TaskGraph() :
+    _nodes() {
+}
+
+int TaskGraph::addTask(std::function<void()>   work,
+                       const std::vector<int>& dependencies) {
+
+    const int id = static_cast<int>(_nodes.size());
+
+    _nodes.push_back(std::make_unique<Node>());
+    _nodes[id]->work            = std::move(work);
+    _nodes[id]->numDependencies = static_cast<int>(dependencies.size());
+    for (const int dependency : dependencies) {
+        _nodes[dependency]->successors.push_back(id);
+    }
+
+    return id;
+}
+
+void TaskGraph::run() {
+    TaskScheduler::TaskGroup group(static_cast<int>(_nodes.size()));
+    for (const auto& node : _nodes) {
+        node->numWaiting.store(node->numDependencies);
+    }
+
+    TaskScheduler& scheduler = TaskScheduler::instance();
+
+    for (int id = 0; id < static_cast<int>(_nodes.size()); ++id) {
+        if (_nodes[id]->numDependencies == 0) {
+            _schedule(scheduler, id, &group);
+        }
+    }
+
+    scheduler._waitUntilDone(group);
+}
+
+void TaskGraph::_schedule(TaskScheduler&                  scheduler,
+                          const int                       id,
+                          TaskScheduler::TaskGroup* const group) {
+
+    /*
+        Nodes scheduled by other nodes stay in the group of the run,
+        successors of a failed node are still scheduled so that the
+        group finishes, they are skipped like every unstarted task
+    */
+    scheduler._submit([this, &scheduler, id, group]() {
+        // finished last, the graph may be destroyed once its last node is
+        TaskScheduler::TaskFinisher finisher(*group);
+
+        Node& node = *_nodes[id];
+        TaskScheduler::_runTask(*group, node.work);
+
+        for (const int successor : node.successors) {
+            if (_nodes[successor]->numWaiting.fetch_sub(1) == 1) {
+                _schedule(scheduler, successor, group);
+            }
+        }
+    }, group);
+}
+
+} // namespace shdr
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace shdr {
+
+/*
+    StageType: pipeline stage a row band size is tuned for
+*/
+enum class StageType {
+    S_ALIGN,
+    S_MERGE,
+    S_TONE_MAP,
+};
+
+/*
+    TaskScheduler is the only source of parallelism of the tool.
+
+    It owns a work-stealing thread pool: each worker has its
+    own task queue, pops its newest task first and steals the
+    oldest task of another worker when it runs out of work.
+    Threads that wait for tasks (e.g. in parallelFor) help
+    executing pending tasks, so nested parallelism is safe.
+    Each parallel call is a task group, and a waiter only helps
+    with tasks of its group or of groups started from inside
+    them, never with sibling or unrelated work. So concurrent
+    jobs never run inside each other's stacks, and a lock held
+    across a parallel call is safe as long as the tasks of the
+    call itself do not take it. A waiter with nothing to help
+    with sleeps until its group gets a task or is done.
+
+    An exception thrown by a task is kept by its group, the
+    tasks of the group that haven't started are skipped, and
+    the parallel call rethrows it on the waiting thread.
+
+    The number of threads is a single global setting, and
+    OpenCV's internal threading is disabled so that it does
+    not compete with the pool.
+
+    On NUMA hosts workers are spread over the nodes and pinned
+    to their node's cpus. parallelRows gives each node a fixed,
+    contiguous part of the row bands of an image and submits
+    them to that node's workers, which steal from their own
+    node before other nodes. Every stage walking the same image
+    size therefore touches a row on the same node, so buffers 
+    first touched in row bands stay local to their readers.
+
+    The row band size can also be set per pipeline stage and
+    resolution class, since the best grain of e.g. a bilateral
+    filter differs from the one of the merge. A StageScope
+    applies the stage's band size to the parallelRows calls of
+    the current thread and of every task started from it.
+*/
+class TaskScheduler {
+public:
+    ~TaskScheduler();
+
+    static TaskScheduler& instance();
+
+    // numThreads includes the calling thread, 0 means one per core.
+    // It should be set before any pipeline runs.
+    static void setNumThreads(const int numThreads);
+
+    // rows per band of parallelRows outside a tuned stage,
+    // 0 means the default, it takes effect at once
+    static void setRowBandSize(const int rowBandSize);
+
+    // rows per band of stage on images of resolutionClass, 0 means the above
+    static void setStageRowBandSize(const StageType stage,
+                                    const int       resolutionClass,
+                                    const int       rowBandSize);
+
+    static int stageRowBandSize(const StageType stage, const int resolutionClass);
+
+    // classes of up to 1, 4, 16 and 64 megapixels, and above
+    static int resolutionClass(const int width, const int height);
+
+    int numThreads() const;
+
+    // rows per band parallelRows uses on the calling thread
+    int rowBandSize() const;
+
+    // number of NUMA nodes the workers are spread over
+    int numNodes() const;
+
+    // Run body(chunkBegin, chunkEnd) over [begin, end) in chunks of
+    // grain elements and return once every chunk is done.
+    void parallelFor(const int                              begin,
+                     const int                              end,
+                     const int                              grain,
+                     const std::function<void(int, int)>&   body);
+
+    // parallelFor over image rows using the row band size
+    void parallelRows(const int                            numRows,
+                      const std::function<void(int, int)>& body);
+
+    // read bandwidth of each node's cpus from each node's memory
+    void reportNodeBandwidth() const;
+
+    /*
+        StageScope applies the row band size of a stage on
+        images of the given size until it goes out of scope
+    */
+    class StageScope {
+    public:
+        StageScope(const StageType stage, const int width, const int height);
+        ~StageScope();
+
+        StageScope(const StageScope&) = delete;
+        StageScope& operator = (const StageScope&) = delete;
+
+    private:
+        int _outerRowBandSize;
+    };
+
+    static const int NUM_STAGE_TYPES        = 3;
+    static const int NUM_RESOLUTION_CLASSES = 5;
+
+private:
+    friend class TaskGraph;
+
+    explicit TaskScheduler(const int numThreads);
+
+    /*
+        Tasks of one parallel call, parent is the group of the
+        task the call was made from (nullptr outside the pool),
+        it outlives every group started from inside its tasks
+    */
+    struct TaskGroup {
+        explicit TaskGroup(const int numTasks);
+
+        // called once by every task, also a skipped or a failed one
+        void finishTask();
+
+        // keep the first exception, tasks not started yet are skipped
+        void fail(std::exception_ptr exception);
+
+        // wake the waiter, e.g. for a task added to the group
+        void notify();
+
+        const TaskGroup* parent;
+
+        // stage row band size of the thread that started the group
+        const int stageRowBandSize;
+
+        std::atomic<bool> isFailed;
+
+        // guarded by mutex, numWakeups counts the notifications
+        std::mutex              mutex;
+        std::condition_variable condition;
+        int                     numRemaining;
+        int                     numWakeups;
+        std::exception_ptr      exception;
+    };
+
+    struct Task {
+        std::function<void()> work;
+        const TaskGroup*      group;
+    };
+
+    // group of the task the current thread runs
+    static thread_local const TaskGroup* _currentGroup;
+
+    // row band size of the stage the current thread runs, 0 outside stages
+    static thread_local int _stageRowBandSize;
+
+    void _submit(std::function<void()> work, TaskGroup* const group);
+    void _submitTo(const int queueIndex, std::function<void()> work, TaskGroup* const group);
+
+    // finishes a task of group when it goes out of scope, however the task ends
+    struct TaskFinisher {
+        explicit TaskFinisher(TaskGroup& group);
+        ~TaskFinisher();
+
+        TaskGroup& group;
+    };
+
+    // run work unless group failed, an exception is kept by the group
+    static void _runTask(TaskGroup& group, const std::function<void()>& work);
+
+    // run a pending task of group (or a nested one), any task if group is nullptr
+    bool _tryRunOne(const TaskGroup* const group);
+
+    // rethrows the first exception of the group's tasks
+    void _waitUntilDone(TaskGroup& group);
+    void _workerLoop(const int queueIndex);
+
+    struct WorkQueue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    int              _numThreads;
+    std::atomic<int> _rowBandSize;
+
+    // one queue per worker, the last one is for external threads
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::vector<std::thread>                _workers;
+
+    // cpus of each node workers run on, worker queues of each node,
+    // and the queues each queue's thread visits, its own one first
+    std::vector<std::vector<int>> _nodeCpus;
+    std::vector<std::vector<int>> _nodeQueues;
+    std::vector<std::vector<int>> _stealOrders;
+
+    std::mutex              _sleepMutex;
+    std::condition_variable _sleepCondition;
+    int                     _numPending;
+    bool                    _isStopping;
+
+    static const int DEFAULT_ROW_BAND_SIZE = 16;
+};
+
+/*
+    TaskGraph is a set of tasks with dependencies, a task
+    is submitted to the scheduler as soon as all tasks it 
+    depends on are finished.
+*/
+class TaskGraph {
+public:
+    TaskGraph();
+
+    // dependencies are ids returned by earlier addTask calls
+    int addTask(std::function<void()>   work,
+                const std::vector<int>& dependencies = std::vector<int>());
+
+    // run all tasks and return once every one is finished
+    void run();
+
+private:
+    struct Node {
+        std::function<void()> work;
+        std::vector<int>      successors;
+        int                   numDependencies;
+        std::atomic<int>      numWaiting;
+    };
+
+    void _schedule(TaskScheduler&                  scheduler,
+                   const int                       id,
+                   TaskScheduler::TaskGroup* const group);
+
+    std::vector<std::unique_ptr<Node>> _nodes;
+};
+
+} // namespace shdr
@@ -0,0 +1,125 @@
+#include "core/toneCurve.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace shdr {
+
+ToneCurve::ToneCurve() :
+    _table(),
+    _minLogLw(0.0f),
+    _maxLogLw(0.0f),
+    _invStep(0.0f) {
+}
+
+void ToneCurve::bake(const std::function<float(const float)>& curve,
+                     const float                              minLogLw,
+                     const float                              maxLogLw,
+                     const int                                size) {
+
+    const float step = (maxLogLw - minLogLw) / static_cast<float>(size - 1);
+
+    _table.resize(size);
+    for (int i = 0; i < size; ++i) {
+        _table[i] = curve(minLogLw + step * static_cast<float>(i));
+    }
+
+    _minLogLw = minLogLw;
+    _maxLogLw = maxLogLw;
+    _invStep  = 1.0f / step;
+}
+
+bool ToneCurve::save(const std::string& filename) const {
+    if (isEmpty()) {
+        std::cout << "There is no tone curve to save"
+                  << std::endl;
+
+        return false;
+    }
+
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f) {
+        std::cout << "Tone curve file can't open: " << filename
+                  << std::endl;
+
+        return false;
+    }
+
+    /*
+        1D .cube LUT, the input domain is log luminance
+        and every channel holds the display luminance
+    */
+    fprintf(f, "# input: ln(luminance + 1e-6), output: display luminance\n");
+    fprintf(f, "TITLE \"shdr tone curve\"\n");
+    fprintf(f, "LUT_1D_SIZE %d\n", static_cast<int>(_table.size()));
+    fprintf(f, "DOMAIN_MIN %.9g %.9g %.9g\n", _minLogLw, _minLogLw, _minLogLw);
+    fprintf(f, "DOMAIN_MAX %.9g %.9g %.9g\n", _maxLogLw, _maxLogLw, _maxLogLw);
+    for (const float value : _table) {
+        fprintf(f, "%.9g %.9g %.9g\n", value, value, value);
+    }
+
+    const bool isWritten = (fclose(f) == 0);
+    if (isWritten) {
+        std::cout << "# Save tone curve to " << filename
+                  << std::endl;
+    }
+
+    return isWritten;
+}
+
+bool ToneCurve::load(const std::string& filename) {
+    FILE* f = fopen(filename.c_str(), "r");
+    if (!f) {
+        std::cout << "Tone curve file can't open: " << filename
+                  << std::endl;
+
+        return false;
+    }
+
+    int                size     = 0;
+    float              minLogLw = 0.0f;
+    float              maxLogLw = 1.0f;
+    std::vector<float> table;
+
+    char line[1024];
+    while (fgets(line, 1024, f)) {
+        float values[3];
+        if (line[0] == '#' || line[0] == '\n' || std::strncmp(line, "TITLE", 5) == 0) {
+            continue;
+        }
+        else if (std::sscanf(line, "LUT_1D_SIZE %d", &size) == 1) {
+            table.reserve(size);
+        }
+        else if (std::sscanf(line, "DOMAIN_MIN %f", &minLogLw) == 1 ||
+                 std::sscanf(line, "DOMAIN_MAX %f", &maxLogLw) == 1 ||
+                 std::sscanf(line, "LUT_1D_INPUT_RANGE %f %f", &minLogLw, &maxLogLw) == 2) {
+            continue;
+        }
+        else if (std::sscanf(line, "%f %f %f", &values[0], &values[1], &values[2]) == 3) {
+            // channels agree for a luminance curve, average them otherwise
+            table.push_back((values[0] + values[1] + values[2]) / 3.0f);
+        }
+    }
+
+    fclose(f);
+
+    if (size < 2 || static_cast<int>(table.size()) != size || !(maxLogLw > minLogLw)) {
+        std::cout << "Tone curve file is not a valid 1D LUT: " << filename
+                  << std::endl;
+
+        return false;
+    }
+
+    _table    = std::move(table);
+    _minLogLw = minLogLw;
+    _maxLogLw = maxLogLw;
+    _invStep  = static_cast<float>(size - 1) / (maxLogLw - minLogLw);
+
+    std::cout << "# Load tone curve from " << filename
+              << std::endl;
+
+    return true;
+}
+
+} // namespace shdr
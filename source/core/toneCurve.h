@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ToneCurve is the luminance curve of a global tone mapper
+    baked into a lookup table, i.e. display luminance sampled
+    uniformly over log luminance ln(lw + LUMINANCE_DELTA).
+
+    Once the key and the white point of a scene are known,
+    applying the operator is a single table lookup per pixel.
+    The table can be saved and loaded as a 1D .cube LUT, so
+    that frames and scenes sharing a look reuse one curve.
+*/
+class ToneCurve {
+public:
+    ToneCurve();
+
+    // sample curve(logLw) over [minLogLw, maxLogLw] at size points
+    void bake(const std::function<float(const float)>& curve,
+              const float                              minLogLw,
+              const float                              maxLogLw,
+              const int                                size = DEFAULT_SIZE);
+
+    bool isEmpty() const;
+
+    // linearly interpolated, clamped to the ends of the table
+    float displayLuminance(const float logLw) const;
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+    static constexpr int DEFAULT_SIZE = 8192;
+
+private:
+    std::vector<float> _table;
+    float              _minLogLw;
+    float              _maxLogLw;
+    float              _invStep;
+};
+
+// header implementation
+
+inline bool ToneCurve::isEmpty() const {
+    return _table.empty();
+}
+
+inline float ToneCurve::displayLuminance(const float logLw) const {
+    const float x     = (logLw - _minLogLw) * _invStep;
+    const int   last  = static_cast<int>(_table.size()) - 1;
+
+    if (x <= 0.0f) {
+        return _table[0];
+    }
+    if (x >= static_cast<float>(last)) {
+        return _table[last];
+    }
+
+    const int   index = static_cast<int>(x);
+    const float t     = x - static_cast<float>(index);
+
+    return _table[index] + t * (_table[index + 1] - _table[index]);
+}
+
+} // namespace shdr
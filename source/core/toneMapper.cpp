@@ -0,0 +1,188 @@
+#include "core/toneMapper.h"
+
+#include "core/taskScheduler.h"
+#include "imageUtils.h"
+
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace shdr {
+
+void ToneMapper::setToneCurveFiles(const std::string& importFilename,
+                                   const std::string& exportFilename) {
+
+    if (!isGlobal() && (!importFilename.empty() || !exportFilename.empty())) {
+        std::cout << "Only global tone mappers have a tone curve, ignore tone curve files"
+                  << std::endl;
+
+        return;
+    }
+
+    _importedCurve       = ToneCurve();
+    _curveExportFilename = exportFilename;
+    _isCurveExported     = false;
+
+    if (!importFilename.empty() && !_importedCurve.load(importFilename)) {
+        std::cout << "Derive the tone curve from the radiance map instead"
+                  << std::endl;
+
+        _importedCurve = ToneCurve();
+    }
+}
+
+void ToneMapper::_luminance(const cv::Mat& hdri, cv::Mat* const out_lw) const {
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    cv::Mat lw = _scratch(height, width, CV_32FC1);
+
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        std::vector<cv::Vec3f> row(width);
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            imageUtils::loadRadianceRow(hdri, iy, &row[0][0]);
+
+            float* lwRow = lw.ptr<float>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                lwRow[ix] = ToneStatistics::luminance(row[ix][0], row[ix][1], row[ix][2]);
+            }
+        }
+    });
+
+    *out_lw = lw;
+}
+
+void ToneMapper::_displayLuminance(const cv::Mat& logLd,
+                                   const float    whitePercentile,
+                                   cv::Mat* const out_ld) const {
+
+    const int width  = logLd.cols;
+    const int height = logLd.rows;
+
+    cv::Mat ld = _scratch(height, width, CV_32FC1);
+
+    ToneStatistics statistics;
+    std::mutex     statisticsMutex;
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        ToneStatistics bandStatistics;
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const float* logLdRow = logLd.ptr<float>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                bandStatistics.addLogLuminance(logLdRow[ix]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(statisticsMutex);
+        statistics.combine(bandStatistics);
+    });
+
+    const float logWhite = statistics.percentileLogLuminance(whitePercentile);
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const float* logLdRow = logLd.ptr<float>(iy);
+            float*       ldRow    = ld.ptr<float>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                ldRow[ix] = std::exp(logLdRow[ix] - logWhite);
+            }
+        }
+    });
+
+    *out_ld = ld;
+}
+
+void ToneMapper::_reconstructColor(const cv::Mat& hdri,
+                                   const cv::Mat& lw,
+                                   const cv::Mat& ld,
+                                   const float    scale,
+                                   cv::Mat* const out_ldri) const {
+
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    cv::Mat ldri = _scratch(height, width, CV_8UC3);
+
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        std::vector<cv::Vec3f> row(width);
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            imageUtils::loadRadianceRow(hdri, iy, &row[0][0]);
+
+            const float* lwRow   = lw.ptr<float>(iy);
+            const float* ldRow   = ld.ptr<float>(iy);
+            cv::Vec3b*   ldriRow = ldri.ptr<cv::Vec3b>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                /*
+                    keep the color ratio of each channel to its luminance,
+                    dividing by zero luminance gives zero like cv::divide
+                */
+                const float ratio = (lwRow[ix] != 0.0f) ? 
+                    ldRow[ix] / lwRow[ix] * scale * 255.0f : 0.0f;
+
+                for (int c = 0; c < 3; ++c) {
+                    ldriRow[ix][c] = cv::saturate_cast<uchar>(row[ix][c] * ratio);
+                }
+            }
+        }
+    });
+
+    *out_ldri = ldri;
+}
+
+void ToneMapper::_globalCurve(const std::function<void(ToneCurve* const)>& bakeCurve,
+                              ToneCurve* const                             out_curve) const {
+
+    if (!_importedCurve.isEmpty()) {
+        *out_curve = _importedCurve;
+    }
+    else {
+        bakeCurve(out_curve);
+    }
+
+    // e.g. every frame of a sequence bakes a curve, only the first one is saved
+    if (!_curveExportFilename.empty() && !_isCurveExported.exchange(true)) {
+        out_curve->save(_curveExportFilename);
+    }
+}
+
+void ToneMapper::_applyCurve(const cv::Mat&   hdri,
+                             const ToneCurve& curve,
+                             cv::Mat* const   out_ldri) const {
+
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    cv::Mat ldri = _scratch(height, width, CV_8UC3);
+
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        std::vector<cv::Vec3f> row(width);
+        std::vector<float>     lw(width);
+        std::vector<float>     logLw(width);
+
+        // the log of a whole row is vectorized by OpenCV
+        cv::Mat logLwRow(1, width, CV_32FC1, logLw.data());
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            imageUtils::loadRadianceRow(hdri, iy, &row[0][0]);
+
+            for (int ix = 0; ix < width; ++ix) {
+                lw[ix]    = ToneStatistics::luminance(row[ix][0], row[ix][1], row[ix][2]);
+                logLw[ix] = lw[ix] + ToneStatistics::LUMINANCE_DELTA;
+            }
+            cv::log(logLwRow, logLwRow);
+
+            cv::Vec3b* ldriRow = ldri.ptr<cv::Vec3b>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                // dividing by zero luminance gives zero like cv::divide
+                const float ratio = (lw[ix] != 0.0f) ? 
+                    curve.displayLuminance(logLw[ix]) / lw[ix] * 255.0f : 0.0f;
+
+                for (int c = 0; c < 3; ++c) {
+                    ldriRow[ix][c] = cv::saturate_cast<uchar>(row[ix][c] * ratio);
+                }
+            }
+        }
+    });
+
+    *out_ldri = ldri;
+}
+
+} // namespace shdr
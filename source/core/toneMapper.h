@@ -1,6 +1,14 @@
 #pragma once
 
+#include "core/pipelineStage.h"
+#include "core/taskScheduler.h"
+#include "core/toneCurve.h"
+#include "core/toneStatistics.h"
+
+#include <atomic>
+#include <functional>
 #include <opencv2/opencv.hpp>
+#include <string>
 
 namespace shdr {
 
@@ -12,11 +20,135 @@ namespace shdr {
     system, we need to compress the full dynamic range 
     to ldr (0-255) but preserving the contrast so that 
     it gives a similar visual match.
+
+    Global luminance statistics can be supplied by the 
+    caller, otherwise they are gathered from hdri first.
+
+    hdri may be stored in single or half precision, tone
+    mappers work on its luminance plane and only touch the
+    color channels while loading them for reconstruction.
+
+    Global operators are a curve of luminance only, they bake 
+    it into a ToneCurve, which can be exported and imported
+    again to skip deriving it for scenes sharing a look.
+
+    A tone mapped window only depends on the hdri within
+    haloRadius() pixels of it, given the global statistics,
+    so a region can be rendered without the whole image.
 */
-class ToneMapper {
+class ToneMapper : public PipelineStage {
 public:
-    virtual void map(const cv::Mat& hdri, 
-                     cv::Mat* const out_ldri) const = 0;
+    ToneMapper();
+
+    void map(const cv::Mat& hdri, 
+             cv::Mat* const out_ldri) const;
+
+    void map(const cv::Mat&        hdri,
+             const ToneStatistics& statistics,
+             cv::Mat* const        out_ldri) const;
+
+    // whether the operator is a global luminance curve
+    bool isGlobal() const;
+
+    // pixels around a window its result depends on, 
+    // WHOLE_IMAGE_HALO if every pixel depends on the whole image
+    int haloRadius() const;
+
+    // empty filenames disable import / export, a curve that 
+    // fails to load is derived from the statistics instead,
+    // the curve of the first map() afterwards is exported
+    void setToneCurveFiles(const std::string& importFilename,
+                           const std::string& exportFilename);
+
+    static constexpr int WHOLE_IMAGE_HALO = -1;
+
+protected:
+    // luminance plane (CV_32FC1) of hdri, same as cv::COLOR_BGR2GRAY
+    void _luminance(const cv::Mat& hdri, cv::Mat* const out_lw) const;
+
+    // ld = exp(logLd - white), where white is the log luminance
+    // percentile (0-100) of logLd, for operators whose result
+    // is only known up to a constant in the log domain
+    void _displayLuminance(const cv::Mat& logLd, 
+                           const float    whitePercentile,
+                           cv::Mat* const out_ld) const;
+
+    // out_ldri = hdri / lw * ld * scale in 8-bit, computed per pixel
+    // so that no full size color buffer is needed
+    void _reconstructColor(const cv::Mat& hdri,
+                           const cv::Mat& lw,
+                           const cv::Mat& ld,
+                           const float    scale,
+                           cv::Mat* const out_ldri) const;
+
+    // the imported curve if there is one, otherwise the one
+    // from bakeCurve, the first one is saved if an export file is given
+    void _globalCurve(const std::function<void(ToneCurve* const)>& bakeCurve,
+                      ToneCurve* const                             out_curve) const;
+
+    // out_ldri = hdri / lw * curve(ln(lw + delta)) in 8-bit,
+    // one table lookup per pixel
+    void _applyCurve(const cv::Mat&   hdri,
+                     const ToneCurve& curve,
+                     cv::Mat* const   out_ldri) const;
+
+private:
+    virtual void _mapImpl(const cv::Mat&        hdri,
+                          const ToneStatistics& statistics,
+                          cv::Mat* const        out_ldri) const = 0;
+
+    virtual bool _isGlobalImpl() const;
+    virtual int  _haloRadiusImpl() const;
+
+    ToneCurve   _importedCurve;
+    std::string _curveExportFilename;
+
+    mutable std::atomic<bool> _isCurveExported;
 };
 
-} // namespace shdr
\ No newline at end of file
+// header implementation
+
+inline ToneMapper::ToneMapper() :
+    PipelineStage(),
+    _importedCurve(),
+    _curveExportFilename(),
+    _isCurveExported(false) {
+}
+
+inline void ToneMapper::map(const cv::Mat& hdri,
+                            cv::Mat* const out_ldri) const {
+
+    TaskScheduler::StageScope stageScope(StageType::S_TONE_MAP, hdri.cols, hdri.rows);
+
+    ToneStatistics statistics;
+    statistics.compute(hdri);
+
+    _mapImpl(hdri, statistics, out_ldri);
+}
+
+inline void ToneMapper::map(const cv::Mat&        hdri,
+                            const ToneStatistics& statistics,
+                            cv::Mat* const        out_ldri) const {
+
+    TaskScheduler::StageScope stageScope(StageType::S_TONE_MAP, hdri.cols, hdri.rows);
+
+    _mapImpl(hdri, statistics, out_ldri);
+}
+
+inline bool ToneMapper::isGlobal() const {
+    return _isGlobalImpl();
+}
+
+inline int ToneMapper::haloRadius() const {
+    return _haloRadiusImpl();
+}
+
+inline bool ToneMapper::_isGlobalImpl() const {
+    return false;
+}
+
+inline int ToneMapper::_haloRadiusImpl() const {
+    return 0;
+}
+
+} // namespace shdr
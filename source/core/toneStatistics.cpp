@@ -0,0 +1,113 @@
+#include "core/toneStatistics.h"
+
+#include "imageUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace shdr {
+
+ToneStatistics::ToneStatistics() :
+    _logSum(0.0),
+    _numSamples(0.0),
+    _minLogLuminance(std::numeric_limits<float>::max()),
+    _maxLogLuminance(std::numeric_limits<float>::lowest()),
+    _histogram(NUM_HISTOGRAM_BINS, 0.0),
+    _isSmoothed(false) {
+}
+
+void ToneStatistics::compute(const cv::Mat& hdri, const int stride) {
+    *this = ToneStatistics();
+
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    std::vector<cv::Vec3f> row(width);
+    for (int iy = 0; iy < height; iy += stride) {
+        imageUtils::loadRadianceRow(hdri, iy, &row[0][0]);
+        for (int ix = 0; ix < width; ix += stride) {
+            const float lw = luminance(row[ix][0], row[ix][1], row[ix][2]);
+
+            addLogLuminance(std::log(lw + LUMINANCE_DELTA));
+        }
+    }
+}
+
+void ToneStatistics::combine(const ToneStatistics& other) {
+    _logSum          += other._logSum;
+    _numSamples      += other._numSamples;
+    _minLogLuminance  = std::min(_minLogLuminance, other._minLogLuminance);
+    _maxLogLuminance  = std::max(_maxLogLuminance, other._maxLogLuminance);
+
+    for (int i = 0; i < NUM_HISTOGRAM_BINS; ++i) {
+        _histogram[i] += other._histogram[i];
+    }
+}
+
+void ToneStatistics::blend(const ToneStatistics& other, const float weight) {
+    const float logAverage = (1.0f - weight) * logAverageLuminance() + 
+                             weight * other.logAverageLuminance();
+
+    /*
+        histograms are blended after normalizing
+        this one to the sample count of other
+    */
+    const double scale = (_numSamples > 0.0) ? other._numSamples / _numSamples : 0.0;
+    for (int i = 0; i < NUM_HISTOGRAM_BINS; ++i) {
+        _histogram[i] = (1.0 - weight) * scale * _histogram[i] + weight * other._histogram[i];
+    }
+
+    _numSamples      = other._numSamples;
+    _logSum          = static_cast<double>(logAverage) * _numSamples;
+    _minLogLuminance = (1.0f - weight) * _minLogLuminance + weight * other._minLogLuminance;
+    _maxLogLuminance = (1.0f - weight) * _maxLogLuminance + weight * other._maxLogLuminance;
+}
+
+float ToneStatistics::logAverageLuminance() const {
+    if (_numSamples <= 0.0) {
+        return 0.0f;
+    }
+
+    return static_cast<float>(_logSum / _numSamples);
+}
+
+float ToneStatistics::minLogLuminance() const {
+    return _minLogLuminance;
+}
+
+float ToneStatistics::maxLogLuminance() const {
+    return _maxLogLuminance;
+}
+
+float ToneStatistics::percentileLogLuminance(const float percentile) const {
+    if (percentile >= 100.0f) {
+        return _maxLogLuminance;
+    }
+    if (percentile <= 0.0f) {
+        return _minLogLuminance;
+    }
+
+    constexpr float binWidth = (MAX_HISTOGRAM_LOG - MIN_HISTOGRAM_LOG) / NUM_HISTOGRAM_BINS;
+
+    /*
+        find the bin where cdf reaches the target count,
+        then interpolate linearly inside that bin
+    */
+    const double target = _numSamples * percentile * 0.01;
+    double       sum    = 0.0;
+    for (int i = 0; i < NUM_HISTOGRAM_BINS; ++i) {
+        if (sum + _histogram[i] >= target && _histogram[i] > 0.0) {
+            const float fraction = static_cast<float>((target - sum) / _histogram[i]);
+            const float logLw    = MIN_HISTOGRAM_LOG + (i + fraction) * binWidth;
+
+            return std::clamp(logLw, _minLogLuminance, _maxLogLuminance);
+        }
+
+        sum += _histogram[i];
+    }
+
+    return _maxLogLuminance;
+}
+
+} // namespace shdr
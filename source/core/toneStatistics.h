@@ -0,0 +1,102 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace shdr {
+
+/*
+    ToneStatistics stores global luminance statistics
+    of a radiance map that tone mappers depend on, i.e.
+    the log-average luminance, the log luminance range
+    and a log luminance histogram.
+
+    Keeping them outside of the tone mappers allows the
+    statistics to be gathered while the radiance map is
+    being merged, and to be smoothed over time for image
+    sequences. The histogram also provides percentiles, 
+    e.g. for a robust white point.
+*/
+class ToneStatistics {
+public:
+    ToneStatistics();
+
+    // Gather statistics from every stride-th pixel in each
+    // direction of a radiance map.
+    void compute(const cv::Mat& hdri, const int stride = 1);
+
+    // Add one sample, logLw is log(luminance + LUMINANCE_DELTA).
+    void addLogLuminance(const float logLw);
+
+    // Merge statistics gathered on another part of the image.
+    void combine(const ToneStatistics& other);
+
+    // Exponential moving average towards other statistics,
+    // weight is the contribution of other (0-1).
+    void blend(const ToneStatistics& other, const float weight);
+
+    float logAverageLuminance() const;
+    float minLogLuminance() const;
+    float maxLogLuminance() const;
+
+    // percentile is in 0-100
+    float percentileLogLuminance(const float percentile) const;
+
+    // Statistics smoothed over an image sequence, tone mappers
+    // then take their range instead of measuring the image.
+    void setSmoothed(const bool isSmoothed);
+    bool isSmoothed() const;
+
+    // luminance of a BGR radiance, same weights as cv::COLOR_BGR2GRAY
+    static float luminance(const float b, const float g, const float r);
+
+    // delta used to avoid log(0) on black pixels
+    static constexpr float LUMINANCE_DELTA = 0.000001f;
+
+    // histogram covers log luminance in [MIN_HISTOGRAM_LOG, MAX_HISTOGRAM_LOG)
+    static constexpr int   NUM_HISTOGRAM_BINS = 1024;
+    static constexpr float MIN_HISTOGRAM_LOG  = -24.0f;
+    static constexpr float MAX_HISTOGRAM_LOG  = 24.0f;
+
+private:
+    double              _logSum;
+    double              _numSamples;
+    float               _minLogLuminance;
+    float               _maxLogLuminance;
+    std::vector<double> _histogram;
+    bool                _isSmoothed;
+};
+
+// header implementation
+
+inline void ToneStatistics::addLogLuminance(const float logLw) {
+    constexpr float binScale = NUM_HISTOGRAM_BINS / (MAX_HISTOGRAM_LOG - MIN_HISTOGRAM_LOG);
+
+    int bin = static_cast<int>((logLw - MIN_HISTOGRAM_LOG) * binScale);
+    bin = (bin < 0) ? 0 : ((bin >= NUM_HISTOGRAM_BINS) ? NUM_HISTOGRAM_BINS - 1 : bin);
+
+    _logSum     += logLw;
+    _numSamples += 1.0;
+    _histogram[bin] += 1.0;
+
+    if (logLw < _minLogLuminance) {
+        _minLogLuminance = logLw;
+    }
+    if (logLw > _maxLogLuminance) {
+        _maxLogLuminance = logLw;
+    }
+}
+
+inline void ToneStatistics::setSmoothed(const bool isSmoothed) {
+    _isSmoothed = isSmoothed;
+}
+
+inline bool ToneStatistics::isSmoothed() const {
+    return _isSmoothed;
+}
+
+inline float ToneStatistics::luminance(const float b, const float g, const float r) {
+    return 0.114f * b + 0.587f * g + 0.299f * r;
+}
+
+} // namespace shdr
@@ -0,0 +1,152 @@
+#include "core/tuningProfile.h"
+
+#include "jsonValue.h"
+#include "systemUtils.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace shdr {
+
+namespace {
+
+const char* const STAGE_NAMES[TaskScheduler::NUM_STAGE_TYPES] = { "align", "merge", "toneMap" };
+
+const char* const RESOLUTION_CLASS_NAMES[TaskScheduler::NUM_RESOLUTION_CLASSES] = {
+    "1MP", "4MP", "16MP", "64MP", "above64MP"
+};
+
+} // anonymous namespace
+
+TuningProfile::TuningProfile() :
+    TuningProfile(0) {
+}
+
+TuningProfile::TuningProfile(const int numThreads) :
+    _numThreads(numThreads),
+    _stageRowBandSizes(TaskScheduler::NUM_STAGE_TYPES,
+                       std::vector<int>(TaskScheduler::NUM_RESOLUTION_CLASSES, 0)) {
+}
+
+void TuningProfile::apply() const {
+    for (int stage = 0; stage < TaskScheduler::NUM_STAGE_TYPES; ++stage) {
+        for (int resolutionClass = 0; resolutionClass < TaskScheduler::NUM_RESOLUTION_CLASSES; ++resolutionClass) {
+            TaskScheduler::setStageRowBandSize(static_cast<StageType>(stage), resolutionClass,
+                                               _stageRowBandSizes[stage][resolutionClass]);
+        }
+    }
+}
+
+bool TuningProfile::load(const std::string& filename) {
+    std::ifstream     file(filename);
+    std::stringstream text;
+    text << file.rdbuf();
+
+    JsonValue profile;
+    if (!file || !JsonValue::parse(text.str(), &profile)) {
+        std::cout << "Tuning profile can't be read: " << filename
+                  << std::endl;
+
+        return false;
+    }
+
+    /*
+        The best settings depend on the cores and caches,
+        so they are only trusted on the host they come from
+    */
+    const std::string host    = profile["host"].asString();
+    const int         numCpus = static_cast<int>(profile["cpus"].asNumber());
+    if (host != systemUtils::hostName() ||
+        numCpus != static_cast<int>(std::thread::hardware_concurrency())) {
+
+        std::cout << "Tuning profile " << filename << " was measured on " << host
+                  << " (" << numCpus << " cpus), run -autotune on this host"
+                  << std::endl;
+
+        return false;
+    }
+
+    _numThreads = static_cast<int>(profile["threads"].asNumber());
+
+    // resolution classes that weren't tuned are left at 0
+    std::string tunedClasses;
+    const JsonValue& rowBandSizes = profile["rowBandSizes"];
+    for (int resolutionClass = 0; resolutionClass < TaskScheduler::NUM_RESOLUTION_CLASSES; ++resolutionClass) {
+        const JsonValue& stages = rowBandSizes[RESOLUTION_CLASS_NAMES[resolutionClass]];
+        for (int stage = 0; stage < TaskScheduler::NUM_STAGE_TYPES; ++stage) {
+            _stageRowBandSizes[stage][resolutionClass] = static_cast<int>(stages[STAGE_NAMES[stage]].asNumber());
+        }
+
+        if (!stages.isNull()) {
+            tunedClasses += std::string(" ") + RESOLUTION_CLASS_NAMES[resolutionClass];
+        }
+    }
+
+    std::cout << "# Load tuning profile from " << filename << ": "
+              << _numThreads << " threads, row band sizes tuned for"
+              << (tunedClasses.empty() ? " no image size" : tunedClasses)
+              << std::endl;
+
+    return true;
+}
+
+bool TuningProfile::save(const std::string& filename) const {
+    JsonValue profile = JsonValue::object();
+    profile.set("host",        systemUtils::hostName());
+    profile.set("cpus",        static_cast<int>(std::thread::hardware_concurrency()));
+    profile.set("threads",     _numThreads);
+
+    JsonValue rowBandSizes = JsonValue::object();
+    for (int resolutionClass = 0; resolutionClass < TaskScheduler::NUM_RESOLUTION_CLASSES; ++resolutionClass) {
+        JsonValue stages  = JsonValue::object();
+        bool      isTuned = false;
+        for (int stage = 0; stage < TaskScheduler::NUM_STAGE_TYPES; ++stage) {
+            const int rowBandSize = _stageRowBandSizes[stage][resolutionClass];
+            if (rowBandSize > 0) {
+                stages.set(STAGE_NAMES[stage], rowBandSize);
+                isTuned = true;
+            }
+        }
+
+        if (isTuned) {
+            rowBandSizes.set(RESOLUTION_CLASS_NAMES[resolutionClass], stages);
+        }
+    }
+    profile.set("rowBandSizes", rowBandSizes);
+
+    std::ofstream file(filename);
+    file << profile.dump() << std::endl;
+
+    if (!file) {
+        std::cout << "Tuning profile can't be written: " << filename
+                  << std::endl;
+
+        return false;
+    }
+
+    std::cout << "# Save tuning profile to " << filename
+              << std::endl;
+
+    return true;
+}
+
+std::string TuningProfile::defaultFilename() {
+    const char* const profile = std::getenv("SHDR_PROFILE");
+    if (profile && profile[0] != '\0') {
+        return profile;
+    }
+
+    const char* const home = std::getenv("HOME");
+
+    return (home && home[0] != '\0') ?
+        std::string(home) + "/.shdr_profile.json" : ".shdr_profile.json";
+}
+
+std::string TuningProfile::resolutionClassName(const int resolutionClass) {
+    return RESOLUTION_CLASS_NAMES[resolutionClass];
+}
+
+} // namespace shdr
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "core/taskScheduler.h"
+
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    TuningProfile holds the task scheduler settings that ran
+    fastest on a host: the number of threads, and the row band
+    size of each pipeline stage, which is the tile its row
+    parallel kernels work on. Row band sizes are kept per
+    resolution class, since the best grain depends on the
+    image size as much as on the cores and caches.
+
+    It is measured once per host by AutoTuner and loaded by
+    normal runs at startup. The profile records the host and
+    its core count, a profile of another host (e.g. found in a
+    shared home directory) is not applied.
+*/
+class TuningProfile {
+public:
+    TuningProfile();
+    explicit TuningProfile(const int numThreads);
+
+    int  numThreads() const;
+    void setNumThreads(const int numThreads);
+
+    // 0 where the stage wasn't tuned on the resolution class
+    int  stageRowBandSize(const StageType stage, const int resolutionClass) const;
+    void setStageRowBandSize(const StageType stage, const int resolutionClass, const int rowBandSize);
+
+    // set the row band sizes of every tuned stage on the task scheduler
+    void apply() const;
+
+    // returns false if the file can't be read or belongs to another host
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+    // $SHDR_PROFILE if set, otherwise .shdr_profile.json in $HOME
+    static std::string defaultFilename();
+
+    // e.g. "4MP" for images of 1 to 4 megapixels
+    static std::string resolutionClassName(const int resolutionClass);
+
+private:
+    int _numThreads;
+
+    // [stage][resolution class]
+    std::vector<std::vector<int>> _stageRowBandSizes;
+};
+
+// header implementation
+
+inline int TuningProfile::numThreads() const {
+    return _numThreads;
+}
+
+inline void TuningProfile::setNumThreads(const int numThreads) {
+    _numThreads = numThreads;
+}
+
+inline int TuningProfile::stageRowBandSize(const StageType stage, const int resolutionClass) const {
+    return _stageRowBandSizes[static_cast<int>(stage)][resolutionClass];
+}
+
+inline void TuningProfile::setStageRowBandSize(const StageType stage,
+                                               const int       resolutionClass,
+                                               const int       rowBandSize) {
+
+    _stageRowBandSizes[static_cast<int>(stage)][resolutionClass] = rowBandSize;
+}
+
+} // namespace shdr
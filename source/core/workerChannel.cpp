@@ -0,0 +1,227 @@
+#include "core/workerChannel.h"
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <csignal>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+    #define SHDR_HAS_PROCESS_WORKER
+#endif
+
+namespace shdr {
+
+ProcessWorkerChannel::ProcessWorkerChannel() :
+    _pid(-1),
+    _inFd(-1),
+    _outFd(-1),
+    _name("process"),
+    _pending() {
+}
+
+ProcessWorkerChannel::~ProcessWorkerChannel() {
+    close();
+}
+
+bool ProcessWorkerChannel::start(const std::string& executable, const std::vector<std::string>& args) {
+#ifdef SHDR_HAS_PROCESS_WORKER
+    // a worker dying while we write must not end the coordinator
+    signal(SIGPIPE, SIG_IGN);
+
+    int inPipe[2];
+    int outPipe[2];
+    if (pipe(inPipe) != 0) {
+        return false;
+    }
+    if (pipe(outPipe) != 0) {
+        ::close(inPipe[0]);
+        ::close(inPipe[1]);
+
+        return false;
+    }
+
+    // later workers must not inherit this worker's pipes, or its input never ends
+    for (const int fd : { inPipe[0], inPipe[1], outPipe[0], outPipe[1] }) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        ::close(inPipe[0]);
+        ::close(inPipe[1]);
+        ::close(outPipe[0]);
+        ::close(outPipe[1]);
+
+        return false;
+    }
+
+    if (pid == 0) {
+        /*
+            Worker side: requests on stdin, responses on stdout,
+            progress output of the worker is dropped
+        */
+        dup2(inPipe[0], STDIN_FILENO);
+        dup2(outPipe[1], STDOUT_FILENO);
+
+        const int nullFd = open("/dev/null", O_WRONLY);
+        if (nullFd >= 0) {
+            dup2(nullFd, STDERR_FILENO);
+            ::close(nullFd);
+        }
+
+        ::close(inPipe[0]);
+        ::close(inPipe[1]);
+        ::close(outPipe[0]);
+        ::close(outPipe[1]);
+
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(executable.c_str()));
+        for (const std::string& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        // looked up in PATH like the shell did for the coordinator
+        execvp(executable.c_str(), argv.data());
+        _exit(127);
+    }
+
+    ::close(inPipe[0]);
+    ::close(outPipe[1]);
+
+    _pid   = static_cast<int>(pid);
+    _inFd  = inPipe[1];
+    _outFd = outPipe[0];
+    _name  = "process " + std::to_string(_pid);
+
+    return true;
+
+#else
+    std::cout << "Local worker processes need a POSIX system"
+              << std::endl;
+
+    return false;
+
+#endif
+}
+
+bool ProcessWorkerChannel::send(const std::string& line) {
+#ifdef SHDR_HAS_PROCESS_WORKER
+    if (_inFd < 0) {
+        return false;
+    }
+
+    const std::string text = line + "\n";
+
+    std::size_t numWritten = 0;
+    while (numWritten < text.size()) {
+        const ssize_t n = write(_inFd, text.data() + numWritten, text.size() - numWritten);
+        if (n <= 0) {
+            return false;
+        }
+
+        numWritten += static_cast<std::size_t>(n);
+    }
+
+    return true;
+
+#else
+    return false;
+
+#endif
+}
+
+bool ProcessWorkerChannel::receive(std::string* const out_line, const int timeoutMs) {
+#ifdef SHDR_HAS_PROCESS_WORKER
+    if (_outFd < 0) {
+        return false;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while (true) {
+        const std::size_t newline = _pending.find('\n');
+        if (newline != std::string::npos) {
+            *out_line = _pending.substr(0, newline);
+            _pending.erase(0, newline + 1);
+
+            return true;
+        }
+
+        /*
+            Wait for output until the deadline, a worker that
+            doesn't answer in time is hung (or far too slow)
+        */
+        if (timeoutMs >= 0) {
+            const auto remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+
+            pollfd outPoll = { _outFd, POLLIN, 0 };
+            const int numReady = (remainingMs > 0) ? 
+                poll(&outPoll, 1, static_cast<int>(remainingMs)) : 0;
+            if (numReady < 0 && errno == EINTR) {
+                continue;
+            }
+            if (numReady == 0) {
+                std::cout << "Worker " << _name << " didn't answer within " << timeoutMs << " ms, kill it"
+                          << std::endl;
+
+                kill();
+
+                return false;
+            }
+        }
+
+        char buffer[4096];
+        const ssize_t n = read(_outFd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+
+        _pending.append(buffer, static_cast<std::size_t>(n));
+    }
+
+#else
+    return false;
+
+#endif
+}
+
+std::string ProcessWorkerChannel::name() const {
+    return _name;
+}
+
+void ProcessWorkerChannel::close() {
+#ifdef SHDR_HAS_PROCESS_WORKER
+    if (_inFd >= 0) {
+        ::close(_inFd);
+        _inFd = -1;
+    }
+    if (_outFd >= 0) {
+        ::close(_outFd);
+        _outFd = -1;
+    }
+    if (_pid > 0) {
+        waitpid(static_cast<pid_t>(_pid), nullptr, 0);
+        _pid = -1;
+    }
+
+#endif
+}
+
+void ProcessWorkerChannel::kill() {
+#ifdef SHDR_HAS_PROCESS_WORKER
+    if (_pid > 0) {
+        ::kill(static_cast<pid_t>(_pid), SIGKILL);
+    }
+
+#endif
+    close();
+}
+
+} // namespace shdr
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace shdr {
+
+/*
+    WorkerChannel is a line-based, bidirectional link to one
+    worker speaking the job server protocol: a request line is
+    sent and exactly one response line comes back.
+
+    The coordinator only talks to channels, so workers may be
+    local processes (ProcessWorkerChannel) or live elsewhere.
+*/
+class WorkerChannel {
+public:
+    virtual ~WorkerChannel() = default;
+
+    // returns false once the worker can't be reached anymore,
+    // a worker that doesn't answer within timeoutMs (< 0 waits
+    // forever) is given up and can't be reached anymore either
+    virtual bool send(const std::string& line) = 0;
+    virtual bool receive(std::string* const out_line, const int timeoutMs) = 0;
+
+    // name used in reports
+    virtual std::string name() const = 0;
+};
+
+/*
+    A local Simple-HDR process running as a stdin job 
+    server, requests go to its stdin and responses come
+    from its stdout (POSIX only)
+*/
+class ProcessWorkerChannel : public WorkerChannel {
+public:
+    ProcessWorkerChannel();
+    ~ProcessWorkerChannel() override;
+
+    // returns false if the process can't be started
+    bool start(const std::string& executable, const std::vector<std::string>& args);
+
+    bool send(const std::string& line) override;
+    bool receive(std::string* const out_line, const int timeoutMs) override;
+
+    std::string name() const override;
+
+    // ends the worker's input and waits for it to exit
+    void close();
+
+    // kills a hung worker and closes the channel
+    void kill();
+
+private:
+    int         _pid;
+    int         _inFd;
+    int         _outFd;
+    std::string _name;
+    std::string _pending;
+};
+
+} // namespace shdr
@@ -1,5 +1,6 @@
 #include "crfSolver/debevecCrfSolver.h"
 
+#include "core/taskScheduler.h"
 #include "mathUtils.h"
 
 #include <iostream>
@@ -38,9 +39,10 @@ DebevecCrfSolver::DebevecCrfSolver(const DwfType& type,
     }
 }
 
-void DebevecCrfSolver::_solveImpl(const std::vector<cv::Mat>& images, 
-                                  const std::vector<float>&   shutterSpeeds, 
-                                  cv::Mat* const              out_hdri) const {
+void DebevecCrfSolver::_solveCrfImpl(const std::vector<cv::Mat>&   images, 
+                                     const std::vector<cv::Point>& offsets,
+                                     const std::vector<float>&     shutterSpeeds, 
+                                     cv::Mat* const                out_crf) const {
 
     std::cout << "# Begin to reconstruct CRF using Debevec's method"
               << std::endl;
@@ -48,8 +50,6 @@ void DebevecCrfSolver::_solveImpl(const std::vector<cv::Mat>& images,
     const int width     = images.at(0).cols;
     const int height    = images.at(0).rows;
     const int numImages = static_cast<int>(images.size());
-    
-    cv::Mat hdri = cv::Mat::zeros(height, width, CV_32FC3);
 
     /*
         First, generate sample points
@@ -69,54 +69,60 @@ void DebevecCrfSolver::_solveImpl(const std::vector<cv::Mat>& images,
         logG means camera response function
     */
     cv::Mat g = cv::Mat::zeros(256, 1, CV_32FC3);
-    for (int c = 0; c < 3; ++c) {
-        cv::Mat A = cv::Mat::zeros(_numSamples * numImages + 1 + 254, 
-                                   256 + _numSamples, 
-                                   CV_32FC1);
+    // channels are independent systems, solve them in parallel
+    TaskScheduler::instance().parallelFor(0, 3, 1, [&](const int begin, const int end) {
+        for (int c = begin; c < end; ++c) {
+            cv::Mat A = _scratch(_numSamples * numImages + 1 + 254, 
+                                 256 + _numSamples, 
+                                 CV_32FC1);
         
-        cv::Mat b = cv::Mat::zeros(_numSamples * numImages + 1 + 254, 
-                                   1, 
-                                   CV_32FC1);
-
-        /*
-            Start to fill in value in A and b
-        */
-        int line = 0;
-        for (int n = 0; n < numImages; ++n) {
-            const cv::Mat& nowImage = images[n];
-
-            for (int sample = 0; sample < _numSamples; ++sample, ++line) {
-                const int z = static_cast<int>(
-                    nowImage.at<cv::Vec3b>(sampleY[sample], sampleX[sample])[c]);
-
-                A.at<float>(line, z)            = 1.0f * _weight[z];
-                A.at<float>(line, 256 + sample) = -1.0f * _weight[z];
+            cv::Mat b = _scratch(_numSamples * numImages + 1 + 254, 
+                                 1, 
+                                 CV_32FC1);
+
+            A.setTo(0.0f);
+            b.setTo(0.0f);
+
+            /*
+                Start to fill in value in A and b
+            */
+            int line = 0;
+            for (int n = 0; n < numImages; ++n) {
+                const cv::Mat& nowImage = images[n];
+
+                for (int sample = 0; sample < _numSamples; ++sample, ++line) {
+                    const int z = static_cast<int>(
+                        _translatedPixel(nowImage, offsets[n], sampleX[sample], sampleY[sample])[c]);
+
+                    A.at<float>(line, z)            = 1.0f * _weight[z];
+                    A.at<float>(line, 256 + sample) = -1.0f * _weight[z];
 				
-                b.at<float>(line, 0)            = std::log(shutterSpeeds[n]) * _weight[z];
+                    b.at<float>(line, 0)            = std::log(shutterSpeeds[n]) * _weight[z];
+                }
+            }
+            A.at<float>(line, 127) = 1.0f;
+            ++line;
+            for (int ix = 1; ix < 255; ++ix, ++line) {
+                A.at<float>(line, ix - 1) = _lambda * _weight[ix];
+                A.at<float>(line, ix)     = -2.0f * _lambda * _weight[ix];
+                A.at<float>(line, ix + 1) = _lambda * _weight[ix];
             }
-        }
-        A.at<float>(line, 127) = 1.0f;
-        ++line;
-        for (int ix = 1; ix < 255; ++ix, ++line) {
-            A.at<float>(line, ix - 1) = _lambda * _weight[ix];
-            A.at<float>(line, ix)     = -2.0f * _lambda * _weight[ix];
-            A.at<float>(line, ix + 1) = _lambda * _weight[ix];
-        }
 
-        /*
-            Use SVD to find invA, then x = invA * x
-        */
-        cv::Mat invA;
-        cv::invert(A, invA, cv::DECOMP_SVD);
-        const cv::Mat x = invA * b;
-
-        /*
-            First 256 values are what we want, i.e. g(0) ~ g(255)
-        */
-        for (int iy = 0; iy < 256; ++iy) {
-            g.at<cv::Vec3f>(iy, 0)[c] = x.at<float>(iy, 0);
+            /*
+                Use SVD to find invA, then x = invA * x
+            */
+            cv::Mat invA = _scratch(A.cols, A.rows, CV_32FC1);
+            cv::invert(A, invA, cv::DECOMP_SVD);
+            const cv::Mat x = invA * b;
+
+            /*
+                First 256 values are what we want, i.e. g(0) ~ g(255)
+            */
+            for (int iy = 0; iy < 256; ++iy) {
+                g.at<cv::Vec3f>(iy, 0)[c] = x.at<float>(iy, 0);
+            }
         }
-    }
+    });
 
     /*
         Clear sample point buffer
@@ -124,41 +130,27 @@ void DebevecCrfSolver::_solveImpl(const std::vector<cv::Mat>& images,
     sampleX.reset();
     sampleY.reset();
 
-    /*
-        Begin to construct HDR radiance map (hdri),
-        for each channel,  each pixel,
-        calculate its weighted radiance sum
-    */
-    cv::Mat weightSum = cv::Mat::zeros(height, width, CV_32FC3);
-    // number of images
-    for (int n = 0; n < numImages; ++n) {
-        const cv::Mat& nowImage = images[n];
-        // image y
-        for (int iy = 0; iy < height; ++iy) {
-            // image x
-            for (int ix = 0; ix < width; ++ix) {
-                // three color channel
-                for (int c = 0; c < 3; ++c) {
-                    const int   z   = static_cast<int>(nowImage.at<cv::Vec3b>(iy, ix)[c]);
-                    const float lnE = g.at<cv::Vec3f>(z, 0)[c] - std::log(shutterSpeeds[n]);
-
-                    hdri.at<cv::Vec3f>(iy, ix)[c]      += _weight[z] * lnE;
-                    weightSum.at<cv::Vec3f>(iy, ix)[c] += _weight[z];
-                }
-            }
-        }
+    *out_crf = g;
 
-        std::cout << "    Finish CRF reconstruction of image " << (n + 1)
-                  << std::endl;
-    }
+    std::cout << "# Finish reconstructing CRF"
+              << std::endl;
+}
 
-    cv::divide(hdri, weightSum, hdri);
-    cv::exp(hdri, hdri);
+void DebevecCrfSolver::_mergeImpl(const std::vector<cv::Mat>& images, 
+                                  const std::vector<float>&   shutterSpeeds, 
+                                  const cv::Mat&              crf,
+                                  cv::Mat* const              out_hdri,
+                                  ToneStatistics* const       out_statistics) const {
 
-    *out_hdri = hdri;
+    _mergeWithCurve(images, shutterSpeeds, crf, _weight.get(), out_hdri, out_statistics);
+}
 
-    std::cout << "# Finish reconstructing CRF"
-              << std::endl;
+void DebevecCrfSolver::_accumulateImpl(const cv::Mat&             image,
+                                       const float                shutterSpeed,
+                                       const cv::Mat&             crf,
+                                       RadianceAccumulator* const inout_accumulator) const {
+
+    _accumulateWithCurve(image, shutterSpeed, crf, _weight.get(), inout_accumulator);
 }
 
 } // namespace shdr
\ No newline at end of file
@@ -25,9 +25,21 @@ public:
                      const float    lambda);
 
 private:
-    void _solveImpl(const std::vector<cv::Mat>& images,
+    void _solveCrfImpl(const std::vector<cv::Mat>&   images,
+                       const std::vector<cv::Point>& offsets,
+                       const std::vector<float>&     shutterSpeeds,
+                       cv::Mat* const                out_crf) const override;
+
+    void _mergeImpl(const std::vector<cv::Mat>& images,
                     const std::vector<float>&   shutterSpeeds,
-                    cv::Mat* const              out_hdri) const override;
+                    const cv::Mat&              crf,
+                    cv::Mat* const              out_hdri,
+                    ToneStatistics* const       out_statistics) const override;
+
+    void _accumulateImpl(const cv::Mat&             image,
+                         const float                shutterSpeed,
+                         const cv::Mat&             crf,
+                         RadianceAccumulator* const inout_accumulator) const override;
 
     std::unique_ptr<float[]> _weight;
     int                      _numSamples;
@@ -0,0 +1,303 @@
+#include "crfSolver/mitsunagaNayarCrfSolver.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+
+namespace shdr {
+
+namespace {
+
+// pixel values outside are too noisy or saturated to pair
+constexpr int MIN_VALID_VALUE = 5;
+constexpr int MAX_VALID_VALUE = 250;
+
+// highest polynomial order supported
+constexpr int MAX_ORDER = 15;
+
+// smallest value of f^-1 before taking the log
+constexpr double MIN_RESPONSE = 1e-6;
+
+// a higher order has to lower the error by this ratio to be chosen
+constexpr double ORDER_IMPROVEMENT = 0.99;
+
+} // anonymous namespace
+
+MitsunagaNayarCrfSolver::MitsunagaNayarCrfSolver() :
+    MitsunagaNayarCrfSolver(6) {
+}
+
+MitsunagaNayarCrfSolver::MitsunagaNayarCrfSolver(const int maxOrder) :
+    _weight(),
+    _maxOrder(std::min(std::max(maxOrder, 1), MAX_ORDER)) {
+
+    // hat function, the ends keep a small weight so that
+    // pixels saturated in every exposure still get a value
+    _weight.reset(new float[256]);
+    for (int z = 0; z < 256; ++z) {
+        _weight[z] = static_cast<float>(std::min(z + 1, 256 - z)) / 128.0f;
+    }
+}
+
+void MitsunagaNayarCrfSolver::_solveCrfImpl(const std::vector<cv::Mat>&   images,
+                                            const std::vector<cv::Point>& offsets,
+                                            const std::vector<float>&     shutterSpeeds,
+                                            cv::Mat* const                out_crf) const {
+
+    std::cout << "# Begin to reconstruct CRF using Mitsunaga and Nayar's method"
+              << std::endl;
+
+    const int numImages = static_cast<int>(images.size());
+    const int numTerms  = _maxOrder + 1;
+
+    /*
+        First, pair exposures adjacent in shutter speed,
+        for each pair (a, b) and radiance E
+
+            f^-1(M_a) = E * t_a = (t_a / t_b) * f^-1(M_b)
+    */
+    std::vector<int> sortedIndices(numImages);
+    std::iota(sortedIndices.begin(), sortedIndices.end(), 0);
+    std::sort(sortedIndices.begin(), sortedIndices.end(), [&](const int a, const int b) {
+        return shutterSpeeds[a] < shutterSpeeds[b];
+    });
+
+    const int numPairs = std::max(numImages - 1, 0);
+
+    /*
+        Count every valid pixel pair in a joint histogram
+        per exposure pair and channel, each histogram is
+        owned by one task so no merging is needed,
+        pixels are counted where the aligned images 
+        would have them
+    */
+    std::vector<std::vector<std::uint32_t>> histograms(numPairs * 3);
+    TaskScheduler::instance().parallelFor(0, numPairs * 3, 1, [&](const int begin, const int end) {
+        for (int task = begin; task < end; ++task) {
+            const int        pair    = task / 3;
+            const int        c       = task % 3;
+            const cv::Mat&   imageA  = images[sortedIndices[pair]];
+            const cv::Mat&   imageB  = images[sortedIndices[pair + 1]];
+            const cv::Point& offsetA = offsets[sortedIndices[pair]];
+            const cv::Point& offsetB = offsets[sortedIndices[pair + 1]];
+
+            std::vector<std::uint32_t>& histogram = histograms[task];
+            histogram.assign(256 * 256, 0);
+
+            if (offsetA == cv::Point(0, 0) && offsetB == cv::Point(0, 0)) {
+                for (int iy = 0; iy < imageA.rows; ++iy) {
+                    const cv::Vec3b* rowA = imageA.ptr<cv::Vec3b>(iy);
+                    const cv::Vec3b* rowB = imageB.ptr<cv::Vec3b>(iy);
+                    for (int ix = 0; ix < imageA.cols; ++ix) {
+                        ++histogram[(rowA[ix][c] << 8) | rowB[ix][c]];
+                    }
+                }
+
+                continue;
+            }
+
+            for (int iy = 0; iy < imageA.rows; ++iy) {
+                for (int ix = 0; ix < imageA.cols; ++ix) {
+                    const int zA = _translatedPixel(imageA, offsetA, ix, iy)[c];
+                    const int zB = _translatedPixel(imageB, offsetB, ix, iy)[c];
+                    ++histogram[(zA << 8) | zB];
+                }
+            }
+        }
+    });
+
+    /*
+        Gram matrix of the pair terms d_k = M_a^k - R * M_b^k
+        per channel, summed over the histogram bins
+    */
+    double power[256][MAX_ORDER + 1];
+    for (int z = 0; z < 256; ++z) {
+        const double m = static_cast<double>(z) / 255.0;
+        power[z][0] = 1.0;
+        for (int k = 1; k < numTerms; ++k) {
+            power[z][k] = power[z][k - 1] * m;
+        }
+    }
+
+    cv::Mat crf = cv::Mat::zeros(256, 1, CV_32FC3);
+    for (int c = 0; c < 3; ++c) {
+        cv::Mat gram      = cv::Mat::zeros(numTerms, numTerms, CV_64FC1);
+        double  numPixels = 0.0;
+
+        std::vector<double> d(numTerms);
+        for (int pair = 0; pair < numPairs; ++pair) {
+            const double ratio = static_cast<double>(shutterSpeeds[sortedIndices[pair]]) /
+                                 static_cast<double>(shutterSpeeds[sortedIndices[pair + 1]]);
+
+            const std::vector<std::uint32_t>& histogram = histograms[pair * 3 + c];
+            for (int za = MIN_VALID_VALUE; za <= MAX_VALID_VALUE; ++za) {
+                for (int zb = MIN_VALID_VALUE; zb <= MAX_VALID_VALUE; ++zb) {
+                    const double count = static_cast<double>(histogram[(za << 8) | zb]);
+                    if (count == 0.0) {
+                        continue;
+                    }
+
+                    for (int k = 0; k < numTerms; ++k) {
+                        d[k] = power[za][k] - ratio * power[zb][k];
+                    }
+                    for (int i = 0; i < numTerms; ++i) {
+                        double* gramRow = gram.ptr<double>(i);
+                        for (int j = 0; j < numTerms; ++j) {
+                            gramRow[j] += count * d[i] * d[j];
+                        }
+                    }
+                    numPixels += count;
+                }
+            }
+        }
+
+        /*
+            Try each order, a higher one only wins
+            if it lowers the error noticeably
+        */
+        std::vector<double> coefficients = { 0.0, 1.0 };
+        double              bestError    = 0.0;
+        int                 bestOrder    = 0;
+        if (numPixels > 0.0) {
+            gram /= numPixels;
+
+            for (int n = 1; n <= _maxOrder; ++n) {
+                std::vector<double> nowCoefficients;
+                double              nowError;
+                if (!_fitPolynomial(gram, n, &nowCoefficients, &nowError)) {
+                    continue;
+                }
+
+                if (bestOrder == 0 || nowError < bestError * ORDER_IMPROVEMENT) {
+                    coefficients = nowCoefficients;
+                    bestError    = nowError;
+                    bestOrder    = n;
+                }
+            }
+        }
+
+        if (bestOrder == 0) {
+            std::cout << "    Channel " << c
+                      << ": no valid pixel pairs or monotonic fit, use linear response instead"
+                      << std::endl;
+        }
+        else {
+            std::cout << "    Channel " << c
+                      << ": order = " << bestOrder << ", error = " << bestError
+                      << std::endl;
+        }
+
+        _expandCurve(coefficients, c, &crf);
+    }
+
+    *out_crf = crf;
+
+    std::cout << "# Finish reconstructing CRF"
+              << std::endl;
+}
+
+void MitsunagaNayarCrfSolver::_mergeImpl(const std::vector<cv::Mat>& images,
+                                         const std::vector<float>&   shutterSpeeds,
+                                         const cv::Mat&              crf,
+                                         cv::Mat* const              out_hdri,
+                                         ToneStatistics* const       out_statistics) const {
+
+    _mergeWithCurve(images, shutterSpeeds, crf, _weight.get(), out_hdri, out_statistics);
+}
+
+void MitsunagaNayarCrfSolver::_accumulateImpl(const cv::Mat&             image,
+                                              const float                shutterSpeed,
+                                              const cv::Mat&             crf,
+                                              RadianceAccumulator* const inout_accumulator) const {
+
+    _accumulateWithCurve(image, shutterSpeed, crf, _weight.get(), inout_accumulator);
+}
+
+bool MitsunagaNayarCrfSolver::_fitPolynomial(const cv::Mat&             gram,
+                                             const int                  order,
+                                             std::vector<double>* const out_coefficients,
+                                             double* const              out_error) const {
+
+    /*
+        Substitute c_N = 1 - sum_{k < N} c_k into the error
+        sum_p (sum_k c_k d_k)^2, its normal equations are
+
+            sum_j (G_ij - G_iN - G_Nj + G_NN) c_j = G_NN - G_iN
+    */
+    const int n = order;
+
+    cv::Mat A(n, n, CV_64FC1);
+    cv::Mat b(n, 1, CV_64FC1);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            A.at<double>(i, j) = gram.at<double>(i, j) - gram.at<double>(i, n) -
+                                 gram.at<double>(n, j) + gram.at<double>(n, n);
+        }
+        b.at<double>(i, 0) = gram.at<double>(n, n) - gram.at<double>(i, n);
+    }
+
+    cv::Mat x;
+    if (!cv::solve(A, b, x, cv::DECOMP_SVD)) {
+        return false;
+    }
+
+    std::vector<double> coefficients(n + 1);
+    double              lastCoefficient = 1.0;
+    for (int k = 0; k < n; ++k) {
+        coefficients[k]  = x.at<double>(k, 0);
+        lastCoefficient -= coefficients[k];
+    }
+    coefficients[n] = lastCoefficient;
+
+    // the inverse response has to increase over the valid range
+    double previous = -1.0;
+    for (int z = MIN_VALID_VALUE; z < 256; ++z) {
+        const double m = static_cast<double>(z) / 255.0;
+
+        double value = 0.0;
+        for (int k = n; k >= 0; --k) {
+            value = value * m + coefficients[k];
+        }
+        if (value <= 0.0 || value < previous) {
+            return false;
+        }
+        previous = value;
+    }
+
+    double error = 0.0;
+    for (int i = 0; i <= n; ++i) {
+        for (int j = 0; j <= n; ++j) {
+            error += coefficients[i] * gram.at<double>(i, j) * coefficients[j];
+        }
+    }
+
+    *out_coefficients = coefficients;
+    *out_error        = error;
+
+    return true;
+}
+
+void MitsunagaNayarCrfSolver::_expandCurve(const std::vector<double>& coefficients,
+                                           const int                  channel,
+                                           cv::Mat* const             inout_crf) {
+
+    const int order = static_cast<int>(coefficients.size()) - 1;
+    for (int z = 0; z < 256; ++z) {
+        // half a step keeps f^-1(0) above zero for curves through the origin
+        const double m = std::max(static_cast<double>(z), 0.5) / 255.0;
+
+        double value = 0.0;
+        for (int k = order; k >= 0; --k) {
+            value = value * m + coefficients[k];
+        }
+
+        inout_crf->at<cv::Vec3f>(z, 0)[channel] =
+            static_cast<float>(std::log(std::max(value, MIN_RESPONSE)));
+    }
+}
+
+} // namespace shdr
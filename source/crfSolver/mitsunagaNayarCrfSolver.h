@@ -0,0 +1,63 @@
+#pragma once
+
+#include "core/crfSolver.h"
+
+#include <memory>
+
+namespace shdr {
+
+/*
+    Mitsunaga and Nayar model the inverse response as a
+    polynomial of the normalized pixel value M in [0, 1],
+
+        f^-1(M) = sum_k c_k M^k,  with f^-1(1) = 1
+
+    and fit it to pixel pairs of exposures with known ratio.
+    The normal equations are only order x order, so every valid
+    pixel pair of the image set is used: pairs are first counted
+    in a joint histogram of pixel values, the polynomial terms
+    are summed over its 256x256 bins afterwards.
+
+    Orders 1 ~ maxOrder are tried, the monotonic curve with the
+    smallest error wins. The coefficients are expanded into the
+    same log response lookup table the merge stage uses.
+*/
+class MitsunagaNayarCrfSolver : public CrfSolver {
+public:
+    MitsunagaNayarCrfSolver();
+    explicit MitsunagaNayarCrfSolver(const int maxOrder);
+
+private:
+    void _solveCrfImpl(const std::vector<cv::Mat>&   images,
+                       const std::vector<cv::Point>& offsets,
+                       const std::vector<float>&     shutterSpeeds,
+                       cv::Mat* const                out_crf) const override;
+
+    void _mergeImpl(const std::vector<cv::Mat>& images,
+                    const std::vector<float>&   shutterSpeeds,
+                    const cv::Mat&              crf,
+                    cv::Mat* const              out_hdri,
+                    ToneStatistics* const       out_statistics) const override;
+
+    void _accumulateImpl(const cv::Mat&             image,
+                         const float                shutterSpeed,
+                         const cv::Mat&             crf,
+                         RadianceAccumulator* const inout_accumulator) const override;
+
+    // fit coefficients c_0 ~ c_order from the gram matrix of the
+    // pair terms, returns false if the fitted curve is not monotonic
+    bool _fitPolynomial(const cv::Mat&             gram,
+                        const int                  order,
+                        std::vector<double>* const out_coefficients,
+                        double* const              out_error) const;
+
+    // ln(f^-1(z / 255)) for z = 0 ~ 255
+    static void _expandCurve(const std::vector<double>& coefficients,
+                             const int                  channel,
+                             cv::Mat* const             inout_crf);
+
+    std::unique_ptr<float[]> _weight;
+    int                      _maxOrder;
+};
+
+} // namespace shdr
@@ -1,128 +1,133 @@
 #include "imageAligner/mtbImageAligner.h"
 
+#include "core/taskScheduler.h"
 #include "mathUtils.h"
 
+#include <cstring>
+#include <exception>
+#include <iostream>
 #include <limits>
 
 namespace shdr {
 
-MtbImageAligner::MtbImageAligner() = default;
+MtbImageAligner::MtbImageAligner() :
+    ImageAligner(),
+    _referenceMutex(),
+    _cachedReferenceKey(),
+    _cachedReferencePyramid(),
+    _cachedReference() {
+}
 
-void MtbImageAligner::align(const std::vector<cv::Mat>& images,
-                            std::vector<cv::Mat>* const out_alignImages) const {
+void MtbImageAligner::_alignImageImpl(const cv::Mat&   reference,
+                                      const cv::Mat&   image,
+                                      const bool       isWarmStart,
+                                      cv::Point* const inout_offset,
+                                      cv::Mat* const   out_alignImage) const {
 
-    std::cout << "# Begin to align images using MTB method"
-              << std::endl;
+    _findOffsetImpl(reference, image, isWarmStart, inout_offset);
 
-    out_alignImages->reserve(images.size());
+    /*
+        After we find the best movement,
+        we need to translate image with it
+    */
+    cv::Mat bestTranslation;
+    mathUtils::getTranslationMatrix(inout_offset->x, inout_offset->y, &bestTranslation);
 
-    const int numImages = static_cast<int>(images.size());
-    const int middle    = numImages / 2;
+    cv::Mat alignImage = _scratch(image.rows, image.cols, image.type());
+    cv::warpAffine(image, alignImage, bestTranslation, image.size());
 
-    std::cout << "    Using image " << (middle + 1) << " as center image"
-              << std::endl;
+    *out_alignImage = alignImage;
+}
+
+void MtbImageAligner::_findOffsetImpl(const cv::Mat&   reference,
+                                      const cv::Mat&   image,
+                                      const bool       isWarmStart,
+                                      cv::Point* const inout_offset) const {
+
+    /*
+        If a previous offset is given, only the finest levels
+        are searched around it instead of the whole pyramid
+    */
+    const int startLevel = isWarmStart ? MAX_MTB_LEVEL - WARM_MTB_LEVEL : 0;
 
     /*
         mainMtb means main median threshold bitmap
         mainEb means main exclusive bitmap
     */
-    std::vector<cv::Mat> mainVecMtb;
-    std::vector<cv::Mat> mainVecEb;
-    _calculateBitmap(images[middle], &mainVecMtb, &mainVecEb);
+    const std::shared_ptr<const BitmapPyramid> mainPyramid = _referencePyramid(reference);
+    const std::vector<cv::Mat>&                mainVecMtb  = mainPyramid->vecMtb;
+    const std::vector<cv::Mat>&                mainVecEb   = mainPyramid->vecEb;
+
+    std::vector<cv::Mat> tmpVecMtb;
+    std::vector<cv::Mat> tmpVecEb;
+    _calculateBitmap(image, &tmpVecMtb, &tmpVecEb);
 
     /*
-        for each image find its best offset that is the closest offset to main image
+        find the best offset that is the closest offset to main image,
+        trace each level of MTB & EB,
+        warm start offset is expressed in the scale
+        of the level before the first searched one
     */
     const int dx[9] = { -1, 0, 1, -1, 0, 1, -1,  0,  1 };
     const int dy[9] = {  1, 1, 1,  0, 0, 0, -1, -1, -1 };
-    for (int n = 0; n < numImages; ++n) {
-        if (n == middle) {
-            out_alignImages->push_back(images[n]);
-        }
 
-        // only align non-center images
-        else {
-            std::vector<cv::Mat> tmpVecMtb;
-            std::vector<cv::Mat> tmpVecEb;
-            _calculateBitmap(images[n], &tmpVecMtb, &tmpVecEb);
+    const int startScale = MAX_MTB_LEVEL - startLevel;
+    int offsetX = isWarmStart ? inout_offset->x / (1 << startScale) : 0;
+    int offsetY = isWarmStart ? inout_offset->y / (1 << startScale) : 0;
+    for (int level = startLevel; level < MAX_MTB_LEVEL; ++level) {
+        const cv::Mat& nowMtb = tmpVecMtb[MAX_MTB_LEVEL - level - 1];
+        const cv::Mat& nowEb  = tmpVecEb[MAX_MTB_LEVEL - level - 1];
 
-            /*
-                trace each level of MTB & EB
-            */
-            int offsetX = 0;
-            int offsetY = 0;
-            for (int level = 0; level < MAX_MTB_LEVEL; ++level) {
-                const cv::Mat& nowMtb = tmpVecMtb[MAX_MTB_LEVEL - level - 1];
-                const cv::Mat& nowEb  = tmpVecEb[MAX_MTB_LEVEL - level - 1];
-
-                const int width  = nowMtb.cols;
-                const int height = nowMtb.rows;
-
-                /*
-                    for each level, offset needs to be multiplied by 2
-                    because image size is also twice than previous one
-                */
-                offsetX *= 2;
-                offsetY *= 2;
-
-                /*
-                    test 9 directions,
-                    find which one has the lowest error
-                */
-                float maxError = std::numeric_limits<float>::max();
-                int dir;
-                for (int idx = 0; idx < 9; ++idx) {
-                    cv::Mat translationMatrix;
-                    mathUtils::getTranslationMatrix(offsetX + dx[idx], offsetY + dy[idx], &translationMatrix);
-
-                    cv::Mat tmpMtb;
-                    cv::Mat tmpEb;
-                    cv::warpAffine(nowMtb, tmpMtb, translationMatrix, nowMtb.size());
-                    cv::warpAffine(nowEb, tmpEb, translationMatrix, nowMtb.size());
-
-                    /*
-                        use XOR to calculate difference pixel value
-                            XOR(A, B) = abs(A-B)
-                        use AND to filter value that is near median value
-                            AND(A, B) = A.mul(B)
-                    */
-                    cv::Mat XOR;
-                    cv::Mat AND;
-                    cv::bitwise_xor(mainVecMtb[MAX_MTB_LEVEL - level - 1], tmpMtb, XOR);
-                    cv::bitwise_and(XOR, mainVecEb[MAX_MTB_LEVEL - level - 1], AND);
-                    cv::bitwise_and(AND, tmpEb, AND);
-
-                    const float error = static_cast<float>(cv::sum(AND)[0]);
-                    if (error < maxError) {
-                        maxError = error;
-                        dir = idx;
-                    }
-                }
+        const int width  = nowMtb.cols;
+        const int height = nowMtb.rows;
 
-                offsetX += dx[dir];
-                offsetY += dy[dir];
-            }
+        cv::Mat tmpMtb = _scratch(height, width, CV_8UC1);
+        cv::Mat tmpEb  = _scratch(height, width, CV_8UC1);
+        cv::Mat XOR    = _scratch(height, width, CV_8UC1);
+        cv::Mat AND    = _scratch(height, width, CV_8UC1);
 
-            /*
-                After we find the best movement,
-                we need to translate image with it
-            */
-            cv::Mat bestTranslation;
-            mathUtils::getTranslationMatrix(offsetX, offsetY, &bestTranslation);
+        /*
+            for each level, offset needs to be multiplied by 2
+            because image size is also twice than previous one
+        */
+        offsetX *= 2;
+        offsetY *= 2;
 
-            cv::Mat alignImage;
-            cv::warpAffine(images[n], alignImage, bestTranslation, images[n].size());
+        /*
+            test 9 directions,
+            find which one has the lowest error
+        */
+        float maxError = std::numeric_limits<float>::max();
+        int dir;
+        for (int idx = 0; idx < 9; ++idx) {
+            cv::Mat translationMatrix;
+            mathUtils::getTranslationMatrix(offsetX + dx[idx], offsetY + dy[idx], &translationMatrix);
 
-            out_alignImages->push_back(alignImage);
+            cv::warpAffine(nowMtb, tmpMtb, translationMatrix, nowMtb.size());
+            cv::warpAffine(nowEb, tmpEb, translationMatrix, nowMtb.size());
 
-            std::cout << "    Image " << (n + 1)
-                      << " max offset: x = " << offsetX << ", y = " << offsetY
-                      << std::endl;
+            /*
+                use XOR to calculate difference pixel value
+                    XOR(A, B) = abs(A-B)
+                use AND to filter value that is near median value
+                    AND(A, B) = A.mul(B)
+            */
+            cv::bitwise_xor(mainVecMtb[MAX_MTB_LEVEL - level - 1], tmpMtb, XOR);
+            cv::bitwise_and(XOR, mainVecEb[MAX_MTB_LEVEL - level - 1], AND);
+            cv::bitwise_and(AND, tmpEb, AND);
+
+            const float error = static_cast<float>(cv::sum(AND)[0]);
+            if (error < maxError) {
+                maxError = error;
+                dir = idx;
+            }
         }
+
+        offsetX += dx[dir];
+        offsetY += dy[dir];
     }
 
-    std::cout << "# Finish aligning images"
-              << std::endl;
+    *inout_offset = cv::Point(offsetX, offsetY);
 }
 
 void MtbImageAligner::_calculateBitmap(const cv::Mat&              image,
@@ -132,57 +137,116 @@ void MtbImageAligner::_calculateBitmap(const cv::Mat&              image,
     out_vecMtb->reserve(MAX_MTB_LEVEL);
     out_vecEb->reserve(MAX_MTB_LEVEL);
 
-    cv::Mat grayImage;
-    cv::cvtColor(image, grayImage, cv::COLOR_BGR2GRAY);
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    std::mutex     histogramMutex;
 
-    for (int level = 0; level < MAX_MTB_LEVEL; ++level) {
-        const int median = _findMedian(grayImage);
-        const int width  = grayImage.cols;
-        const int height = grayImage.rows;
+    /*
+        Gray image and its histogram, in row bands
+    */
+    cv::Mat grayImage = _scratch(image.rows, image.cols, CV_8UC1);
+    int     histogram[256] = { 0 };
+    scheduler.parallelRows(image.rows, [&](const int rowBegin, const int rowEnd) {
+        cv::Mat grayBand = grayImage.rowRange(rowBegin, rowEnd);
+        cv::cvtColor(image.rowRange(rowBegin, rowEnd), grayBand, cv::COLOR_BGR2GRAY);
+
+        int bandHistogram[256] = { 0 };
+        for (int iy = 0; iy < grayBand.rows; ++iy) {
+            const uchar* row = grayBand.ptr<uchar>(iy);
+            for (int ix = 0; ix < grayBand.cols; ++ix) {
+                ++bandHistogram[row[ix]];
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(histogramMutex);
+        for (int i = 0; i < 256; ++i) {
+            histogram[i] += bandHistogram[i];
+        }
+    });
 
-        cv::Mat mtb = cv::Mat::zeros(grayImage.size(), CV_8UC1);
-        cv::Mat eb  = cv::Mat::zeros(grayImage.size(), CV_8UC1);
+    for (int level = 0; level < MAX_MTB_LEVEL; ++level) {
+        const int  width       = grayImage.cols;
+        const int  height      = grayImage.rows;
+        const int  median      = _findMedian(histogram, width * height);
+        const bool isLastLevel = (level == MAX_MTB_LEVEL - 1);
+
+        // every pixel is written below, no need to clear them
+        cv::Mat mtb = _scratch(height, width, CV_8UC1);
+        cv::Mat eb  = _scratch(height, width, CV_8UC1);
+
+        const int nextWidth  = width / 2;
+        const int nextHeight = height / 2;
+        cv::Mat   nextGrayImage;
+        if (!isLastLevel) {
+            nextGrayImage = _scratch(nextHeight, nextWidth, CV_8UC1);
+        }
+        int nextHistogram[256] = { 0 };
 
         /*
-            use median to be the threshold,
-            and check if pixel value is near median
+            One pass per level over pairs of rows: 
+            use median to be the threshold, check if pixel
+            value is near median, and average each 2x2 block 
+            into the next level while counting its histogram
         */
-        for (int iy = 0; iy < height; ++iy) {
-            for (int ix = 0; ix < width; ++ix) {
-                mtb.at<uchar>(iy, ix) = (grayImage.at<uchar>(iy, ix) <= median) ? 0 : 1;
-                eb.at<uchar>(iy, ix)  = (grayImage.at<uchar>(iy, ix) < median - 4 ||
-                                         grayImage.at<uchar>(iy, ix) > median + 4) ? 1 : 0;
+        scheduler.parallelRows((height + 1) / 2, [&](const int pairBegin, const int pairEnd) {
+            int bandHistogram[256] = { 0 };
+            for (int pair = pairBegin; pair < pairEnd; ++pair) {
+                const int rowEnd = std::min(2 * pair + 2, height);
+                for (int iy = 2 * pair; iy < rowEnd; ++iy) {
+                    const uchar* grayRow = grayImage.ptr<uchar>(iy);
+                    uchar*       mtbRow  = mtb.ptr<uchar>(iy);
+                    uchar*       ebRow   = eb.ptr<uchar>(iy);
+                    for (int ix = 0; ix < width; ++ix) {
+                        const int value = grayRow[ix];
+
+                        mtbRow[ix] = static_cast<uchar>(value > median);
+                        ebRow[ix]  = static_cast<uchar>((value < median - 4) | (value > median + 4));
+                    }
+                }
+
+                if (isLastLevel || pair >= nextHeight) {
+                    continue;
+                }
+
+                const uchar* upRow   = grayImage.ptr<uchar>(2 * pair);
+                const uchar* downRow = grayImage.ptr<uchar>(2 * pair + 1);
+                uchar*       nextRow = nextGrayImage.ptr<uchar>(pair);
+                for (int ix = 0; ix < nextWidth; ++ix) {
+                    const int sum = upRow[2 * ix] + upRow[2 * ix + 1] + downRow[2 * ix] + downRow[2 * ix + 1];
+
+                    nextRow[ix] = static_cast<uchar>((sum + 2) >> 2);
+                }
+                for (int ix = 0; ix < nextWidth; ++ix) {
+                    ++bandHistogram[nextRow[ix]];
+                }
             }
-        }
+
+            if (isLastLevel) {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(histogramMutex);
+            for (int i = 0; i < 256; ++i) {
+                nextHistogram[i] += bandHistogram[i];
+            }
+        });
 
         out_vecMtb->push_back(mtb);
         out_vecEb->push_back(eb);
 
-        cv::resize(grayImage, grayImage, cv::Size(width / 2, height / 2));
+        grayImage = nextGrayImage;
+        std::copy(nextHistogram, nextHistogram + 256, histogram);
     }
 }
 
-int MtbImageAligner::_findMedian(const cv::Mat& image) const {
-    const int width  = image.cols;
-    const int height = image.rows;
-    const int middle = (width * height + 1) / 2;
-
-    /*
-        First we calculate the histogram of image
-    */
-    int hist[256] = { 0 };
-    for (int iy = 0; iy < height; ++iy) {
-        for (int ix = 0; ix < width; ++ix) {
-            hist[image.at<uchar>(iy, ix)] += 1;
-        }
-    }
+int MtbImageAligner::_findMedian(const int histogram[256], const int numPixels) const {
+    const int middle = (numPixels + 1) / 2;
 
     /*
-        Second we find cdf that its value is higher than middle (middle means half pixel number)
+        Find cdf that its value is higher than middle (middle means half pixel number)
     */
     int sum = 0;
     for (int i = 0; i < 256; ++i) {
-        sum += hist[i];
+        sum += histogram[i];
         if (sum >= middle) {
             return i;
         }
@@ -194,4 +258,138 @@ int MtbImageAligner::_findMedian(const cv::Mat& image) const {
     return 0;
 }
 
-} // namespace shdr
\ No newline at end of file
+void MtbImageAligner::_clearCacheImpl() const {
+    std::lock_guard<std::mutex> lock(_referenceMutex);
+    _cachedReferenceKey     = ReferenceKey();
+    _cachedReferencePyramid = PyramidFuture();
+    _cachedReference        = cv::Mat();
+}
+
+std::shared_ptr<const MtbImageAligner::BitmapPyramid> 
+MtbImageAligner::_referencePyramid(const cv::Mat& reference) const {
+    /*
+        Aligners of the same reference wait for the first one
+        building its pyramid instead of building it again. 
+        The lock is only held to look up or publish the future,
+        the build itself runs parallel row tasks, which other
+        threads holding the lock could never help with.
+
+        The same buffer is recognized by its pointers, only 
+        another buffer is hashed, e.g. a reloaded reference
+    */
+    std::promise<std::shared_ptr<const BitmapPyramid>> promise;
+    PyramidFuture                                      cachedPyramid;
+    {
+        std::lock_guard<std::mutex> lock(_referenceMutex);
+        if (_cachedReferencePyramid.valid() && _isSameBuffer(_cachedReference, reference)) {
+            cachedPyramid = _cachedReferencePyramid;
+        }
+    }
+
+    if (cachedPyramid.valid()) {
+        return cachedPyramid.get();
+    }
+
+    const ReferenceKey key = _referenceKey(reference);
+    {
+        std::lock_guard<std::mutex> lock(_referenceMutex);
+        if (_cachedReferencePyramid.valid() && _cachedReferenceKey == key) {
+            cachedPyramid = _cachedReferencePyramid;
+        }
+        else {
+            _cachedReferenceKey     = key;
+            _cachedReferencePyramid = promise.get_future().share();
+        }
+        _cachedReference = reference;
+    }
+
+    if (cachedPyramid.valid()) {
+        return cachedPyramid.get();
+    }
+
+    try {
+        auto pyramid = std::make_shared<BitmapPyramid>();
+        _calculateBitmap(reference, &pyramid->vecMtb, &pyramid->vecEb);
+
+        promise.set_value(pyramid);
+
+        return pyramid;
+    }
+    catch (...) {
+        // waiters get the error too, the next aligner builds it again
+        promise.set_exception(std::current_exception());
+
+        std::lock_guard<std::mutex> lock(_referenceMutex);
+        if (_cachedReferenceKey == key) {
+            _cachedReferenceKey     = ReferenceKey();
+            _cachedReferencePyramid = PyramidFuture();
+            _cachedReference        = cv::Mat();
+        }
+
+        throw;
+    }
+}
+
+MtbImageAligner::ReferenceKey MtbImageAligner::_referenceKey(const cv::Mat& reference) {
+    ReferenceKey key;
+    key.rows = reference.rows;
+    key.cols = reference.cols;
+    key.type = reference.type();
+
+    /*
+        Every row is hashed 8 bytes at a time (multiply and
+        xor-shift), the row hashes are then folded in order
+        with FNV-1a, so the key doesn't depend on the bands
+    */
+    const std::size_t          rowBytes = static_cast<std::size_t>(reference.cols) * reference.elemSize();
+    std::vector<std::uint64_t> rowHashes(reference.rows);
+    TaskScheduler::instance().parallelRows(reference.rows, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const uchar*  row  = reference.ptr<uchar>(iy);
+            std::uint64_t hash = rowBytes;
+
+            std::size_t i = 0;
+            for (; i + sizeof(std::uint64_t) <= rowBytes; i += sizeof(std::uint64_t)) {
+                std::uint64_t word;
+                std::memcpy(&word, row + i, sizeof(word));
+
+                hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+                hash ^= hash >> 29;
+            }
+            for (; i < rowBytes; ++i) {
+                hash = (hash ^ row[i]) * 0x9e3779b97f4a7c15ull;
+                hash ^= hash >> 29;
+            }
+
+            rowHashes[iy] = hash;
+        }
+    });
+
+    std::uint64_t checksum = 14695981039346656037ull;
+    for (const std::uint64_t rowHash : rowHashes) {
+        checksum ^= rowHash;
+        checksum *= 1099511628211ull;
+    }
+    key.checksum = checksum;
+
+    return key;
+}
+
+bool MtbImageAligner::_isSameBuffer(const cv::Mat& a, const cv::Mat& b) {
+    return a.data    != nullptr   &&
+           a.data    == b.data    &&
+           a.u       == b.u       &&
+           a.rows    == b.rows    &&
+           a.cols    == b.cols    &&
+           a.type()  == b.type()  &&
+           a.step[0] == b.step[0];
+}
+
+bool MtbImageAligner::ReferenceKey::operator == (const ReferenceKey& other) const {
+    return rows     == other.rows &&
+           cols     == other.cols &&
+           type     == other.type &&
+           checksum == other.checksum;
+}
+
+} // namespace shdr
@@ -2,26 +2,89 @@
 
 #include "core/imageAligner.h"
 
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace shdr {
 
 /*
     MtbImageAligner: Median Threshold Bitmap Image Aligner
+
+    Bitmap pyramids are built in one pass per level, which
+    thresholds the level and box-downsamples it into the next
+    one together with its histogram. The reference pyramid 
+    is cached, so aligning many images (or several batches)
+    against the same reference builds it only once.
+
+    The cache is keyed by a hash of every reference pixel,
+    buffers are often reused for other images. The first
+    aligner of a reference builds its pyramid outside of the
+    lock (the build runs parallel row tasks), aligners of the
+    same reference wait for its shared future.
 */
 class MtbImageAligner : public ImageAligner {
 public:
     MtbImageAligner();
 
-    void align(const std::vector<cv::Mat>& images,
-               std::vector<cv::Mat>* const out_alignImages) const override;
-
 private:
+    void _alignImageImpl(const cv::Mat&   reference,
+                         const cv::Mat&   image,
+                         const bool       isWarmStart,
+                         cv::Point* const inout_offset,
+                         cv::Mat* const   out_alignImage) const override;
+
+    void _findOffsetImpl(const cv::Mat&   reference,
+                         const cv::Mat&   image,
+                         const bool       isWarmStart,
+                         cv::Point* const inout_offset) const override;
+
+    void _clearCacheImpl() const override;
+
+    struct BitmapPyramid {
+        std::vector<cv::Mat> vecMtb;
+        std::vector<cv::Mat> vecEb;
+    };
+
+    using PyramidFuture = std::shared_future<std::shared_ptr<const BitmapPyramid>>;
+
+    // identifies a reference image by its size, type and content
+    struct ReferenceKey {
+        int           rows     = 0;
+        int           cols     = 0;
+        int           type     = 0;
+        std::uint64_t checksum = 0;
+
+        bool operator == (const ReferenceKey& other) const;
+    };
+
     void _calculateBitmap(const cv::Mat&              image,
                           std::vector<cv::Mat>* const out_vecMtb,
                           std::vector<cv::Mat>* const out_vecEb) const;
 
-    int  _findMedian(const cv::Mat& image) const;
+    int  _findMedian(const int histogram[256], const int numPixels) const;
+
+    std::shared_ptr<const BitmapPyramid> _referencePyramid(const cv::Mat& reference) const;
+
+    // hashes every row in parallel
+    static ReferenceKey _referenceKey(const cv::Mat& reference);
+
+    // same pixels in memory, so the content needs no hash
+    static bool _isSameBuffer(const cv::Mat& a, const cv::Mat& b);
+
+    mutable std::mutex    _referenceMutex;
+    mutable ReferenceKey  _cachedReferenceKey;
+    mutable PyramidFuture _cachedReferencePyramid;
+
+    // held so that no other image gets its buffer while cached
+    mutable cv::Mat       _cachedReference;
 
     static const int MAX_MTB_LEVEL = 5;
+
+    // number of finest levels searched around a warm-start offset
+    static const int WARM_MTB_LEVEL = 2;
 };
 
 } // namespace shdr
\ No newline at end of file
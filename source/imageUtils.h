@@ -0,0 +1,97 @@
+#pragma once
+
+/*
+    It stores some image utilities for radiance maps,
+    which are stored either in single precision (CV_32FC3)
+    or in half precision (CV_16FC3). Conversions are done
+    row by row while loading and storing, so that kernels
+    always compute in float.
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <opencv2/opencv.hpp>
+
+namespace shdr::imageUtils {
+
+// half precision storage needs CV_16F, which comes with OpenCV 4
+#if CV_VERSION_MAJOR >= 4
+    #define SHDR_HAS_HALF_RADIANCE
+#endif
+
+inline bool isHalfRadiance(const cv::Mat& hdri) {
+#ifdef SHDR_HAS_HALF_RADIANCE
+    return hdri.depth() == CV_16F;
+
+#else
+    return false;
+
+#endif
+}
+
+inline int radianceType(const bool isHalfPrecision) {
+#ifdef SHDR_HAS_HALF_RADIANCE
+    return isHalfPrecision ? CV_16FC3 : CV_32FC3;
+
+#else
+    return CV_32FC3;
+
+#endif
+}
+
+// largest finite half precision value
+constexpr float MAX_HALF_RADIANCE = 65504.0f;
+
+// largest radiance a map of the given type stores without overflow
+inline float maxRadiance(const int radianceType) {
+#ifdef SHDR_HAS_HALF_RADIANCE
+    return (CV_MAT_DEPTH(radianceType) == CV_16F) ? MAX_HALF_RADIANCE : FLT_MAX;
+
+#else
+    return FLT_MAX;
+
+#endif
+}
+
+// load row iy of hdri as BGR floats, out_row holds hdri.cols * 3 floats
+inline void loadRadianceRow(const cv::Mat& hdri, const int iy, float* const out_row) {
+    const int numValues = hdri.cols * 3;
+
+#ifdef SHDR_HAS_HALF_RADIANCE
+    if (hdri.depth() == CV_16F) {
+        const cv::float16_t* row = hdri.ptr<cv::float16_t>(iy);
+        for (int i = 0; i < numValues; ++i) {
+            out_row[i] = static_cast<float>(row[i]);
+        }
+
+        return;
+    }
+
+#endif
+
+    const float* row = hdri.ptr<float>(iy);
+    std::copy(row, row + numValues, out_row);
+}
+
+// store BGR floats into row iy of hdri, half precision
+// clamps values above its range instead of making them inf
+inline void storeRadianceRow(const float* const row, const int iy, cv::Mat* const out_hdri) {
+    const int numValues = out_hdri->cols * 3;
+
+#ifdef SHDR_HAS_HALF_RADIANCE
+    if (out_hdri->depth() == CV_16F) {
+        cv::float16_t* outRow = out_hdri->ptr<cv::float16_t>(iy);
+        for (int i = 0; i < numValues; ++i) {
+            outRow[i] = cv::float16_t(std::min(row[i], MAX_HALF_RADIANCE));
+        }
+
+        return;
+    }
+
+#endif
+
+    float* outRow = out_hdri->ptr<float>(iy);
+    std::copy(row, row + numValues, outRow);
+}
+
+} // namespace shdr::imageUtils
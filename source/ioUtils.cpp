@@ -0,0 +1,148 @@
+#include "ioUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if (defined(_MSC_VER) || \
+     (defined(__GNUC__) && (__GNUC_MAJOR__ >= 8))) 
+    #include <filesystem>
+    namespace std_fs = std::filesystem;
+#else
+    #include <experimental/filesystem>
+    namespace std_fs = std::experimental::filesystem;
+#endif
+
+namespace shdr::ioUtils {
+
+void readShutterSpeeds(const std::string&        shutterFilename,
+                       std::vector<float>* const out_shutterSpeeds) {
+
+    /*
+        Read shutter times from a file,
+        one shutter time per line
+    */
+    FILE *f = fopen(shutterFilename.c_str(), "r");
+    if (!f) {
+        std::cout << "Shutter times file can't open !"
+                  << std::endl;
+
+        exit(0);
+    }
+
+    char line[1024];
+    while (fgets(line, 1024, f)) {
+        if (line[strlen(line)] == '\n') {
+            line[strlen(line) - 1] = '\0';
+        }
+
+        const float time = static_cast<float>(std::stold(line));
+        out_shutterSpeeds->push_back(time);
+    }
+
+    fclose(f);
+}
+
+void readImages(const std::string&          imageDirectory,
+                std::vector<cv::Mat>* const out_images) {
+
+    std::cout << "# Begin to read images"
+              << std::endl;
+
+    std::vector<std::string> imageFilenames;
+    listFiles(imageDirectory, &imageFilenames);
+
+    for (std::size_t i = 0; i < imageFilenames.size(); ++i) {
+        std::cout << "    Image " << (i + 1) << ": " << imageFilenames[i]
+                  << std::endl;
+
+        const cv::Mat img = cv::imread(imageFilenames[i]);
+        out_images->push_back(img);
+    }
+
+    std::cout << "# Total read " << out_images->size() << " images"
+              << std::endl;
+}
+
+void listFiles(const std::string&              directory,
+               std::vector<std::string>* const out_filenames) {
+
+    for (const auto& entry : std_fs::directory_iterator(directory)) {
+        out_filenames->push_back(entry.path().string());
+    }
+
+    // Because filename loading order may be different from standard order,
+    // we need to sort it first to make sure its order fits shutterspeed's order.
+    std::sort(out_filenames->begin(), out_filenames->end());
+}
+
+void listSubdirectories(const std::string&              directory,
+                        std::vector<std::string>* const out_subdirectories) {
+
+    for (const auto& entry : std_fs::directory_iterator(directory)) {
+        if (std_fs::is_directory(entry.path())) {
+            out_subdirectories->push_back(entry.path().string());
+        }
+    }
+
+    std::sort(out_subdirectories->begin(), out_subdirectories->end());
+}
+
+namespace {
+
+const char BASE64_ALPHABET[] = 
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+} // anonymous namespace
+
+std::string encodeBase64(const std::vector<uchar>& data) {
+    std::string text;
+    text.reserve((data.size() + 2) / 3 * 4);
+
+    for (std::size_t i = 0; i < data.size(); i += 3) {
+        const std::size_t remain = data.size() - i;
+        const unsigned int value = 
+            (static_cast<unsigned int>(data[i]) << 16) |
+            ((remain > 1) ? (static_cast<unsigned int>(data[i + 1]) << 8) : 0u) |
+            ((remain > 2) ? static_cast<unsigned int>(data[i + 2]) : 0u);
+
+        text.push_back(BASE64_ALPHABET[(value >> 18) & 0x3F]);
+        text.push_back(BASE64_ALPHABET[(value >> 12) & 0x3F]);
+        text.push_back((remain > 1) ? BASE64_ALPHABET[(value >> 6) & 0x3F] : '=');
+        text.push_back((remain > 2) ? BASE64_ALPHABET[value & 0x3F] : '=');
+    }
+
+    return text;
+}
+
+bool decodeBase64(const std::string&        text,
+                  std::vector<uchar>* const out_data) {
+
+    out_data->clear();
+    out_data->reserve(text.size() / 4 * 3);
+
+    unsigned int value   = 0;
+    int          numBits = 0;
+    for (const char c : text) {
+        if (c == '=') {
+            break;
+        }
+
+        const char* found = strchr(BASE64_ALPHABET, c);
+        if (!found || c == '\0') {
+            return false;
+        }
+
+        value    = (value << 6) | static_cast<unsigned int>(found - BASE64_ALPHABET);
+        numBits += 6;
+        if (numBits >= 8) {
+            numBits -= 8;
+            out_data->push_back(static_cast<uchar>((value >> numBits) & 0xFF));
+        }
+    }
+
+    return true;
+}
+
+} // namespace shdr::ioUtils
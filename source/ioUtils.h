@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+    It stores some input utilities for reading
+    shutter speeds and bracketed images from disk,
+    and for passing encoded images as text.
+*/
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace shdr::ioUtils {
+
+void readShutterSpeeds(const std::string&        shutterFilename,
+                       std::vector<float>* const out_shutterSpeeds);
+
+void readImages(const std::string&          imageDirectory,
+                std::vector<cv::Mat>* const out_images);
+
+// sorted paths of all files in the directory
+void listFiles(const std::string&              directory,
+               std::vector<std::string>* const out_filenames);
+
+void listSubdirectories(const std::string&              directory,
+                        std::vector<std::string>* const out_subdirectories);
+
+// base64 text of an encoded image buffer
+std::string encodeBase64(const std::vector<uchar>& data);
+
+// returns false on malformed text
+bool decodeBase64(const std::string&        text,
+                  std::vector<uchar>* const out_data);
+
+} // namespace shdr::ioUtils
@@ -0,0 +1,475 @@
+#include "jsonValue.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace shdr {
+
+namespace {
+
+/*
+    Recursive descent parser over a string, nesting is limited
+    to MAX_DEPTH so that a hostile document can't overflow the stack
+*/
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) :
+        _text(text),
+        _position(0),
+        _depth(0) {
+    }
+
+    bool parseDocument(JsonValue* const out_value) {
+        if (!_parseValue(out_value)) {
+            return false;
+        }
+
+        _skipSpaces();
+
+        return _position == _text.size();
+    }
+
+private:
+    void _skipSpaces() {
+        while (_position < _text.size() &&
+               (_text[_position] == ' '  || _text[_position] == '\t' ||
+                _text[_position] == '\r' || _text[_position] == '\n')) {
+
+            ++_position;
+        }
+    }
+
+    bool _consume(const std::string& token) {
+        if (_text.compare(_position, token.size(), token) != 0) {
+            return false;
+        }
+
+        _position += token.size();
+
+        return true;
+    }
+
+    bool _parseValue(JsonValue* const out_value) {
+        _skipSpaces();
+        if (_position >= _text.size()) {
+            return false;
+        }
+
+        const char c = _text[_position];
+        if (c == '{' || c == '[') {
+            if (_depth >= MAX_DEPTH) {
+                return false;
+            }
+
+            ++_depth;
+            const bool isParsed = (c == '{') ? _parseObject(out_value) : _parseArray(out_value);
+            --_depth;
+
+            return isParsed;
+        }
+        else if (c == '"') {
+            std::string value;
+            if (!_parseString(&value)) {
+                return false;
+            }
+
+            *out_value = JsonValue(value);
+
+            return true;
+        }
+        else if (_consume("true")) {
+            *out_value = JsonValue(true);
+
+            return true;
+        }
+        else if (_consume("false")) {
+            *out_value = JsonValue(false);
+
+            return true;
+        }
+        else if (_consume("null")) {
+            *out_value = JsonValue();
+
+            return true;
+        }
+
+        return _parseNumber(out_value);
+    }
+
+    bool _parseNumber(JsonValue* const out_value) {
+        const char* begin = _text.c_str() + _position;
+        char*       end   = nullptr;
+
+        // strtod also takes nan, inf and hex numbers, json doesn't
+        if (*begin != '-' && (*begin < '0' || *begin > '9')) {
+            return false;
+        }
+        for (const char* c = begin; *c != '\0' && *c != ',' && *c != ']' && *c != '}' && 
+                                    *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n'; ++c) {
+            if (*c == 'x' || *c == 'X' || *c == 'n' || *c == 'N' || *c == 'i' || *c == 'I') {
+                return false;
+            }
+        }
+
+        const double value = std::strtod(begin, &end);
+        if (end == begin || !std::isfinite(value)) {
+            return false;
+        }
+
+        _position += static_cast<std::size_t>(end - begin);
+        *out_value = JsonValue(value);
+
+        return true;
+    }
+
+    bool _parseString(std::string* const out_value) {
+        // skip opening quote
+        ++_position;
+
+        while (_position < _text.size()) {
+            const char c = _text[_position++];
+            if (c == '"') {
+                return true;
+            }
+            else if (c != '\\') {
+                out_value->push_back(c);
+
+                continue;
+            }
+
+            if (_position >= _text.size()) {
+                return false;
+            }
+
+            const char escape = _text[_position++];
+            switch (escape) {
+                case '"':  out_value->push_back('"');  break;
+                case '\\': out_value->push_back('\\'); break;
+                case '/':  out_value->push_back('/');  break;
+                case 'b':  out_value->push_back('\b'); break;
+                case 'f':  out_value->push_back('\f'); break;
+                case 'n':  out_value->push_back('\n'); break;
+                case 'r':  out_value->push_back('\r'); break;
+                case 't':  out_value->push_back('\t'); break;
+                case 'u': {
+                    if (_position + 4 > _text.size()) {
+                        return false;
+                    }
+
+                    const unsigned int code = 
+                        static_cast<unsigned int>(std::strtoul(_text.substr(_position, 4).c_str(), nullptr, 16));
+                    _position += 4;
+
+                    // encode the code point as utf-8 (basic multilingual plane only)
+                    if (code < 0x80) {
+                        out_value->push_back(static_cast<char>(code));
+                    }
+                    else if (code < 0x800) {
+                        out_value->push_back(static_cast<char>(0xC0 | (code >> 6)));
+                        out_value->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                    }
+                    else {
+                        out_value->push_back(static_cast<char>(0xE0 | (code >> 12)));
+                        out_value->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                        out_value->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                    }
+
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool _parseArray(JsonValue* const out_value) {
+        // skip opening bracket
+        ++_position;
+
+        *out_value = JsonValue::array();
+
+        _skipSpaces();
+        if (_consume("]")) {
+            return true;
+        }
+
+        while (true) {
+            JsonValue element;
+            if (!_parseValue(&element)) {
+                return false;
+            }
+            out_value->push(element);
+
+            _skipSpaces();
+            if (_consume("]")) {
+                return true;
+            }
+            if (!_consume(",")) {
+                return false;
+            }
+        }
+    }
+
+    bool _parseObject(JsonValue* const out_value) {
+        // skip opening brace
+        ++_position;
+
+        *out_value = JsonValue::object();
+
+        _skipSpaces();
+        if (_consume("}")) {
+            return true;
+        }
+
+        while (true) {
+            _skipSpaces();
+
+            std::string key;
+            if (_position >= _text.size() || _text[_position] != '"' || !_parseString(&key)) {
+                return false;
+            }
+
+            _skipSpaces();
+            if (!_consume(":")) {
+                return false;
+            }
+
+            JsonValue element;
+            if (!_parseValue(&element)) {
+                return false;
+            }
+            out_value->set(key, element);
+
+            _skipSpaces();
+            if (_consume("}")) {
+                return true;
+            }
+            if (!_consume(",")) {
+                return false;
+            }
+        }
+    }
+
+    const std::string& _text;
+    std::size_t        _position;
+    int                _depth;
+
+    static const int MAX_DEPTH = 64;
+};
+
+const JsonValue NULL_VALUE;
+const std::vector<JsonValue> EMPTY_ARRAY;
+
+} // anonymous namespace
+
+JsonValue::JsonValue() :
+    _type(JsonType::J_NULL),
+    _bool(false),
+    _number(0.0),
+    _string(),
+    _array(),
+    _object() {
+}
+
+JsonValue::JsonValue(const bool value) :
+    JsonValue() {
+
+    _type = JsonType::J_BOOL;
+    _bool = value;
+}
+
+JsonValue::JsonValue(const int value) :
+    JsonValue(static_cast<double>(value)) {
+}
+
+JsonValue::JsonValue(const double value) :
+    JsonValue() {
+
+    _type   = JsonType::J_NUMBER;
+    _number = value;
+}
+
+JsonValue::JsonValue(const char* const value) :
+    JsonValue(std::string(value)) {
+}
+
+JsonValue::JsonValue(const std::string& value) :
+    JsonValue() {
+
+    _type   = JsonType::J_STRING;
+    _string = value;
+}
+
+JsonValue JsonValue::array() {
+    JsonValue value;
+    value._type = JsonType::J_ARRAY;
+
+    return value;
+}
+
+JsonValue JsonValue::object() {
+    JsonValue value;
+    value._type = JsonType::J_OBJECT;
+
+    return value;
+}
+
+bool JsonValue::parse(const std::string& text, JsonValue* const out_value) {
+    JsonParser parser(text);
+    if (!parser.parseDocument(out_value)) {
+        *out_value = JsonValue();
+
+        return false;
+    }
+
+    return true;
+}
+
+std::string JsonValue::dump() const {
+    std::string text;
+    _dump(&text);
+
+    return text;
+}
+
+JsonType JsonValue::type() const {
+    return _type;
+}
+
+bool JsonValue::isNull() const {
+    return _type == JsonType::J_NULL;
+}
+
+bool JsonValue::asBool(const bool defaultValue) const {
+    return (_type == JsonType::J_BOOL) ? _bool : defaultValue;
+}
+
+double JsonValue::asNumber(const double defaultValue) const {
+    return (_type == JsonType::J_NUMBER) ? _number : defaultValue;
+}
+
+std::string JsonValue::asString(const std::string& defaultValue) const {
+    return (_type == JsonType::J_STRING) ? _string : defaultValue;
+}
+
+const std::vector<JsonValue>& JsonValue::asArray() const {
+    return (_type == JsonType::J_ARRAY) ? _array : EMPTY_ARRAY;
+}
+
+bool JsonValue::has(const std::string& key) const {
+    for (const auto& member : _object) {
+        if (member.first == key) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const JsonValue& JsonValue::operator [] (const std::string& key) const {
+    for (const auto& member : _object) {
+        if (member.first == key) {
+            return member.second;
+        }
+    }
+
+    return NULL_VALUE;
+}
+
+void JsonValue::set(const std::string& key, const JsonValue& value) {
+    for (auto& member : _object) {
+        if (member.first == key) {
+            member.second = value;
+
+            return;
+        }
+    }
+
+    _object.emplace_back(key, value);
+}
+
+void JsonValue::push(const JsonValue& value) {
+    _array.push_back(value);
+}
+
+void JsonValue::_dump(std::string* const out_text) const {
+    switch (_type) {
+        case JsonType::J_NULL:
+            out_text->append("null");
+            break;
+
+        case JsonType::J_BOOL:
+            out_text->append(_bool ? "true" : "false");
+            break;
+
+        case JsonType::J_NUMBER: {
+            // json has no nan or infinity
+            if (!std::isfinite(_number)) {
+                out_text->append("null");
+                break;
+            }
+
+            char buffer[32];
+            if (std::floor(_number) == _number && std::abs(_number) < 1e15) {
+                snprintf(buffer, sizeof(buffer), "%.0f", _number);
+            }
+            else {
+                snprintf(buffer, sizeof(buffer), "%.9g", _number);
+            }
+            out_text->append(buffer);
+            break;
+        }
+
+        case JsonType::J_STRING:
+            out_text->push_back('"');
+            for (const char c : _string) {
+                switch (c) {
+                    case '"':  out_text->append("\\\""); break;
+                    case '\\': out_text->append("\\\\"); break;
+                    case '\n': out_text->append("\\n");  break;
+                    case '\r': out_text->append("\\r");  break;
+                    case '\t': out_text->append("\\t");  break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            char buffer[8];
+                            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                            out_text->append(buffer);
+                        }
+                        else {
+                            out_text->push_back(c);
+                        }
+                }
+            }
+            out_text->push_back('"');
+            break;
+
+        case JsonType::J_ARRAY:
+            out_text->push_back('[');
+            for (std::size_t i = 0; i < _array.size(); ++i) {
+                if (i > 0) {
+                    out_text->push_back(',');
+                }
+                _array[i]._dump(out_text);
+            }
+            out_text->push_back(']');
+            break;
+
+        case JsonType::J_OBJECT:
+            out_text->push_back('{');
+            for (std::size_t i = 0; i < _object.size(); ++i) {
+                if (i > 0) {
+                    out_text->push_back(',');
+                }
+                JsonValue(_object[i].first)._dump(out_text);
+                out_text->push_back(':');
+                _object[i].second._dump(out_text);
+            }
+            out_text->push_back('}');
+            break;
+    }
+}
+
+} // namespace shdr
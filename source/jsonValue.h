@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace shdr {
+
+/*
+    JsonType: type of a JsonValue
+*/
+enum class JsonType {
+    J_NULL,
+    J_BOOL,
+    J_NUMBER,
+    J_STRING,
+    J_ARRAY,
+    J_OBJECT,
+};
+
+/*
+    JsonValue is a minimal JSON document used by the
+    line-delimited job protocol (one document per line).
+*/
+class JsonValue {
+public:
+    JsonValue();
+    JsonValue(const bool value);
+    JsonValue(const int value);
+    JsonValue(const double value);
+    JsonValue(const char* const value);
+    JsonValue(const std::string& value);
+
+    static JsonValue array();
+    static JsonValue object();
+
+    // returns false (and a null value) on malformed text
+    static bool parse(const std::string& text, JsonValue* const out_value);
+
+    // single line serialization
+    std::string dump() const;
+
+    JsonType type() const;
+    bool     isNull() const;
+
+    bool               asBool(const bool defaultValue = false) const;
+    double             asNumber(const double defaultValue = 0.0) const;
+    std::string        asString(const std::string& defaultValue = "") const;
+    const std::vector<JsonValue>& asArray() const;
+
+    bool has(const std::string& key) const;
+
+    // missing keys give a null value
+    const JsonValue& operator [] (const std::string& key) const;
+
+    void set(const std::string& key, const JsonValue& value);
+    void push(const JsonValue& value);
+
+private:
+    void _dump(std::string* const out_text) const;
+
+    JsonType                                      _type;
+    bool                                          _bool;
+    double                                        _number;
+    std::string                                   _string;
+    std::vector<JsonValue>                        _array;
+    std::vector<std::pair<std::string, JsonValue>> _object;
+};
+
+} // namespace shdr
@@ -1,6 +1,23 @@
+#include "core/autoTuner.h"
+#include "core/batchCoordinator.h"
+#include "core/captureSession.h"
 #include "core/hdrSolver.h"
+#include "core/imageCache.h"
+#include "core/imageWriter.h"
+#include "core/jobServer.h"
+#include "core/regressionSuite.h"
+#include "core/sequenceSolver.h"
+#include "core/taskScheduler.h"
+#include "core/tuningProfile.h"
+#include "core/workerChannel.h"
+#include "ioUtils.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 using namespace shdr;
 
@@ -33,16 +50,172 @@ Options:
                    default: <mtb>
              
     -crfs <method> Specify crfSolver method used for solving camera response function.
-                   It currently only supports one method.
-                   <debevec>
+                   It currently supports two kinds of methods.
+                   <debevec>, <mitsunaga-nayar>
 
                    default: <debevec> 
 
     -tm   <method> Specify toneMapper method used for tone mapping.
-                   It currently supports three kinds of methods.
-                   <photographic-global>, <photographic-local>, <bilateral>
+                   It currently supports five kinds of methods.
+                   <photographic-global>, <photographic-local>, <bilateral>,
+                   <local-laplacian>, <gradient-domain>
 
                    default: <bilateral>
+
+    -lut-import <file>
+                   Apply a tone curve saved as a 1D .cube LUT instead of deriving
+                   it from the radiance map (global tone mappers only).
+
+    -lut-export <file>
+                   Save the tone curve of a global tone mapper as a 1D .cube LUT,
+                   its input is log luminance. In sequence mode the curve of
+                   the first frame is saved.
+
+    -roi <x,y,w,h> Only merge and tone map the given region of the images, 
+                   alignment offsets and global tone mapping statistics are
+                   still taken from the whole image.
+
+    -o    <path>   Specify where the tone mapped image is written, "-" streams it
+                   to stdout (progress output then goes to stderr).
+
+                   default: ./hdr_tone_mapping.png
+
+    -format <name> Specify the output format, e.g. <png>, <jpg>, <webp>, <ppm>,
+                   instead of taking it from the output file extension
+                   (stdout defaults to <png>). Frames of a sequence are written
+                   in the same format. Only <ppm> is streamed, it is converted
+                   in parallel and written while it is converted; other formats
+                   are encoded in memory first.
+
+    -quality <number>
+                   Specify the quality of lossy output formats, 0-100.
+
+                   default: 95
+
+    -compression <number>
+                   Specify the png compression level, 0-9.
+
+                   default: 1
+
+    -threads <number>
+                   Specify the number of threads used by the whole pipeline,
+                   0 means one thread per core. On NUMA hosts the threads are
+                   spread over the nodes and pinned to them.
+
+                   default: the tuning profile's, otherwise 0
+
+    -numa-report   Print the read bandwidth between the cpus and the memory
+                   of every NUMA node before running.
+
+    -autotune      Time the alignment, merge and tone mapping of the given
+                   images with different numbers of threads and row band sizes,
+                   and save the fastest settings as this host's tuning profile.
+                   Row band sizes are saved per stage for the size class of the
+                   images (up to 1, 4, 16, 64 MP or above), tuning on another
+                   size adds to the profile.
+
+    -profile <path>
+                   Specify the tuning profile that runs load at startup and
+                   -autotune writes. Settings given on the command line win.
+
+                   default: $SHDR_PROFILE, otherwise ~/.shdr_profile.json
+
+    -cull          Drop redundant exposures before alignment, keeping the fewest
+                   that expose (nearly) every part of the scene well.
+
+    -cache <path>  Keep decoded images in the given directory, so that repeated
+                   runs on the same images map them instead of decoding them.
+
+    -cache-size <MB>
+                   Specify the size limit of the image cache, least recently
+                   used images are evicted first.
+
+                   default: 4096
+
+    -cache-aligned Cache aligned images as well.
+
+    -lean          Free every buffer as soon as the next stage has consumed it,
+                   which lowers the peak memory of a run.
+
+    -fp16          Store the radiance map in half precision, which halves
+                   its memory footprint (requires OpenCV 4).
+
+    -seq  <path>   Run in sequence (time-lapse) mode and write tone mapped 
+                   frames to the given directory. Each subdirectory of the
+                   images directory is one frame (bracket set), and all
+                   frames share the same shutterspeed file.
+
+    -seq-rate <value>
+                   Specify how fast tone mapping statistics adapt to a new
+                   frame in sequence mode, from 0 (frozen) to 1 (no smoothing).
+
+                   default: 0.2
+
+    -session <path>
+                   Run in tethered capture mode with the given session file.
+                   Exposures added to the images directory (and shutterspeed
+                   file) since the last run are folded into the session, then
+                   a preview of the current radiance map is tone mapped.
+
+    -server [<path>]
+                   Run as a local job server which keeps stages and response
+                   curves warm between jobs. Jobs are line-delimited JSON read
+                   from the Unix socket at the given path, or from stdin when
+                   no path is given (responses go to stdout, progress to stderr).
+                   -ia, -crfs and -tm give the methods of jobs naming none.
+                   The images directory and shutterspeed file are not needed.
+
+    -server-jobs <number>
+                   Specify how many jobs the server runs at the same time.
+
+                   default: 2
+
+    -server-queue <number>
+                   Specify how many jobs may wait in the server's queue before
+                   it stops reading requests.
+
+                   default: 8
+
+    -coordinator <path>
+                   Run the jobs of the given manifest (one job server request
+                   per line) on several local worker processes, handing out
+                   jobs as workers become idle and retrying failed ones.
+                   -ia, -crfs, -tm and -fp16 are passed on to the workers.
+                   The images directory and shutterspeed file are not needed.
+
+    -workers <number>
+                   Specify how many worker processes the coordinator starts,
+                   the threads (-threads) are split among them.
+
+                   default: 2
+
+    -retries <number>
+                   Specify how many times the coordinator retries a failed job.
+
+                   default: 2
+
+    -job-timeout <seconds>
+                   Specify how long the coordinator waits for a worker to finish
+                   a job, a worker that takes longer is killed and its job is
+                   retried on another worker. 0 waits forever.
+
+                   default: 600
+
+    -regress <path>
+                   Run every image aligner, crf solver and tone mapper combination
+                   on the images directory and on synthetic brackets, and compare
+                   quality (PSNR, SSIM, radiance error), time and peak memory with
+                   the goldens and budgets recorded in the given directory.
+                   Exits with 1 if any case regressed.
+
+    -regress-record
+                   Record the goldens and budgets of -regress instead. Budgets
+                   are recorded for the current host only, a host without
+                   budgets is only checked for quality.
+
+    -regress-synthetic
+                   Only run the synthetic brackets of -regress, whose goldens
+                   are shipped in data/regression.
 )");
 
         return 0;
@@ -57,6 +230,37 @@ Options:
         std::string imageAlignerMethod = "mtb";
         std::string crfSolverMethod    = "debevec";
         std::string toneMapperMethod   = "bilateral";
+        std::string sequenceDirectory  = "";
+        float       adaptationRate     = 0.2f;
+        bool        isHalfPrecision    = false;
+        bool        isCulling          = false;
+        bool        isLean             = false;
+        bool        isNumaReport       = false;
+        std::string lutImportFilePath  = "";
+        std::string lutExportFilePath  = "";
+        cv::Rect    regionOfInterest   = cv::Rect();
+        std::string cacheDirectory     = "";
+        std::size_t cacheSizeMB        = 4096;
+        bool        isAlignedCaching   = false;
+        int         numThreads         = -1;
+        bool        isAutoTuning       = false;
+        std::string profileFilePath    = "";
+        std::string sessionFilePath    = "";
+        std::string outputPath         = "./hdr_tone_mapping.png";
+        std::string outputFormat       = "";
+        int         outputQuality      = 95;
+        int         outputCompression  = 1;
+        bool        isServer           = false;
+        std::string serverSocketPath   = "";
+        int         numServerJobs      = 2;
+        int         serverQueueSize    = 8;
+        std::string manifestFilePath   = "";
+        std::string regressionPath     = "";
+        bool        isRecording        = false;
+        bool        isSyntheticOnly    = false;
+        int         numWorkers         = 2;
+        int         numRetries         = 2;
+        int         jobTimeoutSeconds  = 600;
         const std::string imageDirectoryPath   = argv[argc - 2];
         const std::string shutterspeedFilePath = argv[argc - 1];
 
@@ -70,21 +274,300 @@ Options:
             if (args[i] == "-tm") {
                 toneMapperMethod = args[i + 1];
             }
+            if (args[i] == "-roi") {
+                int x, y, width, height;
+                if (std::sscanf(args[i + 1].c_str(), "%d,%d,%d,%d", &x, &y, &width, &height) == 4) {
+                    regionOfInterest = cv::Rect(x, y, width, height);
+                }
+                else {
+                    std::cout << "Region of interest should be x,y,w,h: " << args[i + 1]
+                              << std::endl;
+                }
+            }
+            if (args[i] == "-o") {
+                outputPath = args[i + 1];
+            }
+            if (args[i] == "-format") {
+                outputFormat = args[i + 1];
+            }
+            if (args[i] == "-quality") {
+                outputQuality = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-compression") {
+                outputCompression = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-threads") {
+                numThreads = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-autotune") {
+                isAutoTuning = true;
+            }
+            if (args[i] == "-profile") {
+                profileFilePath = args[i + 1];
+            }
+            if (args[i] == "-numa-report") {
+                isNumaReport = true;
+            }
+            if (args[i] == "-fp16") {
+                isHalfPrecision = true;
+            }
+            if (args[i] == "-cull") {
+                isCulling = true;
+            }
+            if (args[i] == "-lean") {
+                isLean = true;
+            }
+            if (args[i] == "-lut-import") {
+                lutImportFilePath = args[i + 1];
+            }
+            if (args[i] == "-lut-export") {
+                lutExportFilePath = args[i + 1];
+            }
+            if (args[i] == "-cache") {
+                cacheDirectory = args[i + 1];
+            }
+            if (args[i] == "-cache-size") {
+                cacheSizeMB = std::stoul(args[i + 1]);
+            }
+            if (args[i] == "-cache-aligned") {
+                isAlignedCaching = true;
+            }
+            if (args[i] == "-session") {
+                sessionFilePath = args[i + 1];
+            }
+            if (args[i] == "-seq") {
+                sequenceDirectory = args[i + 1];
+            }
+            if (args[i] == "-seq-rate") {
+                adaptationRate = std::stof(args[i + 1]);
+            }
+            if (args[i] == "-server") {
+                isServer = true;
+                if (i + 1 < args.size() && args[i + 1][0] != '-') {
+                    serverSocketPath = args[i + 1];
+                }
+            }
+            if (args[i] == "-server-jobs") {
+                numServerJobs = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-server-queue") {
+                serverQueueSize = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-regress") {
+                regressionPath = args[i + 1];
+            }
+            if (args[i] == "-regress-record") {
+                isRecording = true;
+            }
+            if (args[i] == "-regress-synthetic") {
+                isSyntheticOnly = true;
+            }
+            if (args[i] == "-coordinator") {
+                manifestFilePath = args[i + 1];
+            }
+            if (args[i] == "-workers") {
+                numWorkers = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-retries") {
+                numRetries = std::stoi(args[i + 1]);
+            }
+            if (args[i] == "-job-timeout") {
+                jobTimeoutSeconds = std::stoi(args[i + 1]);
+            }
+        }
+
+        ImageWriter imageWriter(outputPath);
+        imageWriter.setFormat(outputFormat);
+        imageWriter.setQuality(outputQuality);
+        imageWriter.setCompression(outputCompression);
+
+        // stdout carries the responses of a stdin job server 
+        // or the streamed image, progress goes to stderr
+        std::streambuf* const stdoutBuffer = std::cout.rdbuf();
+        if ((isServer && serverSocketPath.empty()) || imageWriter.isStdout()) {
+            std::cout.rdbuf(std::cerr.rdbuf());
         }
 
         std::cout << "Simple-HDR, copyright (c)2019-2020 Chia-Yu Chou\n"
                   << std::endl;
 
+        /*
+            The tuning profile of this host fills in the scheduler 
+            settings not given on the command line, a missing 
+            default profile just means the host wasn't tuned
+        */
+        const std::string profileFilename = profileFilePath.empty() ? 
+            TuningProfile::defaultFilename() : profileFilePath;
+
+        TuningProfile profile;
+        if (isAutoTuning) {
+            // tuning adds to this host's profile, other image sizes are kept
+            if (std::ifstream(profileFilename)) {
+                profile.load(profileFilename);
+            }
+        }
+        else if ((!profileFilePath.empty() || std::ifstream(profileFilename)) && 
+                 profile.load(profileFilename)) {
+
+            if (numThreads < 0) {
+                numThreads = profile.numThreads();
+            }
+            profile.apply();
+        }
+
+        TaskScheduler::setNumThreads(std::max(numThreads, 0));
+        if (isNumaReport) {
+            TaskScheduler::instance().reportNodeBandwidth();
+        }
+
+        if (isAutoTuning) {
+            std::vector<float>   shutterSpeeds;
+            std::vector<cv::Mat> images;
+            ioUtils::readShutterSpeeds(shutterspeedFilePath, &shutterSpeeds);
+            ioUtils::readImages(imageDirectoryPath, &images);
+
+            AutoTuner autoTuner(imageAlignerMethod, crfSolverMethod, toneMapperMethod);
+            autoTuner.tune(images, shutterSpeeds, &profile);
+
+            return (profile.numThreads() > 0 && profile.save(profileFilename)) ? 0 : 1;
+        }
+
+        if (!regressionPath.empty()) {
+            RegressionSuite regressionSuite(regressionPath);
+            if (!isSyntheticOnly) {
+                regressionSuite.addScene("captured", imageDirectoryPath, shutterspeedFilePath);
+            }
+            regressionSuite.addSyntheticScene("synthetic-3", 640, 480, 3);
+            regressionSuite.addSyntheticScene("synthetic-5", 640, 480, 5);
+
+            return (regressionSuite.run(isRecording) == 0) ? 0 : 1;
+        }
+
+        if (!manifestFilePath.empty()) {
+            BatchCoordinator batchCoordinator(manifestFilePath, numRetries, jobTimeoutSeconds);
+
+            /*
+                Workers are this executable running as stdin job servers,
+                one job at a time each, sharing the cores between them
+            */
+            const int numCores = (numThreads > 0) ? 
+                numThreads : static_cast<int>(std::thread::hardware_concurrency());
+            const int numWorkerThreads = std::max(numCores / std::max(numWorkers, 1), 1);
+
+            std::vector<std::string> workerArgs = { "-server",
+                                                    "-server-jobs", "1",
+                                                    "-threads",     std::to_string(numWorkerThreads),
+                                                    "-ia",          imageAlignerMethod,
+                                                    "-crfs",        crfSolverMethod,
+                                                    "-tm",          toneMapperMethod };
+            if (isHalfPrecision) {
+                workerArgs.push_back("-fp16");
+            }
+
+            const std::string executable = argv[0];
+
+            std::vector<std::unique_ptr<ProcessWorkerChannel>> processes;
+            std::vector<WorkerChannel*>                        workers;
+            for (int w = 0; w < numWorkers; ++w) {
+                auto process = std::make_unique<ProcessWorkerChannel>();
+                if (!process->start(executable, workerArgs)) {
+                    std::cout << "Worker " << (w + 1) << " can't be started !"
+                              << std::endl;
+
+                    continue;
+                }
+
+                workers.push_back(process.get());
+                processes.push_back(std::move(process));
+            }
+
+            const int numFailed = workers.empty() ? 
+                static_cast<int>(batchCoordinator.numJobs()) : batchCoordinator.run(workers);
+
+            for (auto& process : processes) {
+                process->close();
+            }
+
+            return (numFailed == 0) ? 0 : 1;
+        }
+
+        if (isServer) {
+            JobServer jobServer(imageAlignerMethod,
+                                crfSolverMethod,
+                                toneMapperMethod,
+                                numServerJobs,
+                                serverQueueSize);
+
+            jobServer.setHalfPrecision(isHalfPrecision);
+            if (serverSocketPath.empty()) {
+                std::ostream responses(stdoutBuffer);
+                jobServer.serve(std::cin, responses);
+            }
+            else {
+                jobServer.serveSocket(serverSocketPath);
+            }
+
+            return 0;
+        }
+
+        if (!sequenceDirectory.empty()) {
+            SequenceSolver sequenceSolver(imageDirectoryPath,
+                                          shutterspeedFilePath,
+                                          imageAlignerMethod,
+                                          crfSolverMethod,
+                                          toneMapperMethod,
+                                          adaptationRate);
+
+            sequenceSolver.setHalfPrecision(isHalfPrecision);
+            sequenceSolver.setToneCurveFiles(lutImportFilePath, lutExportFilePath);
+            sequenceSolver.setImageWriter(imageWriter);
+            sequenceSolver.solve(sequenceDirectory);
+
+            return 0;
+        }
+
+        if (!sessionFilePath.empty()) {
+            CaptureSession captureSession(sessionFilePath,
+                                          imageDirectoryPath,
+                                          shutterspeedFilePath,
+                                          imageAlignerMethod,
+                                          crfSolverMethod,
+                                          toneMapperMethod);
+
+            cv::Mat preview;
+            captureSession.setHalfPrecision(isHalfPrecision);
+            captureSession.setToneCurveFiles(lutImportFilePath, lutExportFilePath);
+            captureSession.solve(&preview);
+            if (!preview.empty() && !imageWriter.write(preview)) {
+                return 1;
+            }
+
+            return 0;
+        }
+
+        std::shared_ptr<ImageCache> imageCache = nullptr;
+        if (!cacheDirectory.empty()) {
+            imageCache = std::make_shared<ImageCache>(cacheDirectory, cacheSizeMB << 20);
+            imageCache->setAlignedCaching(isAlignedCaching);
+        }
+
         cv::Mat hdri;
         HdrSolver hdrSolver(imageDirectoryPath,
                             shutterspeedFilePath,
                             imageAlignerMethod,
                             crfSolverMethod,
-                            toneMapperMethod);
+                            toneMapperMethod,
+                            imageCache);
 
+        hdrSolver.setHalfPrecision(isHalfPrecision);
+        hdrSolver.setLeanMode(isLean);
+        hdrSolver.setToneCurveFiles(lutImportFilePath, lutExportFilePath);
+        hdrSolver.setRegionOfInterest(regionOfInterest);
+        if (isCulling) {
+            hdrSolver.cullExposures();
+        }
         hdrSolver.solve(&hdri);
-        cv::imwrite("./hdr_tone_mapping.png", hdri);
 
-        return 0;
+        return imageWriter.write(hdri) ? 0 : 1;
     }
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 */
 
 #include <cmath>
+#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <random>
 
@@ -34,14 +35,36 @@ inline float gaussian(const int x, const float mean, const float sigma) {
 }
 
 
-static std::random_device rd;
+/*
+    One random engine is shared by the whole process, it is
+    seeded randomly unless a fixed seed is given for 
+    reproducible runs (e.g. regression runs)
+*/
+struct RandomState {
+    std::mutex                 mutex;
+    std::default_random_engine engine{ std::random_device{}() };
+};
+
+inline RandomState& randomState() {
+    static RandomState state;
+
+    return state;
+}
+
+inline void setSeed(const unsigned int seed) {
+    RandomState&                state = randomState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.engine.seed(seed);
+}
 
 inline int nextInt(const int min, const int max) {
-    std::default_random_engine generator = std::default_random_engine(rd());
+    RandomState&                state = randomState();
+    std::lock_guard<std::mutex> lock(state.mutex);
 
     std::uniform_int_distribution<int> distribution(min, max - 1);
 
-    return distribution(generator);
+    return distribution(state.engine);
 }
 
 inline void getTranslationMatrix(const int      tx,
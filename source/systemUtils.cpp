@@ -0,0 +1,199 @@
+#include "systemUtils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+namespace shdr::systemUtils {
+
+namespace {
+
+#ifdef __linux__
+
+// value of a "Name:   1234 kB" line of /proc/self/status
+std::size_t readStatusKilobytes(const char* const name) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) {
+        return 0;
+    }
+
+    const std::size_t nameLength = strlen(name);
+
+    std::size_t kilobytes = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+            unsigned long long value = 0;
+            if (sscanf(line + nameLength + 1, "%llu", &value) == 1) {
+                kilobytes = static_cast<std::size_t>(value);
+            }
+
+            break;
+        }
+    }
+
+    fclose(f);
+
+    return kilobytes;
+}
+
+// cpus of a cpulist like "0-7,16-23"
+void parseCpuList(const char* list, std::vector<int>* const out_cpus) {
+    while (*list) {
+        int first         = 0;
+        int last          = 0;
+        int numCharacters = 0;
+        if (sscanf(list, "%d-%d%n", &first, &last, &numCharacters) == 2) {
+            list += numCharacters;
+        }
+        else if (sscanf(list, "%d%n", &first, &numCharacters) == 1) {
+            last  = first;
+            list += numCharacters;
+        }
+        else {
+            break;
+        }
+
+        for (int cpu = first; cpu <= last; ++cpu) {
+            out_cpus->push_back(cpu);
+        }
+
+        if (*list != ',') {
+            break;
+        }
+        ++list;
+    }
+}
+
+#endif
+
+} // anonymous namespace
+
+std::size_t residentBytes() {
+#ifdef __linux__
+    return readStatusKilobytes("VmRSS") << 10;
+
+#else
+    return 0;
+
+#endif
+}
+
+std::size_t peakResidentBytes() {
+#ifdef __linux__
+    return readStatusKilobytes("VmHWM") << 10;
+
+#elif defined(__APPLE__)
+    // ru_maxrss is in bytes on macOS
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<std::size_t>(usage.ru_maxrss);
+
+#else
+    return 0;
+
+#endif
+}
+
+bool resetPeakResidentBytes() {
+#ifdef __linux__
+    // "5" resets the peak resident size (Linux 4.0+)
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) {
+        return false;
+    }
+
+    const bool isWritten = (fputs("5", f) >= 0) && (fclose(f) == 0);
+    if (!isWritten) {
+        return false;
+    }
+
+    // some kernels accept the write but keep the peak
+    return readStatusKilobytes("VmHWM") <= readStatusKilobytes("VmRSS") + 1024;
+
+#else
+    return false;
+
+#endif
+}
+
+void numaNodes(std::vector<std::vector<int>>* const out_nodeCpus) {
+    out_nodeCpus->clear();
+
+#ifdef __linux__
+    // node ids may have gaps, memory-only nodes have no cpus
+    constexpr int MAX_NUM_NODES = 1024;
+    for (int node = 0; node < MAX_NUM_NODES; ++node) {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE* f = fopen(filename, "r");
+        if (!f) {
+            continue;
+        }
+
+        char             line[4096];
+        std::vector<int> cpus;
+        if (fgets(line, sizeof(line), f)) {
+            parseCpuList(line, &cpus);
+        }
+        fclose(f);
+
+        if (!cpus.empty()) {
+            out_nodeCpus->push_back(cpus);
+        }
+    }
+
+#endif
+
+    if (out_nodeCpus->empty()) {
+        const int numCpus = static_cast<int>(std::thread::hardware_concurrency());
+
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < numCpus; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        out_nodeCpus->push_back(cpus);
+    }
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (const int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpuSet);
+        }
+    }
+
+    return sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0;
+
+#else
+    return false;
+
+#endif
+}
+
+std::string hostName() {
+#if defined(__unix__) || defined(__APPLE__)
+    char name[256] = { 0 };
+    if (gethostname(name, sizeof(name) - 1) == 0) {
+        return name;
+    }
+
+#endif
+    return "";
+}
+
+} // namespace shdr::systemUtils
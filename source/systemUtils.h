@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+    It stores some system utilities for querying
+    the resources used by the process and the
+    topology of the host.
+*/
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace shdr::systemUtils {
+
+// current resident set size in bytes, 0 if unknown
+std::size_t residentBytes();
+
+// peak resident set size in bytes, 0 if unknown
+std::size_t peakResidentBytes();
+
+// restart the peak at the current resident size, so that
+// the peak of one phase can be measured, false if unsupported
+bool resetPeakResidentBytes();
+
+// cpus of each NUMA node with cpus, a single node
+// with every cpu if the topology is unknown
+void numaNodes(std::vector<std::vector<int>>* const out_nodeCpus);
+
+// run the calling thread on the given cpus only, false if unsupported
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+// network name of the host, empty if unknown
+std::string hostName();
+
+} // namespace shdr::systemUtils
@@ -1,5 +1,8 @@
 #include "toneMapper/bilateralToneMapper.h"
 
+#include "core/taskScheduler.h"
+
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -13,38 +16,66 @@ BilateralToneMapper::BilateralToneMapper(const float delta) :
     _delta(delta) {
 }
 
-void BilateralToneMapper::map(const cv::Mat& hdri, 
-                              cv::Mat* const out_ldri) const {
+void BilateralToneMapper::_mapImpl(const cv::Mat&        hdri,
+                                    const ToneStatistics& statistics,
+                                    cv::Mat* const        out_ldri) const {
 
     std::cout << "# Begin to implement tone mapping using bilateral method"
               << std::endl;
 
-    cv::Mat ldri = hdri.clone();
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    cv::Mat ldri;
     cv::Mat intensity; 
-    cv::Mat logIntensity;
-    cv::Mat lowFrequency;
-    cv::Mat highFrequency;
-    cv::Mat newIntensity;
+    cv::Mat logIntensity  = _scratch(height, width, CV_32FC1);
+    cv::Mat lowFrequency  = _scratch(height, width, CV_32FC1);
+    cv::Mat highFrequency = _scratch(height, width, CV_32FC1);
+    cv::Mat newIntensity  = _scratch(height, width, CV_32FC1);
 
     /*
         We need to separate intensity & color,
         first calculate its intensity
     */
-    cv::cvtColor(hdri, intensity, cv::COLOR_BGR2GRAY);
-    cv::log(intensity + _delta, logIntensity);
+    _luminance(hdri, &intensity);
+    intensity.convertTo(logIntensity, CV_32FC1, 1.0, _delta);
+    cv::log(logIntensity, logIntensity);
 
     /*
         Split to low frequency image & high frequency image
     */
-    cv::bilateralFilter(logIntensity, lowFrequency, 5, 30, 30);
-    highFrequency = logIntensity - lowFrequency;
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        /*
+            Each row band is filtered with a halo of the filter radius,
+            the band is copied so that the filter only sees its own rows
+        */
+        const int haloBegin = std::max(rowBegin - FILTER_RADIUS, 0);
+        const int haloEnd   = std::min(rowEnd + FILTER_RADIUS, height);
+
+        const cv::Mat band = logIntensity.rowRange(haloBegin, haloEnd).clone();
+        cv::Mat       filteredBand;
+        cv::bilateralFilter(band, filteredBand, 2 * FILTER_RADIUS + 1, 30, 30);
+
+        filteredBand.rowRange(rowBegin - haloBegin, rowEnd - haloBegin)
+                    .copyTo(lowFrequency.rowRange(rowBegin, rowEnd));
+    });
+    cv::subtract(logIntensity, lowFrequency, highFrequency);
 
     /*
-        Now we need to reduce contrast in low frequency image
+        Now we need to reduce contrast in low frequency image,
+        its range is the one of the base layer, a sequence 
+        takes the smoothed log luminance range instead so
+        that the frames don't flicker
     */
     double min;
     double max;
-    cv::minMaxLoc(lowFrequency, &min, &max);
+    if (statistics.isSmoothed()) {
+        min = statistics.minLogLuminance();
+        max = statistics.maxLogLuminance();
+    }
+    else {
+        cv::minMaxLoc(lowFrequency, &min, &max);
+    }
 
     const float compressionFactor = static_cast<float>(std::log(6.0) / (max - min));
     lowFrequency *= compressionFactor;
@@ -53,22 +84,14 @@ void BilateralToneMapper::map(const cv::Mat& hdri,
         Now we combine reduced contrast low frequency image
         and high frequency image to new intensity image
     */
-    newIntensity = lowFrequency + highFrequency;
+    cv::add(lowFrequency, highFrequency, newIntensity);
     cv::exp(newIntensity, newIntensity);
 
     /*
         Recalculate color for each channel
     */
     const float logScale = 1.0f / static_cast<float>(std::exp(compressionFactor * max));
-    std::vector<cv::Mat> vecMat;
-    cv::split(ldri, vecMat);
-    for (int c = 0; c < 3; ++c) {
-        cv::divide(vecMat[c], intensity, vecMat[c]);
-        vecMat[c] = vecMat[c].mul(newIntensity) * logScale;
-    }
-    cv::merge(vecMat, ldri);
-    ldri *= 255.0f;
-    ldri.convertTo(ldri, CV_8UC3);
+    _reconstructColor(hdri, intensity, newIntensity, logScale, &ldri);
 
     *out_ldri = ldri;
 
@@ -76,4 +99,8 @@ void BilateralToneMapper::map(const cv::Mat& hdri,
               << std::endl;
 }
 
+int BilateralToneMapper::_haloRadiusImpl() const {
+    return FILTER_RADIUS;
+}
+
 } // namespace shdr
\ No newline at end of file
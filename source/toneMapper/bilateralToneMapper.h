@@ -9,11 +9,17 @@ public:
     BilateralToneMapper();
     BilateralToneMapper(const float delta);
 
-    void map(const cv::Mat& hdri, 
-             cv::Mat* const out_ldri) const override;
-
 private:
+    void _mapImpl(const cv::Mat&        hdri,
+                  const ToneStatistics& statistics,
+                  cv::Mat* const        out_ldri) const override;
+
+    int _haloRadiusImpl() const override;
+
     float _delta;
+
+    // radius of the bilateral filter window
+    static const int FILTER_RADIUS = 2;
 };
 
 } // namespace shdr
\ No newline at end of file
@@ -0,0 +1,431 @@
+#include "toneMapper/gradientDomainToneMapper.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace shdr {
+
+namespace {
+
+double elapsedMilliseconds(const std::chrono::steady_clock::time_point& begin,
+                           const std::chrono::steady_clock::time_point& end) {
+
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+} // anonymous namespace
+
+GradientDomainToneMapper::GradientDomainToneMapper() :
+    GradientDomainToneMapper(0.1f, 0.85f) {
+}
+
+GradientDomainToneMapper::GradientDomainToneMapper(const float alpha, const float beta) :
+    _alpha(alpha),
+    _beta(beta) {
+}
+
+// the attenuation is relative to each level's own mean gradient, no global statistics needed
+void GradientDomainToneMapper::_mapImpl(const cv::Mat&        hdri,
+                                        const ToneStatistics& /* statistics */,
+                                        cv::Mat* const        out_ldri) const {
+
+    std::cout << "# Begin to implement tone mapping using gradient domain method"
+              << std::endl;
+
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    const int numLevels    = _numGridLevels(height, width);
+    const int cellSize     = 1 << numLevels;
+    const int paddedWidth  = (width + cellSize - 1) / cellSize * cellSize;
+    const int paddedHeight = (height + cellSize - 1) / cellSize * cellSize;
+
+    cv::Mat ldri;
+    cv::Mat lw;
+    cv::Mat logLw       = _scratch(height, width, CV_32FC1);
+    cv::Mat paddedLogLw = _scratch(paddedHeight, paddedWidth, CV_32FC1);
+    cv::Mat phi;
+    cv::Mat div;
+    cv::Mat paddedLogLd;
+    cv::Mat ld;
+
+    _luminance(hdri, &lw);
+    lw.convertTo(logLw, CV_32FC1, 1.0, ToneStatistics::LUMINANCE_DELTA);
+    cv::log(logLw, logLw);
+    cv::copyMakeBorder(logLw, paddedLogLw, 
+                       0, paddedHeight - height, 
+                       0, paddedWidth - width, 
+                       cv::BORDER_REPLICATE);
+
+    /*
+        Attenuate gradients and reconstruct the 
+        log luminance from them
+    */
+    _attenuation(paddedLogLw, &phi);
+    _divergence(paddedLogLw, phi, &div);
+
+    const auto solveBegin = std::chrono::steady_clock::now();
+    _solvePoisson(div, numLevels, &paddedLogLd);
+
+    std::cout << "# Poisson solve of " << paddedWidth << "x" << paddedHeight << " took "
+              << elapsedMilliseconds(solveBegin, std::chrono::steady_clock::now()) << " ms"
+              << std::endl;
+
+    const cv::Mat logLd = paddedLogLd(cv::Rect(0, 0, width, height));
+
+    /*
+        The solution is only known up to a constant,
+        shift it so that the brightest 0.5% saturate
+    */
+    _displayLuminance(logLd, 99.5f, &ld);
+
+    /*
+        Recalculate color for each channel
+    */
+    _reconstructColor(hdri, lw, ld, 1.0f, &ldri);
+
+    *out_ldri = ldri;
+
+    std::cout << "# Finish implementing tone mapping"
+              << std::endl;
+}
+
+int GradientDomainToneMapper::_haloRadiusImpl() const {
+    // the poisson solve couples every pixel
+    return WHOLE_IMAGE_HALO;
+}
+
+void GradientDomainToneMapper::_attenuation(const cv::Mat& logLw, cv::Mat* const out_phi) const {
+    /*
+        Gaussian pyramid of the log luminance, 
+        down to a few dozen pixels
+    */
+    std::vector<cv::Mat> pyramid;
+    pyramid.push_back(logLw);
+    while (std::min(pyramid.back().rows, pyramid.back().cols) >= 2 * MIN_PYRAMID_SIZE) {
+        cv::Mat next;
+        cv::pyrDown(pyramid.back(), next);
+        pyramid.push_back(next);
+    }
+
+    /*
+        Scaling factor of each level is
+        (alpha / |grad H|) * (|grad H| / alpha)^beta,
+        the factors are propagated from the coarsest level
+        and multiplied, i.e. phi_k = up(phi_k+1) * scale_k
+    */
+    cv::Mat phi;
+    for (int k = static_cast<int>(pyramid.size()) - 1; k >= 0; --k) {
+        const cv::Mat& level  = pyramid[k];
+        const int      width  = level.cols;
+        const int      height = level.rows;
+        const float    invGridSpacing = 1.0f / static_cast<float>(1 << (k + 1));
+
+        cv::Mat magnitude = _scratch(height, width, CV_32FC1);
+        TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+            for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                const float* upRow     = level.ptr<float>(std::max(iy - 1, 0));
+                const float* row       = level.ptr<float>(iy);
+                const float* downRow   = level.ptr<float>(std::min(iy + 1, height - 1));
+                float*       resultRow = magnitude.ptr<float>(iy);
+                for (int ix = 0; ix < width; ++ix) {
+                    const float gx = (row[std::min(ix + 1, width - 1)] - row[std::max(ix - 1, 0)]) * invGridSpacing;
+                    const float gy = (downRow[ix] - upRow[ix]) * invGridSpacing;
+
+                    resultRow[ix] = std::sqrt(gx * gx + gy * gy);
+                }
+            }
+        });
+
+        const float alpha    = _alpha * static_cast<float>(cv::mean(magnitude)[0]) + 1e-4f;
+        const float invAlpha = 1.0f / alpha;
+        const float exponent = _beta - 1.0f;
+
+        cv::Mat levelPhi = _scratch(height, width, CV_32FC1);
+        if (phi.empty()) {
+            levelPhi.setTo(1.0f);
+        }
+        else {
+            cv::resize(phi, levelPhi, levelPhi.size(), 0.0, 0.0, cv::INTER_LINEAR);
+        }
+
+        TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+            for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                const float* magnitudeRow = magnitude.ptr<float>(iy);
+                float*       phiRow       = levelPhi.ptr<float>(iy);
+                for (int ix = 0; ix < width; ++ix) {
+                    phiRow[ix] *= std::pow(magnitudeRow[ix] * invAlpha + 1e-4f, exponent);
+                }
+            }
+        });
+
+        phi = levelPhi;
+    }
+
+    *out_phi = phi;
+}
+
+void GradientDomainToneMapper::_divergence(const cv::Mat& logLw, 
+                                           const cv::Mat& phi, 
+                                           cv::Mat* const out_div) const {
+
+    const int width  = logLw.cols;
+    const int height = logLw.rows;
+
+    cv::Mat div = _scratch(height, width, CV_32FC1);
+
+    /*
+        G = phi * grad H by forward differences (phi is averaged 
+        onto the pixel faces), there is no flux through the image
+        border, so div G sums up to zero as Neumann boundary needs
+    */
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const float* hRow      = logLw.ptr<float>(iy);
+            const float* phiRow    = phi.ptr<float>(iy);
+            const float* hUpRow    = (iy > 0)          ? logLw.ptr<float>(iy - 1) : nullptr;
+            const float* phiUpRow  = (iy > 0)          ? phi.ptr<float>(iy - 1)   : nullptr;
+            const float* hDownRow  = (iy < height - 1) ? logLw.ptr<float>(iy + 1) : nullptr;
+            const float* phiDownRow= (iy < height - 1) ? phi.ptr<float>(iy + 1)   : nullptr;
+            float*       divRow    = div.ptr<float>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                float sum = 0.0f;
+                if (ix < width - 1) {
+                    sum += (hRow[ix + 1] - hRow[ix]) * 0.5f * (phiRow[ix + 1] + phiRow[ix]);
+                }
+                if (ix > 0) {
+                    sum -= (hRow[ix] - hRow[ix - 1]) * 0.5f * (phiRow[ix] + phiRow[ix - 1]);
+                }
+                if (hDownRow) {
+                    sum += (hDownRow[ix] - hRow[ix]) * 0.5f * (phiDownRow[ix] + phiRow[ix]);
+                }
+                if (hUpRow) {
+                    sum -= (hRow[ix] - hUpRow[ix]) * 0.5f * (phiRow[ix] + phiUpRow[ix]);
+                }
+
+                divRow[ix] = sum;
+            }
+        }
+    });
+
+    *out_div = div;
+}
+
+void GradientDomainToneMapper::_solvePoisson(const cv::Mat& div, 
+                                             const int      numLevels, 
+                                             cv::Mat* const out_u) const {
+    /*
+        Build the grid hierarchy, each coarser level halves
+        both dimensions (cell centered), div is padded so
+        that they stay even down to the coarsest level
+    */
+    std::vector<GridLevel> levels;
+
+    GridLevel finest;
+    finest.f  = div;
+    finest.u  = _scratch(div.rows, div.cols, CV_32FC1);
+    finest.r  = _scratch(div.rows, div.cols, CV_32FC1);
+    finest.h2 = 1.0f;
+    levels.push_back(finest);
+
+    for (int k = 0; k < numLevels; ++k) {
+        const int rows = levels.back().f.rows / 2;
+        const int cols = levels.back().f.cols / 2;
+
+        GridLevel coarse;
+        coarse.u  = _scratch(rows, cols, CV_32FC1);
+        coarse.f  = _scratch(rows, cols, CV_32FC1);
+        coarse.r  = _scratch(rows, cols, CV_32FC1);
+        coarse.h2 = levels.back().h2 * 4.0f;
+        levels.push_back(coarse);
+    }
+
+    const int coarsest = static_cast<int>(levels.size()) - 1;
+
+    /*
+        Full multigrid: the right hand side is restricted to 
+        every level, the coarsest level is solved directly,
+        then each finer level starts from the interpolated 
+        coarser solution and is improved by a few V-cycles
+    */
+    for (int k = 0; k < coarsest; ++k) {
+        _restrict(levels[k].f, &levels[k + 1].f);
+    }
+
+    levels[coarsest].u.setTo(0.0f);
+    _smooth(levels[coarsest], NUM_COARSE_SWEEPS);
+
+    for (int k = coarsest - 1; k >= 0; --k) {
+        _prolong(levels[k + 1].u, false, &levels[k].u);
+
+        for (int cycle = 0; cycle < NUM_V_CYCLES; ++cycle) {
+            _vCycle(levels, k);
+        }
+    }
+
+    *out_u = levels[0].u;
+}
+
+void GradientDomainToneMapper::_vCycle(std::vector<GridLevel>& levels, const int level) const {
+    GridLevel& fine = levels[level];
+    if (level == static_cast<int>(levels.size()) - 1) {
+        _smooth(fine, NUM_COARSE_SWEEPS);
+
+        return;
+    }
+
+    GridLevel& coarse = levels[level + 1];
+
+    _smooth(fine, NUM_SMOOTH_SWEEPS);
+    _residual(fine);
+
+    // correction equation on the coarser grid
+    _restrict(fine.r, &coarse.f);
+    coarse.u.setTo(0.0f);
+    _vCycle(levels, level + 1);
+    _prolong(coarse.u, true, &fine.u);
+
+    _smooth(fine, NUM_SMOOTH_SWEEPS);
+}
+
+void GradientDomainToneMapper::_smooth(GridLevel& level, const int numSweeps) const {
+    cv::Mat&       u      = level.u;
+    const cv::Mat& f      = level.f;
+    const float    h2     = level.h2;
+    const int      width  = u.cols;
+    const int      height = u.rows;
+
+    /*
+        Red-black Gauss-Seidel, pixels of one color only
+        depend on pixels of the other color, so every row
+        band of a color is updated in parallel, boundary
+        pixels only count neighbors inside the image
+    */
+    for (int sweep = 0; sweep < numSweeps; ++sweep) {
+        for (int color = 0; color < 2; ++color) {
+            TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+                for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                    float*       row     = u.ptr<float>(iy);
+                    const float* upRow   = (iy > 0)          ? u.ptr<float>(iy - 1) : nullptr;
+                    const float* downRow = (iy < height - 1) ? u.ptr<float>(iy + 1) : nullptr;
+                    const float* fRow    = f.ptr<float>(iy);
+                    for (int ix = (iy + color) & 1; ix < width; ix += 2) {
+                        float sum          = 0.0f;
+                        int   numNeighbors = 0;
+                        if (ix > 0)         { sum += row[ix - 1]; ++numNeighbors; }
+                        if (ix < width - 1) { sum += row[ix + 1]; ++numNeighbors; }
+                        if (upRow)          { sum += upRow[ix];   ++numNeighbors; }
+                        if (downRow)        { sum += downRow[ix]; ++numNeighbors; }
+
+                        if (numNeighbors > 0) {
+                            row[ix] = (sum - h2 * fRow[ix]) / static_cast<float>(numNeighbors);
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+void GradientDomainToneMapper::_residual(GridLevel& level) const {
+    const cv::Mat& u      = level.u;
+    const cv::Mat& f      = level.f;
+    cv::Mat&       r      = level.r;
+    const float    invH2  = 1.0f / level.h2;
+    const int      width  = u.cols;
+    const int      height = u.rows;
+
+    /*
+        r = f - laplacian(u)
+    */
+    TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const float* row     = u.ptr<float>(iy);
+            const float* upRow   = (iy > 0)          ? u.ptr<float>(iy - 1) : nullptr;
+            const float* downRow = (iy < height - 1) ? u.ptr<float>(iy + 1) : nullptr;
+            const float* fRow    = f.ptr<float>(iy);
+            float*       rRow    = r.ptr<float>(iy);
+            for (int ix = 0; ix < width; ++ix) {
+                float laplacian = 0.0f;
+                if (ix > 0)         { laplacian += row[ix - 1] - row[ix]; }
+                if (ix < width - 1) { laplacian += row[ix + 1] - row[ix]; }
+                if (upRow)          { laplacian += upRow[ix]   - row[ix]; }
+                if (downRow)        { laplacian += downRow[ix] - row[ix]; }
+
+                rRow[ix] = fRow[ix] - laplacian * invH2;
+            }
+        }
+    });
+}
+
+void GradientDomainToneMapper::_restrict(const cv::Mat& fine, cv::Mat* const out_coarse) const {
+    cv::Mat& coarse = *out_coarse;
+
+    /*
+        Each coarse cell is the average of its 4 fine cells
+    */
+    TaskScheduler::instance().parallelRows(coarse.rows, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const float* fineRow0  = fine.ptr<float>(2 * iy);
+            const float* fineRow1  = fine.ptr<float>(2 * iy + 1);
+            float*       coarseRow = coarse.ptr<float>(iy);
+            for (int ix = 0; ix < coarse.cols; ++ix) {
+                const int fx = 2 * ix;
+
+                coarseRow[ix] = 0.25f * (fineRow0[fx] + fineRow0[fx + 1] + fineRow1[fx] + fineRow1[fx + 1]);
+            }
+        }
+    });
+}
+
+void GradientDomainToneMapper::_prolong(const cv::Mat& coarse, 
+                                        const bool     isAdded, 
+                                        cv::Mat* const inout_fine) const {
+
+    cv::Mat&  fine         = *inout_fine;
+    const int coarseWidth  = coarse.cols;
+    const int coarseHeight = coarse.rows;
+
+    /*
+        Bilinear interpolation between cell centers, a fine cell 
+        center lies at coarse position (x / 2 - 0.25), so the
+        weights are 3/4 and 1/4, clamped at the border
+    */
+    TaskScheduler::instance().parallelRows(fine.rows, [&](const int rowBegin, const int rowEnd) {
+        for (int iy = rowBegin; iy < rowEnd; ++iy) {
+            const int   cy0 = (iy & 1) ? (iy >> 1) : (iy >> 1) - 1;
+            const float ty  = (iy & 1) ? 0.25f : 0.75f;
+
+            const float* coarseRow0 = coarse.ptr<float>(std::max(cy0, 0));
+            const float* coarseRow1 = coarse.ptr<float>(std::min(cy0 + 1, coarseHeight - 1));
+            float*       fineRow    = fine.ptr<float>(iy);
+            for (int ix = 0; ix < fine.cols; ++ix) {
+                const int   cx0 = (ix & 1) ? (ix >> 1) : (ix >> 1) - 1;
+                const float tx  = (ix & 1) ? 0.25f : 0.75f;
+                const int   x0  = std::max(cx0, 0);
+                const int   x1  = std::min(cx0 + 1, coarseWidth - 1);
+
+                const float top    = coarseRow0[x0] + tx * (coarseRow0[x1] - coarseRow0[x0]);
+                const float bottom = coarseRow1[x0] + tx * (coarseRow1[x1] - coarseRow1[x0]);
+                const float value  = top + ty * (bottom - top);
+
+                fineRow[ix] = isAdded ? fineRow[ix] + value : value;
+            }
+        }
+    });
+}
+
+int GradientDomainToneMapper::_numGridLevels(const int rows, const int cols) {
+    int numLevels = 0;
+    while ((std::min(rows, cols) >> (numLevels + 1)) >= MIN_GRID_SIZE) {
+        ++numLevels;
+    }
+
+    return numLevels;
+}
+
+} // namespace shdr
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/toneMapper.h"
+
+#include <vector>
+
+namespace shdr {
+
+/*
+    Gradient domain tone mapping of Fattal et al., 
+    "Gradient Domain High Dynamic Range Compression".
+
+    Large log luminance gradients are attenuated at every
+    scale of a gaussian pyramid while small ones are kept,
+    then the log luminance is reconstructed from the 
+    attenuated gradient field by solving a Poisson equation
+    (with Neumann boundary) using full multigrid, which 
+    runs in linear time with parallel red-black sweeps
+    (the time of every solve is logged).
+
+    Multigrid halves the grid exactly on every level, so 
+    the log luminance is padded (replicating its border)
+    to a multiple of the coarsest cell size first.
+*/
+class GradientDomainToneMapper : public ToneMapper {
+public:
+    GradientDomainToneMapper();
+    GradientDomainToneMapper(const float alpha, const float beta);
+
+private:
+    /*
+        One level of the multigrid hierarchy, which solves
+        laplacian(u) = f on a grid of spacing sqrt(h2)
+    */
+    struct GridLevel {
+        cv::Mat u;
+        cv::Mat f;
+        cv::Mat r;
+        float   h2;
+    };
+
+    void _mapImpl(const cv::Mat&        hdri,
+                  const ToneStatistics& statistics,
+                  cv::Mat* const        out_ldri) const override;
+
+    int _haloRadiusImpl() const override;
+
+    // attenuation factor of each pixel's gradient
+    void _attenuation(const cv::Mat& logLw, cv::Mat* const out_phi) const;
+
+    // divergence of the attenuated gradient field
+    void _divergence(const cv::Mat& logLw, const cv::Mat& phi, cv::Mat* const out_div) const;
+
+    void _solvePoisson(const cv::Mat& div, const int numLevels, cv::Mat* const out_u) const;
+
+    void _vCycle(std::vector<GridLevel>& levels, const int level) const;
+    void _smooth(GridLevel& level, const int numSweeps) const;
+    void _residual(GridLevel& level) const;
+    void _restrict(const cv::Mat& fine, cv::Mat* const out_coarse) const;
+    void _prolong(const cv::Mat& coarse, const bool isAdded, cv::Mat* const inout_fine) const;
+
+    // number of times the grid can be halved before it gets too small
+    static int _numGridLevels(const int rows, const int cols);
+
+    // gradient magnitude (relative to its mean) left untouched
+    float _alpha;
+    // exponent of the attenuation, < 1 compresses large gradients
+    float _beta;
+
+    static constexpr int MIN_PYRAMID_SIZE   = 32;
+    static constexpr int MIN_GRID_SIZE      = 8;
+    static constexpr int NUM_SMOOTH_SWEEPS  = 2;
+    static constexpr int NUM_COARSE_SWEEPS  = 200;
+    static constexpr int NUM_V_CYCLES       = 2;
+};
+
+} // namespace shdr
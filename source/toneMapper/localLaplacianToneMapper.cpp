@@ -0,0 +1,193 @@
+#include "toneMapper/localLaplacianToneMapper.h"
+
+#include "core/taskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace shdr {
+
+LocalLaplacianToneMapper::LocalLaplacianToneMapper() :
+    LocalLaplacianToneMapper(std::log(2.5f), 0.8f, 0.4f) {
+}
+
+LocalLaplacianToneMapper::LocalLaplacianToneMapper(const float sigma, 
+                                                   const float alpha, 
+                                                   const float beta) :
+    _sigma(sigma),
+    _alpha(alpha),
+    _beta(beta) {
+}
+
+void LocalLaplacianToneMapper::_mapImpl(const cv::Mat&        hdri,
+                                        const ToneStatistics& statistics,
+                                        cv::Mat* const        out_ldri) const {
+
+    std::cout << "# Begin to implement tone mapping using local laplacian method"
+              << std::endl;
+
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    int numLevels = 1;
+    while ((std::min(width, height) >> numLevels) >= MIN_PYRAMID_SIZE) {
+        ++numLevels;
+    }
+
+    cv::Mat ldri;
+    cv::Mat lw;
+    cv::Mat logLw    = _scratch(height, width, CV_32FC1);
+    cv::Mat remapped = _scratch(height, width, CV_32FC1);
+    cv::Mat ld;
+
+    _luminance(hdri, &lw);
+    lw.convertTo(logLw, CV_32FC1, 1.0, ToneStatistics::LUMINANCE_DELTA);
+    cv::log(logLw, logLw);
+
+    std::vector<cv::Mat> inputPyramid;
+    _gaussianPyramid(logLw, numLevels, &inputPyramid);
+
+    std::vector<cv::Mat> outputPyramid(numLevels);
+    for (int l = 0; l < numLevels - 1; ++l) {
+        outputPyramid[l] = _scratch(inputPyramid[l].rows, inputPyramid[l].cols, CV_32FC1);
+        outputPyramid[l].setTo(0.0f);
+    }
+
+    /*
+        References are spread evenly over the log luminance
+        range (ignoring outliers), roughly one per sigma
+    */
+    const float minLog = statistics.percentileLogLuminance(0.5f);
+    const float maxLog = std::max(statistics.percentileLogLuminance(99.5f), minLog + _sigma);
+
+    const int numReferences = std::min(
+        std::max(static_cast<int>(std::ceil((maxLog - minLog) / _sigma)) + 1, 2), 
+        MAX_NUM_REFERENCES);
+    const float step    = (maxLog - minLog) / static_cast<float>(numReferences - 1);
+    const float invStep = 1.0f / step;
+
+    std::vector<cv::Mat> remappedPyramid;
+    for (int j = 0; j < numReferences; ++j) {
+        const float reference = minLog + step * static_cast<float>(j);
+
+        TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+            for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                const float* logLwRow    = logLw.ptr<float>(iy);
+                float*       remappedRow = remapped.ptr<float>(iy);
+                for (int ix = 0; ix < width; ++ix) {
+                    remappedRow[ix] = _remap(logLwRow[ix], reference);
+                }
+            }
+        });
+
+        _gaussianPyramid(remapped, numLevels, &remappedPyramid);
+
+        /*
+            Laplacian coefficients of the remapped image are 
+            added to the output with a hat weight on the input's
+            gaussian coefficient, levels are independent
+        */
+        TaskScheduler::instance().parallelFor(0, numLevels - 1, 1, [&](const int levelBegin, const int levelEnd) {
+            for (int l = levelBegin; l < levelEnd; ++l) {
+                const cv::Mat& gaussian = inputPyramid[l];
+                const cv::Mat& current  = remappedPyramid[l];
+                cv::Mat&       output   = outputPyramid[l];
+
+                cv::Mat upsampled = _scratch(current.rows, current.cols, CV_32FC1);
+                cv::pyrUp(remappedPyramid[l + 1], upsampled, current.size());
+
+                TaskScheduler::instance().parallelRows(current.rows, [&](const int rowBegin, const int rowEnd) {
+                    for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                        const float* gaussianRow  = gaussian.ptr<float>(iy);
+                        const float* currentRow   = current.ptr<float>(iy);
+                        const float* upsampledRow = upsampled.ptr<float>(iy);
+                        float*       outputRow    = output.ptr<float>(iy);
+                        for (int ix = 0; ix < current.cols; ++ix) {
+                            const float value  = std::min(std::max(gaussianRow[ix], minLog), maxLog);
+                            const float weight = 1.0f - std::abs(value - reference) * invStep;
+                            if (weight > 0.0f) {
+                                outputRow[ix] += weight * (currentRow[ix] - upsampledRow[ix]);
+                            }
+                        }
+                    }
+                });
+            }
+        });
+    }
+
+    /*
+        The residual keeps the coarsest illumination, 
+        it is compressed like an edge around its mean
+    */
+    cv::Mat& residual = outputPyramid[numLevels - 1];
+    residual = _scratch(inputPyramid[numLevels - 1].rows, inputPyramid[numLevels - 1].cols, CV_32FC1);
+
+    const float meanResidual = static_cast<float>(cv::mean(inputPyramid[numLevels - 1])[0]);
+    inputPyramid[numLevels - 1].convertTo(residual, CV_32FC1, _beta, (1.0f - _beta) * meanResidual);
+
+    /*
+        Collapse the output pyramid
+    */
+    cv::Mat logLd = residual;
+    for (int l = numLevels - 2; l >= 0; --l) {
+        cv::Mat upsampled = _scratch(outputPyramid[l].rows, outputPyramid[l].cols, CV_32FC1);
+        cv::pyrUp(logLd, upsampled, outputPyramid[l].size());
+        cv::add(upsampled, outputPyramid[l], upsampled);
+
+        logLd = upsampled;
+    }
+
+    /*
+        Shift the result so that the brightest 0.5% saturate
+    */
+    _displayLuminance(logLd, 99.5f, &ld);
+
+    /*
+        Recalculate color for each channel
+    */
+    _reconstructColor(hdri, lw, ld, 1.0f, &ldri);
+
+    *out_ldri = ldri;
+
+    std::cout << "# Finish implementing tone mapping"
+              << std::endl;
+}
+
+int LocalLaplacianToneMapper::_haloRadiusImpl() const {
+    // the coarsest pyramid level spans the whole image
+    return WHOLE_IMAGE_HALO;
+}
+
+void LocalLaplacianToneMapper::_gaussianPyramid(const cv::Mat&              image,
+                                                const int                   numLevels,
+                                                std::vector<cv::Mat>* const out_pyramid) const {
+
+    out_pyramid->resize(numLevels);
+    (*out_pyramid)[0] = image;
+
+    for (int l = 1; l < numLevels; ++l) {
+        const cv::Mat& previous = (*out_pyramid)[l - 1];
+
+        cv::Mat level = _scratch((previous.rows + 1) / 2, (previous.cols + 1) / 2, CV_32FC1);
+        cv::pyrDown(previous, level, level.size());
+
+        (*out_pyramid)[l] = level;
+    }
+}
+
+float LocalLaplacianToneMapper::_remap(const float value, const float reference) const {
+    const float difference = value - reference;
+    const float magnitude  = std::abs(difference);
+    const float sign       = (difference < 0.0f) ? -1.0f : 1.0f;
+
+    // details
+    if (magnitude <= _sigma) {
+        return reference + sign * _sigma * std::pow(magnitude / _sigma, _alpha);
+    }
+
+    // edges
+    return reference + sign * (_beta * (magnitude - _sigma) + _sigma);
+}
+
+} // namespace shdr
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core/toneMapper.h"
+
+#include <vector>
+
+namespace shdr {
+
+/*
+    Local laplacian tone mapping of Paris et al., using the
+    fast approximation of Aubry et al., "Fast Local Laplacian
+    Filters: Theory and Applications".
+
+    The log luminance is remapped around a small fixed set 
+    of reference values, and the laplacian coefficients of 
+    each remapped image are blended into the output pyramid
+    according to where the input's gaussian pyramid lies 
+    between the references. Differences up to sigma are
+    details (scaled by the power alpha), larger ones are 
+    edges (scaled by beta), so beta < 1 compresses the range
+    without halos.
+
+    References are processed one at a time, so only the
+    input, output and one remapped pyramid are resident.
+*/
+class LocalLaplacianToneMapper : public ToneMapper {
+public:
+    LocalLaplacianToneMapper();
+    LocalLaplacianToneMapper(const float sigma, const float alpha, const float beta);
+
+private:
+    void _mapImpl(const cv::Mat&        hdri,
+                  const ToneStatistics& statistics,
+                  cv::Mat* const        out_ldri) const override;
+
+    int _haloRadiusImpl() const override;
+
+    void _gaussianPyramid(const cv::Mat&              image,
+                          const int                   numLevels,
+                          std::vector<cv::Mat>* const out_pyramid) const;
+
+    // remapping function r(value) around the reference
+    float _remap(const float value, const float reference) const;
+
+    // detail / edge threshold in log luminance
+    float _sigma;
+    // detail exponent, < 1 enhances details
+    float _alpha;
+    // edge scale, < 1 compresses the range
+    float _beta;
+
+    static constexpr int MIN_PYRAMID_SIZE   = 16;
+    static constexpr int MAX_NUM_REFERENCES = 16;
+};
+
+} // namespace shdr
@@ -1,68 +1,78 @@
 #include "toneMapper/photographicGlobalToneMapper.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
 namespace shdr {
 
 PhotographicGlobalToneMapper::PhotographicGlobalToneMapper() :
-    PhotographicGlobalToneMapper(0.7f, 0.000001f) {
+    PhotographicGlobalToneMapper(0.7f, 100.0f) {
 }
 
-PhotographicGlobalToneMapper::PhotographicGlobalToneMapper(const float alpha, const float delta) :
+// the key comes from the log-average of the statistics, which use ToneStatistics::LUMINANCE_DELTA
+PhotographicGlobalToneMapper::PhotographicGlobalToneMapper(const float alpha, const float whitePercentile) :
     _alpha(alpha),
-    _delta(delta) {
+    _whitePercentile(whitePercentile) {
 }
 
-void PhotographicGlobalToneMapper::map(const cv::Mat& hdri, 
-                                       cv::Mat* const out_ldri) const {
+void PhotographicGlobalToneMapper::_mapImpl(const cv::Mat&        hdri,
+                                             const ToneStatistics& statistics,
+                                             cv::Mat* const        out_ldri) const {
 
     std::cout << "# Begin to implement tone mapping using photographic global method"
               << std::endl;
 
-    cv::Mat ldri = hdri.clone();
-    cv::Mat lw;
-    cv::Mat logLw;
-    cv::Mat lm; 
-    cv::Mat ld;
+    /*
+        The operator only depends on luminance, so the curve is
+        baked once the key and the white point are known (or 
+        imported), then applied with one lookup per pixel
+    */
+    ToneCurve curve;
+    _globalCurve([&](ToneCurve* const out_curve) {
+        _bakeCurve(statistics, out_curve);
+    }, &curve);
 
-    cv::cvtColor(hdri, lw, cv::COLOR_BGR2GRAY);
-    cv::log(lw + _delta, logLw);
+    cv::Mat ldri;
+    _applyCurve(hdri, curve, &ldri);
 
-    const float meanLogLw = static_cast<float>(cv::mean(logLw)[0]);
-    const float meanLw    = std::exp(meanLogLw);
-    const float invMeanLw = 1.0f / meanLw;
-    lm = _alpha * invMeanLw * lw;
+    *out_ldri = ldri;
 
-    double min;
-    double max;
-    cv::minMaxLoc(lm, &min, &max);
+    std::cout << "# Finish implementing tone mapping"
+              << std::endl;
+}
 
-    const float lWhite     = static_cast<float>(max);
-    const float invLWhite2 = 1.0f / (lWhite * lWhite);
+bool PhotographicGlobalToneMapper::_isGlobalImpl() const {
+    return true;
+}
 
-    const cv::Mat up   = 1.0f + lm * invLWhite2;
-    const cv::Mat down = 1.0f + lm;
-    cv::divide(up, down, ld);
-    ld = ld.mul(lm);
+void PhotographicGlobalToneMapper::_bakeCurve(const ToneStatistics& statistics, 
+                                              ToneCurve* const      out_curve) const {
+
+    const float meanLogLw = statistics.logAverageLuminance();
+    const float meanLw    = std::exp(meanLogLw);
+    const float invMeanLw = 1.0f / meanLw;
+    const float lmScale   = _alpha * invMeanLw;
 
     /*
-        calculate each channel
+        white point is the scaled luminance at the given percentile,
+        which is the largest one by default
     */
-    std::vector<cv::Mat> vecMat;
-    cv::split(ldri, vecMat);
-    for (int c = 0; c < 3; ++c) {
-        cv::divide(vecMat[c], lw, vecMat[c]);
-        vecMat[c] = vecMat[c].mul(ld);
-    }
-    cv::merge(vecMat, ldri);
-    ldri *= 255.0f;
-    ldri.convertTo(ldri, CV_8UC3);
+    const float logLWhite  = statistics.percentileLogLuminance(_whitePercentile);
+    const float lWhite     = lmScale * std::exp(logLWhite);
+    const float invLWhite2 = 1.0f / (lWhite * lWhite);
 
-    *out_ldri = ldri;
+    /*
+        ld = lm * (1 + lm / lWhite^2) / (1 + lm), sampled over
+        the whole log luminance range of the statistics so that
+        an exported curve also covers other scenes
+    */
+    out_curve->bake([=](const float logLw) {
+        const float lw = std::max(std::exp(logLw) - ToneStatistics::LUMINANCE_DELTA, 0.0f);
+        const float lm = lmScale * lw;
 
-    std::cout << "# Finish implementing tone mapping"
-              << std::endl;
+        return lm * (1.0f + lm * invLWhite2) / (1.0f + lm);
+    }, ToneStatistics::MIN_HISTOGRAM_LOG, ToneStatistics::MAX_HISTOGRAM_LOG);
 }
 
-} // namespace shdr
\ No newline at end of file
+} // namespace shdr
@@ -7,14 +7,23 @@ namespace shdr {
 class PhotographicGlobalToneMapper : public ToneMapper {
 public:
     PhotographicGlobalToneMapper();
-    PhotographicGlobalToneMapper(const float alpha, const float delta);
-
-    void map(const cv::Mat& hdri, 
-             cv::Mat* const out_ldri) const override;
+    PhotographicGlobalToneMapper(const float alpha, const float whitePercentile);
 
 private:
+    void _mapImpl(const cv::Mat&        hdri,
+                  const ToneStatistics& statistics,
+                  cv::Mat* const        out_ldri) const override;
+
+    bool _isGlobalImpl() const override;
+
+    // ld = lm * (1 + lm / lWhite^2) / (1 + lm) over log luminance
+    void _bakeCurve(const ToneStatistics& statistics, ToneCurve* const out_curve) const;
+
     float _alpha;
-    float _delta;
+
+    // luminance percentile (0-100) used as white point,
+    // 100 means the maximum luminance
+    float _whitePercentile;
 };
 
 } // namespace shdr
\ No newline at end of file
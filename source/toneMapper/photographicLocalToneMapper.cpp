@@ -1,5 +1,7 @@
 #include "toneMapper/photographicLocalToneMapper.h"
 
+#include "core/taskScheduler.h"
+
 #include <cmath>
 #include <iostream>
 
@@ -21,42 +23,37 @@ PhotographicLocalToneMapper::PhotographicLocalToneMapper(const float alpha,
     _maxKernelSize(maxKernelSize) {
 }
 
-void PhotographicLocalToneMapper::map(const cv::Mat& hdri, 
-                                      cv::Mat* const out_ldri) const {
+void PhotographicLocalToneMapper::_mapImpl(const cv::Mat&        hdri,
+                                            const ToneStatistics& statistics,
+                                            cv::Mat* const        out_ldri) const {
 
     std::cout << "# Begin to implement tone mapping using photographic local method"
               << std::endl;
 
-    cv::Mat ldri = hdri.clone();
+    const int width  = hdri.cols;
+    const int height = hdri.rows;
+
+    cv::Mat ldri;
     cv::Mat lw;
-    cv::Mat logLw;
-    cv::Mat lm;
-    cv::Mat ld;
+    cv::Mat lm = _scratch(height, width, CV_32FC1);
+    cv::Mat ld = _scratch(height, width, CV_32FC1);
     cv::Mat lsmax;
 
-    cv::cvtColor(hdri, lw, cv::COLOR_BGR2GRAY);
-    cv::log(lw + _delta, logLw);
+    _luminance(hdri, &lw);
     
-    const float meanLogLw = static_cast<float>(cv::mean(logLw)[0]);
+    const float meanLogLw = statistics.logAverageLuminance();
     const float meanLw    = std::exp(meanLogLw);
     const float invMeanLw = 1.0f / meanLw;
-    lm = _alpha * invMeanLw * lw;
+    lw.convertTo(lm, CV_32FC1, _alpha * invMeanLw);
 
     _localOperator(lm, &lsmax);
-    cv::divide(lm, 1.0f + lsmax, ld);
+    lsmax.convertTo(lsmax, CV_32FC1, 1.0, 1.0);
+    cv::divide(lm, lsmax, ld);
 
     /*
         calculate each channel
     */
-    std::vector<cv::Mat> vecMat;
-    cv::split(ldri, vecMat);
-    for (int c = 0; c < 3; ++c) {
-        cv::divide(vecMat[c], lw, vecMat[c]);
-        vecMat[c] = vecMat[c].mul(ld);
-    }
-    cv::merge(vecMat, ldri);
-    ldri *= 255.0f;
-    ldri.convertTo(ldri, CV_8UC3);
+    _reconstructColor(hdri, lw, ld, 1.0f, &ldri);
 
     *out_ldri = ldri;
 
@@ -64,51 +61,65 @@ void PhotographicLocalToneMapper::map(const cv::Mat& hdri,
               << std::endl;
 }
 
-void PhotographicLocalToneMapper::_localOperator(const cv::Mat& lm, cv::Mat* const out_lsmax) const {
-    cv::Mat lsmax = lm.clone();
+int PhotographicLocalToneMapper::_haloRadiusImpl() const {
+    // radius of the largest blur kernel
+    return (_maxKernelSize - 1) / 2;
+}
 
+void PhotographicLocalToneMapper::_localOperator(const cv::Mat& lm, cv::Mat* const out_lsmax) const {
     const int width      = lm.cols;
     const int height     = lm.rows;
     const int numKernels = (_maxKernelSize-1) / 2 + 1;
+
+    cv::Mat lsmax = _scratch(height, width, CV_32FC1);
+    lm.copyTo(lsmax);
 	
     /*
         Create all blur images
     */
-    std::vector<cv::Mat> lblur;
-    for (int size = 1; size <= _maxKernelSize; size += 2) {
-        cv::Mat blur;
-        cv::GaussianBlur(lm, blur, cv::Size(size, size), 0);
-        lblur.push_back(blur);
-    }
+    std::vector<cv::Mat> lblur(numKernels);
+    TaskScheduler::instance().parallelFor(0, numKernels, 1, [&](const int begin, const int end) {
+        for (int n = begin; n < end; ++n) {
+            const int size = 1 + 2 * n;
+
+            lblur[n] = _scratch(height, width, CV_32FC1);
+            cv::GaussianBlur(lm, lblur[n], cv::Size(size, size), 0);
+        }
+    });
 
     /*
         For each pixel, find its lsmax
     */
-    cv::Mat index = cv::Mat::zeros(lm.size(), CV_8UC1);
-    cv::Mat vs;
+    cv::Mat index = _scratch(height, width, CV_8UC1);
+    cv::Mat up    = _scratch(height, width, CV_32FC1);
+    cv::Mat down  = _scratch(height, width, CV_32FC1);
+    cv::Mat vs    = _scratch(height, width, CV_32FC1);
+    index.setTo(0);
     // for each kernel size (blur image)
     for (int n = 0; n < numKernels - 1; ++n) {
         const int s = 1 + 2 * n;
         
-        const cv::Mat up   = lblur[n] - lblur[n + 1];
-        const cv::Mat down = std::pow(2.0f, _phi) * _alpha / (s * s) + lblur[n];
+        cv::subtract(lblur[n], lblur[n + 1], up);
+        lblur[n].convertTo(down, CV_32FC1, 1.0, std::pow(2.0f, _phi) * _alpha / (s * s));
         cv::divide(up, down, vs);
         vs = cv::abs(vs);
 
         // check if vs < epsilon
-        for (int iy = 0; iy < height; ++iy) {
-            for (int ix = 0; ix < width; ++ix) {
-                if (vs.at<float>(iy, ix) < _epsilon) {
-                    if (index.at<uchar>(iy, ix) == 0) {
-                        const cv::Mat& ls = lblur[n];
-                        lsmax.at<float>(iy, ix) = ls.at<float>(iy, ix);
+        TaskScheduler::instance().parallelRows(height, [&](const int rowBegin, const int rowEnd) {
+            for (int iy = rowBegin; iy < rowEnd; ++iy) {
+                for (int ix = 0; ix < width; ++ix) {
+                    if (vs.at<float>(iy, ix) < _epsilon) {
+                        if (index.at<uchar>(iy, ix) == 0) {
+                            const cv::Mat& ls = lblur[n];
+                            lsmax.at<float>(iy, ix) = ls.at<float>(iy, ix);
+                        }
+                    }
+                    else {
+                        index.at<uchar>(iy, ix) = 1;
                     }
-                }
-                else {
-                    index.at<uchar>(iy, ix) = 1;
                 }
             }
-        }
+        });
     }
 
     *out_lsmax = lsmax;
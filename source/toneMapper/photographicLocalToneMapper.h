@@ -13,10 +13,13 @@ public:
                                 const float epsilon,
                                 const int   maxKernelSize);
 
-    void map(const cv::Mat& hdri, 
-             cv::Mat* const out_ldri) const override;
-
 private:
+    void _mapImpl(const cv::Mat&        hdri,
+                  const ToneStatistics& statistics,
+                  cv::Mat* const        out_ldri) const override;
+
+    int _haloRadiusImpl() const override;
+
     void _localOperator(const cv::Mat& lm, cv::Mat* const out_lsmax) const;
 
     float _alpha;